@@ -14,6 +14,12 @@ INCLUDEPATH += /usr/local/include/raspicam
 INCLUDEPATH += /home/laris/wiringPi/wiringPi
 LIBS += -L /usr/local/lib -lraspicam -lwiringPi -lcrypt
 
+# io_uring backend of DeviceLoop (liburing >= 2.2): qmake CONFIG+=io_uring
+io_uring {
+    DEFINES += POODLE_IO_URING
+    LIBS += -luring
+}
+
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
 TARGET = Poodle_demo
@@ -27,7 +33,21 @@ SOURCES += main.cpp\
     seriallens.cpp \
     motor_canopen_driver.cpp \
     poodlecamera.cpp \
-    log_handler.cpp
+    log_handler.cpp \
+    canreceiver.cpp \
+    cantransport.cpp \
+    loopbackcan.cpp \
+    cancapture.cpp \
+    canbcm.cpp \
+    deviceloop.cpp \
+    trajectory.cpp \
+    odcache.cpp \
+    sdoclient.cpp \
+    ioworker.cpp \
+    nodemonitor.cpp \
+    axisconfig.cpp \
+    virtualdrive.cpp \
+    targetscheduler.cpp
 
 HEADERS  += poodle_window.h \
     canwrapper.h \
@@ -35,6 +55,21 @@ HEADERS  += poodle_window.h \
     seriallens.h \
     motor_canopen_driver.h \
     poodlecamera.h \
-    log_handler.h
+    log_handler.h \
+    canringbuffer.h \
+    canreceiver.h \
+    cantransport.h \
+    loopbackcan.h \
+    cancapture.h \
+    canbcm.h \
+    deviceloop.h \
+    trajectory.h \
+    odcache.h \
+    sdoclient.h \
+    ioworker.h \
+    nodemonitor.h \
+    axisconfig.h \
+    virtualdrive.h \
+    targetscheduler.h
 
 FORMS    += poodle_window.ui
@@ -0,0 +1,117 @@
+#include "axisconfig.h"
+
+#include <QFile>
+#include <QSettings>
+#include <QStringList>
+
+#include <stdlib.h>
+#include <string.h>
+
+static AxisConfig makeAxis(const QString& name, unsigned char nodeid, const char* bus, int32_t offset){
+    AxisConfig axis;
+    axis.name = name;
+    axis.nodeid = nodeid;
+    axis.bus = bus;
+    axis.offset = offset;
+    axis.minAngle = 0;
+    axis.maxAngle = 0;
+    axis.profileVelocity = 0;
+    axis.profileAcceleration = 0;
+    axis.profileDeceleration = 0;
+    return axis;
+}
+
+std::vector<AxisConfig> defaultAxes(const char* interfaceName){
+    std::vector<AxisConfig> axes;
+    axes.push_back(makeAxis("Mirror " + QString::number(ID_MIRROR_1), ID_MIRROR_1, interfaceName, OFFCET_MIRROR_1));
+    axes.push_back(makeAxis("Mirror " + QString::number(ID_MIRROR_2), ID_MIRROR_2, interfaceName, OFFCET_MIRROR_2));
+    return axes;
+}
+
+bool loadAxes(const QString& path, const char* defaultBus, std::vector<AxisConfig>& axes, QString& error){
+    QSettings settings(path, QSettings::IniFormat);
+    if(settings.status() != QSettings::NoError){
+        error = "Can not read " + path;
+        return false;
+    }
+
+    std::vector<AxisConfig> table;
+    QStringList groups = settings.childGroups();
+    for(int i=1; groups.contains("axis" + QString::number(i)); i++){
+        QString group = "axis" + QString::number(i);
+        settings.beginGroup(group);
+        bool ok = true;
+        bool valid;
+        int nodeid = settings.value("node").toInt(&valid);
+        ok = ok && valid;
+        AxisConfig axis = makeAxis(settings.value("name", group).toString(), nodeid,
+                                   settings.value("bus", defaultBus).toString().toStdString().c_str(), settings.value("offset", 0).toInt(&valid));
+        ok = ok && valid;
+        if(settings.contains("min") || settings.contains("max")){
+            axis.minAngle = settings.value("min").toInt(&valid);
+            ok = ok && valid;
+            axis.maxAngle = settings.value("max").toInt(&valid);
+            ok = ok && valid;
+        }
+        axis.profileVelocity = settings.value("velocity", 0).toUInt(&valid);
+        ok = ok && valid;
+        axis.profileAcceleration = settings.value("acceleration", 0).toUInt(&valid);
+        ok = ok && valid;
+        axis.profileDeceleration = settings.value("deceleration", 0).toUInt(&valid);
+        ok = ok && valid;
+        settings.endGroup();
+
+        if(!ok || nodeid < 1 || nodeid > 127){
+            error = "Invalid value in [" + group + "] of " + path;
+            return false;
+        }
+        for(unsigned int j=0; j<table.size(); j++){
+            if(table[j].nodeid == axis.nodeid){
+                error = "Node " + QString::number(nodeid) + " used by two axes in " + path;
+                return false;
+            }
+        }
+        table.push_back(axis);
+    }
+
+    if(table.empty()){
+        error = "No [axis1] group in " + path;
+        return false;
+    }
+    axes = table;
+    return true;
+}
+
+bool loadSimulation(const QString& path, VirtualDriveConfig& config, std::string& bus){
+    config = defaultVirtualDriveConfig();
+    bus.clear();
+    bool enabled = false;
+
+    if(QFile::exists(path)){
+        QSettings settings(path, QSettings::IniFormat);
+        if(settings.childGroups().contains("simulation")){
+            settings.beginGroup("simulation");
+            enabled = settings.value("enabled", true).toBool();
+            bus = settings.value("bus", "").toString().toStdString();
+            config.latencyUs = settings.value("latency", config.latencyUs).toInt();
+            config.jitterUs = settings.value("jitter", config.jitterUs).toInt();
+            config.cycleUs = settings.value("cycle", config.cycleUs).toInt();
+            config.velocity = settings.value("velocity", config.velocity).toUInt();
+            config.acceleration = settings.value("acceleration", config.acceleration).toUInt();
+            config.deceleration = settings.value("deceleration", config.deceleration).toUInt();
+            settings.endGroup();
+        }
+    }
+
+    // the environment wins, to run the same machine file on a test bench or in the CI
+    const char* simulation = getenv("POODLE_SIMULATION");
+    if(simulation != NULL && simulation[0] != '\0'){
+        enabled = strcmp(simulation, "0") != 0;
+        if(enabled && strcmp(simulation, "1") != 0) bus = simulation;
+    }
+    const char* latency = getenv("POODLE_SIM_LATENCY_US");
+    if(latency != NULL) config.latencyUs = atoi(latency);
+    const char* jitter = getenv("POODLE_SIM_JITTER_US");
+    if(jitter != NULL) config.jitterUs = atoi(jitter);
+    return enabled;
+}
@@ -0,0 +1,70 @@
+#ifndef AXISCONFIG_H
+#define AXISCONFIG_H
+
+#include <QString>
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "virtualdrive.h"
+
+// default machine: the two mirrors of the weeding head, used when there is no configuration file
+#define ID_MIRROR_1 3
+#define ID_MIRROR_2 4
+
+#define OFFCET_MIRROR_1 265750
+#define OFFCET_MIRROR_2 441000
+
+#define AXIS_CONFIG_FILE "poodle_axes.ini" // in the working directory
+
+// One axis of the machine: a drive and the mirror it moves
+struct AxisConfig
+{
+    QString name;                 // for the logs and the GUI
+    unsigned char nodeid;
+    std::string bus;              // interface of the node (can0, vcan0, loop0...)
+    int32_t offset;               // position (counts) of the angle 0
+    int32_t minAngle;             // allowed targets, relative to the offset (no limit if minAngle >= maxAngle)
+    int32_t maxAngle;
+    uint32_t profileVelocity;     // 0x6081, 0 to keep the value of the drive (the moves are planned within these values)
+    uint32_t profileAcceleration; // 0x6083, 0 to keep the value of the drive
+    uint32_t profileDeceleration; // 0x6084, 0 to keep the value of the drive
+
+    bool hasLimits() const { return minAngle < maxAngle; }
+    bool isAllowed(int32_t angle) const { return !hasLimits() || (angle >= minAngle && angle <= maxAngle); }
+};
+
+std::vector<AxisConfig> defaultAxes(const char* interfaceName); // function to get the two mirrors of the macros above, on interfaceName
+
+bool loadAxes(const QString& path, const char* defaultBus, std::vector<AxisConfig>& axes, QString& error);
+// function to read the axes of an ini file, one group per axis, numbered from 1 in the order of the table:
+//   [axis1]
+//   name=mirror 1
+//   node=3
+//   bus=can0            (optional, defaultBus)
+//   offset=265750
+//   min=-100000         (optional, with max)
+//   max=100000
+//   velocity=...        (optional, profile parameters written by configureMirrors, the limits of the synchronized profiles)
+//   acceleration=...
+//   deceleration=...
+// error: the reason of the failure, for the logs
+// return false if the file can not be read or an axis is not valid (axes is left untouched)
+
+bool loadSimulation(const QString& path, VirtualDriveConfig& config, std::string& bus);
+// function to know if the axes should be simulated (see VirtualDrive), from the [simulation] group of the axes file:
+//   [simulation]
+//   enabled=true
+//   bus=vcan0           (optional: every axis is moved to this interface, vcan* or loop*)
+//   latency=300         (optional, us, see VirtualDriveConfig)
+//   jitter=100
+//   cycle=1000
+//   velocity=...        (optional, default profile parameters of the drives)
+//   acceleration=...
+//   deceleration=...
+// or from the environment, which overrides the file: POODLE_SIMULATION=1 or POODLE_SIMULATION=<bus>,
+// POODLE_SIM_LATENCY_US, POODLE_SIM_JITTER_US
+// config: default values for the keys not given, bus: empty to keep the bus of each axis
+// return true if the simulation is enabled
+
+#endif // AXISCONFIG_H
@@ -0,0 +1,203 @@
+#include "canbcm.h"
+
+#include <sys/epoll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <net/if.h>
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <vector>
+
+#define INVALID_SOCKET -1
+#define BCM_MAX_FRAMES 256 // limit of the kernel for one job
+
+CanBcm::CanBcm(){
+    m_initialized = false;
+    m_socket = INVALID_SOCKET;
+    m_epoll = INVALID_SOCKET;
+}
+
+CanBcm::~CanBcm(){
+    Close();
+}
+
+// Open the broadcast manager socket. The bcm socket is connected (not bound) to the interface.
+// Parameters:
+// interfaceName - the name of the CAN interface (can0, vcan0...)
+// errorCode - error code indicating why init did fail
+bool CanBcm::Init(const char *interfaceName, int &errorCode){
+    struct sockaddr_can addr;
+    struct ifreq ifr;
+
+    errorCode = 0;
+    if(m_initialized) return true;
+
+    m_socket = socket(PF_CAN, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, CAN_BCM);
+    if(m_socket < 0){
+        errorCode = errno;
+        m_socket = INVALID_SOCKET;
+        return false;
+    }
+
+    strncpy(ifr.ifr_name, interfaceName, IFNAMSIZ);
+    ifr.ifr_name[IFNAMSIZ-1] = '\0';
+    if(ioctl(m_socket, SIOCGIFINDEX, &ifr)){
+        errorCode = errno;
+        close(m_socket);
+        m_socket = INVALID_SOCKET;
+        return false;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.can_family = AF_CAN;
+    addr.can_ifindex = ifr.ifr_ifindex;
+    if(connect(m_socket, (struct sockaddr *)&addr, sizeof(addr))){
+        errorCode = errno;
+        close(m_socket);
+        m_socket = INVALID_SOCKET;
+        return false;
+    }
+
+    m_epoll = epoll_create1(EPOLL_CLOEXEC);
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = m_socket;
+    if(m_epoll < 0 || epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_socket, &ev)){
+        errorCode = errno;
+        if(m_epoll >= 0) close(m_epoll);
+        close(m_socket);
+        m_socket = INVALID_SOCKET;
+        m_epoll = INVALID_SOCKET;
+        return false;
+    }
+
+    m_initialized = true;
+    return true;
+}
+
+// Close the socket, the kernel removes every job of the socket
+void CanBcm::Close(){
+    if(m_initialized){
+        close(m_epoll);
+        close(m_socket);
+        m_epoll = INVALID_SOCKET;
+        m_socket = INVALID_SOCKET;
+        m_initialized = false;
+    }
+}
+
+// Send one command to the broadcast manager: a bcm_msg_head followed by count frames
+// ival1Us: rx timeout (RX_SETUP), ival2Us: period (TX_SETUP)
+bool CanBcm::sendHead(uint32_t opcode, uint32_t flags, canid_t canid, uint32_t ival1Us, uint32_t ival2Us, const struct can_frame *frames, int count, int &errorCode){
+    errorCode = 0;
+    if(!m_initialized){
+        errorCode = -1;
+        return false;
+    }
+    if(count < 0 || count > BCM_MAX_FRAMES){
+        errorCode = EINVAL;
+        return false;
+    }
+
+    std::vector<char> buffer(sizeof(struct bcm_msg_head) + count * sizeof(struct can_frame), 0);
+    struct bcm_msg_head* head = (struct bcm_msg_head*)&buffer[0];
+    head->opcode = opcode;
+    head->flags = flags;
+    head->count = 0;
+    head->ival1.tv_sec = ival1Us / 1000000;
+    head->ival1.tv_usec = ival1Us % 1000000;
+    head->ival2.tv_sec = ival2Us / 1000000;
+    head->ival2.tv_usec = ival2Us % 1000000;
+    head->can_id = canid;
+    head->nframes = count;
+    if(count > 0){
+        memcpy(&buffer[sizeof(struct bcm_msg_head)], frames, count * sizeof(struct can_frame));
+    }
+
+    if(write(m_socket, &buffer[0], buffer.size()) < 0){
+        errorCode = errno;
+        return false;
+    }
+    return true;
+}
+
+bool CanBcm::AddCyclicTx(canid_t canid, const struct can_frame *frames, int count, uint32_t intervalUs, int &errorCode){
+    // SETTIMER: take ival2 as the period, STARTTIMER: start now
+    return sendHead(TX_SETUP, SETTIMER | STARTTIMER, canid, 0, intervalUs, frames, count, errorCode);
+}
+
+bool CanBcm::UpdateCyclicTx(canid_t canid, const struct can_frame *frames, int count, int &errorCode){
+    // without SETTIMER/STARTTIMER the kernel only replaces the content, the next cycle sends the new frames
+    return sendHead(TX_SETUP, 0, canid, 0, 0, frames, count, errorCode);
+}
+
+bool CanBcm::RemoveCyclicTx(canid_t canid, int &errorCode){
+    return sendHead(TX_DELETE, 0, canid, 0, 0, NULL, 0, errorCode);
+}
+
+bool CanBcm::AddRxFilter(canid_t canid, const uint8_t *mask, uint8_t len, uint32_t timeoutUs, int &errorCode){
+    // the timeout is given in ival1 for the rx jobs
+    uint32_t flags = 0;
+    if(timeoutUs > 0) flags |= SETTIMER | STARTTIMER;
+
+    if(mask == NULL){
+        // no content filter: every reception of canid is notified
+        return sendHead(RX_SETUP, flags | RX_FILTER_ID, canid, timeoutUs, 0, NULL, 0, errorCode);
+    }
+
+    // content filter: only the changes of the masked bits are notified (RX_CHECK_DLC: and the changes of length)
+    struct can_frame filter;
+    memset(&filter, 0, sizeof(filter));
+    filter.can_id = canid;
+    filter.can_dlc = len > CAN_MAX_DLEN ? CAN_MAX_DLEN : len;
+    memcpy(filter.data, mask, filter.can_dlc);
+    return sendHead(RX_SETUP, flags | RX_CHECK_DLC, canid, timeoutUs, 0, &filter, 1, errorCode);
+}
+
+bool CanBcm::RemoveRxFilter(canid_t canid, int &errorCode){
+    return sendHead(RX_DELETE, 0, canid, 0, 0, NULL, 0, errorCode);
+}
+
+bool CanBcm::WaitNotification(uint32_t &opcode, struct can_frame &frame, int &errorCode, int timeoutMs){
+    // bcm_msg_head ends with a flexible array: the notification is read in a raw buffer
+    char msg[sizeof(struct bcm_msg_head) + sizeof(struct can_frame)];
+    struct bcm_msg_head* head = (struct bcm_msg_head*)msg;
+    struct epoll_event ev;
+
+    errorCode = 0;
+    if(!m_initialized){
+        errorCode = -1;
+        return false;
+    }
+
+    while(true){
+        int n = read(m_socket, msg, sizeof(msg));
+        if(n >= (int)sizeof(struct bcm_msg_head)){
+            opcode = head->opcode;
+            if(head->nframes > 0 && n >= (int)sizeof(msg)){
+                memcpy(&frame, msg + sizeof(struct bcm_msg_head), sizeof(frame));
+            }else{
+                memset(&frame, 0, sizeof(frame));
+                frame.can_id = head->can_id;
+            }
+            return true;
+        }
+        if(n < 0 && errno != EAGAIN && errno != EWOULDBLOCK){
+            errorCode = errno;
+            return false;
+        }
+
+        int ret = epoll_wait(m_epoll, &ev, 1, timeoutMs);
+        if(ret == 0){
+            errorCode = ETIMEDOUT;
+            return false;
+        }
+        if(ret < 0 && errno != EINTR){
+            errorCode = errno;
+            return false;
+        }
+    }
+}
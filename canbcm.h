@@ -0,0 +1,54 @@
+#ifndef CANBCM_H
+#define CANBCM_H
+
+#include <stdint.h>
+
+#include <linux/can.h>
+#include <linux/can/bcm.h>
+
+// Wrapper of a SocketCAN broadcast manager socket (CAN_BCM).
+// The kernel sends the cyclic frames itself (SYNC, heartbeat, RPDO refresh) from a hrtimer, so the
+// cycle does not depend on a user-space thread being scheduled, and watches the received frames to
+// notify us only when their content changes or when they stop arriving.
+// Only available on SocketCAN interfaces (can*, vcan*), not on the loopback transport.
+class CanBcm
+{
+public:
+    CanBcm();
+    ~CanBcm();
+
+    bool Init(const char *interfaceName, int &errorCode); // function to open the bcm socket on an interface
+    void Close();
+    bool isInitialized() { return m_initialized; }
+
+    bool AddCyclicTx(canid_t canid, const struct can_frame *frames, int count, uint32_t intervalUs, int &errorCode);
+    // function to send frames every intervalUs (when count > 1, one frame of the list per interval, in turn)
+    // canid: identifier of the job (the frames are sent with their own can_id)
+
+    bool UpdateCyclicTx(canid_t canid, const struct can_frame *frames, int count, int &errorCode);
+    // function to change the content of a cyclic job without touching its timer (e.g. new setpoint in an RPDO)
+
+    bool RemoveCyclicTx(canid_t canid, int &errorCode);
+
+    bool AddRxFilter(canid_t canid, const uint8_t *mask, uint8_t len, uint32_t timeoutUs, int &errorCode);
+    // function to be notified when the frame canid changes
+    // mask: the bytes of the payload to watch (a bit set to 1 is compared), NULL to be notified of every frame
+    // len: the number of bytes of mask
+    // timeoutUs: if not 0, a RX_TIMEOUT notification is sent when the frame has not been received for timeoutUs
+
+    bool RemoveRxFilter(canid_t canid, int &errorCode);
+
+    bool WaitNotification(uint32_t &opcode, struct can_frame &frame, int &errorCode, int timeoutMs);
+    // function to wait for a notification of the rx filters
+    // opcode: RX_CHANGED (frame is the new content) or RX_TIMEOUT (frame.can_id is the missing frame)
+    // return false if nothing was notified before timeoutMs (errorCode = ETIMEDOUT) or on error
+
+private:
+    bool sendHead(uint32_t opcode, uint32_t flags, canid_t canid, uint32_t ival1Us, uint32_t ival2Us, const struct can_frame *frames, int count, int &errorCode);
+
+    bool m_initialized;
+    int m_socket;
+    int m_epoll;
+};
+
+#endif // CANBCM_H
@@ -0,0 +1,326 @@
+#include "cancapture.h"
+#include "canreceiver.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+CanCapture::CanCapture(){
+    _fd = -1;
+    _length = 0;
+    _writable = false;
+    _header = NULL;
+    _records = NULL;
+    _count = 0;
+    _dropped = 0;
+}
+
+CanCapture::~CanCapture(){
+    close();
+}
+
+bool CanCapture::map(int fd, size_t length, bool writable, int &errorCode){
+    void* addr = mmap(NULL, length, writable ? (PROT_READ | PROT_WRITE) : PROT_READ, MAP_SHARED, fd, 0);
+    if(addr == MAP_FAILED){
+        errorCode = errno;
+        return false;
+    }
+    madvise(addr, length, MADV_SEQUENTIAL);
+    _fd = fd;
+    _length = length;
+    _writable = writable;
+    _header = (CanCaptureHeader*)addr;
+    _records = (CanCaptureRecord*)((char*)addr + sizeof(CanCaptureHeader));
+    return true;
+}
+
+// Create a capture file able to hold capacity frames. The whole file is allocated at once,
+// so that appending a frame never has to extend it.
+// Parameters:
+// path - the capture file, overwritten if it exists
+// capacity - the maximum number of frames
+// errorcode - will be set to an error code
+bool CanCapture::create(const char *path, uint64_t capacity, int &errorCode){
+    errorCode = 0;
+    close();
+
+    int fd = ::open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fd < 0){
+        errorCode = errno;
+        return false;
+    }
+
+    size_t length = sizeof(CanCaptureHeader) + capacity * sizeof(CanCaptureRecord);
+    int ret = posix_fallocate(fd, 0, length);
+    if(ret != 0){
+        errorCode = ret;
+        ::close(fd);
+        return false;
+    }
+    if(!map(fd, length, true, errorCode)){
+        ::close(fd);
+        return false;
+    }
+
+    memcpy(_header->magic, CAN_CAPTURE_MAGIC, sizeof(_header->magic));
+    _header->recordSize = sizeof(CanCaptureRecord);
+    _header->reserved = 0;
+    _header->capacity = capacity;
+    _header->count = 0;
+    _count = 0;
+    _dropped = 0;
+    return true;
+}
+
+// Open an existing capture file, read only
+bool CanCapture::open(const char *path, int &errorCode){
+    errorCode = 0;
+    close();
+
+    int fd = ::open(path, O_RDONLY | O_CLOEXEC);
+    if(fd < 0){
+        errorCode = errno;
+        return false;
+    }
+    struct stat st;
+    if(fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(CanCaptureHeader)){
+        errorCode = EINVAL;
+        ::close(fd);
+        return false;
+    }
+    if(!map(fd, st.st_size, false, errorCode)){
+        ::close(fd);
+        return false;
+    }
+    if(memcmp(_header->magic, CAN_CAPTURE_MAGIC, sizeof(_header->magic)) != 0 ||
+       _header->recordSize != sizeof(CanCaptureRecord) ||
+       sizeof(CanCaptureHeader) + _header->capacity * sizeof(CanCaptureRecord) > _length){
+        errorCode = EINVAL; // not a capture file, or not written by this version
+        close();
+        return false;
+    }
+    _count = _header->count;
+    return true;
+}
+
+void CanCapture::close(){
+    if(_header == NULL) return;
+    if(_writable){
+        msync(_header, _length, MS_ASYNC);
+    }
+    munmap(_header, _length);
+    ::close(_fd);
+    _header = NULL;
+    _records = NULL;
+    _fd = -1;
+    _length = 0;
+}
+
+uint64_t CanCapture::size() const {
+    if(_header == NULL) return 0;
+    return __atomic_load_n(&_header->count, __ATOMIC_ACQUIRE);
+}
+
+bool CanCapture::append(const CanCaptureRecord& record){
+    if(_header == NULL || !_writable) return false;
+    if(_count >= _header->capacity){
+        _dropped++;
+        return false;
+    }
+    _records[_count] = record;
+    _count++;
+    // the count is published after the record, a reader mapping the same file never sees a partial record
+    __atomic_store_n(&_header->count, _count, __ATOMIC_RELEASE);
+    return true;
+}
+
+bool CanCapture::append(const CanRxFrame& rx){
+    CanCaptureRecord record;
+    record.timestamp = rx.timestamp;
+    record.can_id = rx.fdframe.can_id | rx.flags; // the flags removed by the receiver are put back
+    record.len = rx.fdframe.len;
+    record.flags = rx.fd ? rx.fdframe.flags : 0;
+    record.fd = rx.fd;
+    record.reserved = 0;
+    memcpy(record.data, rx.fdframe.data, rx.fd ? CANFD_MAX_DLEN : CAN_MAX_DLEN);
+    return append(record);
+}
+
+// Write the capture in the candump -L format, readable by can-utils (canplayer, log2asc...)
+bool CanCapture::exportCandump(const char *path, const char *interfaceName, int &errorCode) const {
+    errorCode = 0;
+    FILE* f = fopen(path, "w");
+    if(f == NULL){
+        errorCode = errno;
+        return false;
+    }
+
+    uint64_t n = size();
+    for(uint64_t i=0; i<n; i++){
+        const CanCaptureRecord& r = _records[i];
+        fprintf(f, "(%lld.%06lld) %s ", (long long)(r.timestamp / 1000000000LL), (long long)((r.timestamp % 1000000000LL) / 1000), interfaceName);
+        if(r.can_id & (CAN_EFF_FLAG | CAN_ERR_FLAG)){
+            fprintf(f, "%08X", r.can_id & (CAN_EFF_MASK | CAN_ERR_FLAG));
+        }else{
+            fprintf(f, "%03X", r.can_id & CAN_SFF_MASK);
+        }
+        if(r.fd){
+            fprintf(f, "##%X", r.flags & 0x0F);
+        }else if(r.can_id & CAN_RTR_FLAG){
+            fprintf(f, "#R\n");
+            continue;
+        }else{
+            fprintf(f, "#");
+        }
+        for(int j=0; j<r.len; j++){
+            fprintf(f, "%02X", r.data[j]);
+        }
+        fprintf(f, "\n");
+    }
+
+    if(fclose(f) != 0){
+        errorCode = errno;
+        return false;
+    }
+    return true;
+}
+
+static int hexValue(char c){
+    if(c >= '0' && c <= '9') return c - '0';
+    if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+static bool parseCandumpLine(const char* line, CanCaptureRecord& r){
+    // line: "(1436509052.249713) can0 123#DEADBEEF", "... 123##1DEADBEEF" (can fd) or "... 123#R" (rtr)
+    long long sec, usec;
+    char iface[32];
+    char frame[300];
+    if(sscanf(line, " (%lld.%lld) %31s %299s", &sec, &usec, iface, frame) != 4) return false;
+
+    memset(&r, 0, sizeof(r));
+    r.timestamp = sec * 1000000000LL + usec * 1000LL;
+
+    char* sep = strchr(frame, '#');
+    if(sep == NULL) return false;
+    *sep = '\0';
+    r.can_id = strtoul(frame, NULL, 16);
+    if(strlen(frame) == 8){
+        if(!(r.can_id & CAN_ERR_FLAG)) r.can_id |= CAN_EFF_FLAG;
+    }
+
+    const char* data = sep + 1;
+    if(*data == 'R'){
+        r.can_id |= CAN_RTR_FLAG;
+        return true;
+    }
+    if(*data == '#'){
+        r.fd = 1;
+        if(hexValue(data[1]) < 0) return false;
+        r.flags = hexValue(data[1]);
+        data += 2;
+    }
+    int maxlen = r.fd ? CANFD_MAX_DLEN : CAN_MAX_DLEN;
+    while(*data && r.len < maxlen){
+        if(*data == '.'){ // optional byte separator
+            data++;
+            continue;
+        }
+        int hi = hexValue(data[0]);
+        int lo = hexValue(data[1]);
+        if(hi < 0 || lo < 0) return false;
+        r.data[r.len++] = (hi << 4) | lo;
+        data += 2;
+    }
+    return true;
+}
+
+// Convert a candump -L log into a capture file (the lines that can not be parsed are skipped)
+bool CanCapture::importCandump(const char *logPath, const char *capturePath, int &errorCode){
+    errorCode = 0;
+    FILE* f = fopen(logPath, "r");
+    if(f == NULL){
+        errorCode = errno;
+        return false;
+    }
+
+    std::vector<CanCaptureRecord> records;
+    char line[512];
+    CanCaptureRecord r;
+    while(fgets(line, sizeof(line), f)){
+        if(parseCandumpLine(line, r)) records.push_back(r);
+    }
+    fclose(f);
+
+    CanCapture capture;
+    if(!capture.create(capturePath, records.size(), errorCode)) return false;
+    for(unsigned int i=0; i<records.size(); i++){
+        capture.append(records[i]);
+    }
+    capture.close();
+    return true;
+}
+
+// Send the captured frames on a transport. With originalTiming, each frame is sent at its original offset
+// from the first one (absolute deadlines, so the error does not accumulate), otherwise as fast as the transport accepts them.
+int64_t CanCapture::replay(CanTransport* transport, bool originalTiming, int &errorCode, const std::atomic<bool>* stop) const {
+    errorCode = 0;
+    uint64_t n = size();
+    if(n == 0) return 0;
+
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int64_t t0 = _records[0].timestamp;
+    int64_t sent = 0;
+
+    for(uint64_t i=0; i<n; i++){
+        if(stop && *stop) break;
+        const CanCaptureRecord& r = _records[i];
+
+        if(originalTiming){
+            int64_t offset = r.timestamp - t0;
+            if(offset < 0) offset = 0;
+            struct timespec deadline;
+            int64_t ns = start.tv_nsec + offset % 1000000000LL;
+            deadline.tv_sec = start.tv_sec + offset / 1000000000LL + ns / 1000000000LL;
+            deadline.tv_nsec = ns % 1000000000LL;
+            while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR);
+        }
+
+        bool ok;
+        do{
+            if(r.fd){
+                struct canfd_frame frame;
+                memset(&frame, 0, sizeof(frame));
+                frame.can_id = r.can_id;
+                frame.len = r.len;
+                memcpy(frame.data, r.data, r.len);
+                ok = transport->SendFdMsg(frame, false, r.flags & CANFD_BRS, r.flags & CANFD_ESI, errorCode);
+            }else{
+                struct can_frame frame;
+                memset(&frame, 0, sizeof(frame));
+                frame.can_id = r.can_id; // the flags are kept in the id
+                frame.can_dlc = r.len;
+                memcpy(frame.data, r.data, r.len);
+                ok = transport->SendMsg(frame, false, false, errorCode);
+            }
+            if(!ok && (errorCode == ENOBUFS || errorCode == EAGAIN)){
+                usleep(100); // tx queue full, wait for the controller to send some frames
+            }
+        }while(!ok && (errorCode == ENOBUFS || errorCode == EAGAIN));
+
+        if(!ok) return sent > 0 ? sent : -1;
+        sent++;
+    }
+    return sent;
+}
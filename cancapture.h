@@ -0,0 +1,79 @@
+#ifndef CANCAPTURE_H
+#define CANCAPTURE_H
+
+#include <atomic>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "cantransport.h"
+
+struct CanRxFrame;
+
+#define CAN_CAPTURE_MAGIC "PDLCAP01"
+
+// One captured frame, as stored in the capture file (fixed size, so record i is at a known offset)
+struct CanCaptureRecord
+{
+    int64_t timestamp; // reception time, ns since epoch
+    uint32_t can_id;   // with the CAN_EFF_FLAG/CAN_RTR_FLAG/CAN_ERR_FLAG flags
+    uint8_t len;       // payload length
+    uint8_t flags;     // CANFD_BRS/CANFD_ESI
+    uint8_t fd;        // 1 for a can fd frame
+    uint8_t reserved;
+    uint8_t data[CANFD_MAX_DLEN];
+};
+
+struct CanCaptureHeader
+{
+    char magic[8];
+    uint32_t recordSize;
+    uint32_t reserved;
+    uint64_t capacity; // number of records preallocated in the file
+    uint64_t count;    // number of records written
+};
+
+// Binary capture of the CAN traffic in a preallocated memory-mapped file.
+// A single thread appends (the CanReceiver thread), without any syscall per frame,
+// the kernel writes the pages back in the background.
+// Captures can be converted from/to the candump log format ("(1436509052.249713) can0 123#DEADBEEF")
+// and replayed on a transport (vcan, loopback...).
+class CanCapture
+{
+public:
+    CanCapture();
+    ~CanCapture();
+
+    bool create(const char *path, uint64_t capacity, int &errorCode); // function to create a capture file for capacity frames
+    bool open(const char *path, int &errorCode);                      // function to open an existing capture (read only)
+    void close();                                                    // function to flush and close the capture
+
+    bool isOpen() const { return _header != NULL; }
+    bool append(const CanRxFrame& rx);           // function to add a frame, false if the capture is full (the frame is counted as dropped)
+    bool append(const CanCaptureRecord& record);
+
+    uint64_t size() const;                       // number of frames captured
+    uint64_t getDropped() const { return _dropped; }
+    const CanCaptureRecord& record(uint64_t i) const { return _records[i]; }
+
+    bool exportCandump(const char *path, const char *interfaceName, int &errorCode) const; // function to write the capture as a candump -L log
+    static bool importCandump(const char *logPath, const char *capturePath, int &errorCode); // function to convert a candump log into a capture file
+
+    int64_t replay(CanTransport* transport, bool originalTiming, int &errorCode, const std::atomic<bool>* stop = NULL) const;
+    // function to send the captured frames on transport
+    // originalTiming: keep the original time between frames (true) or send them as fast as possible (false)
+    // stop: if not NULL, the replay ends as soon as it becomes true
+    // return the number of frames sent, -1 on error
+
+private:
+    bool map(int fd, size_t length, bool writable, int &errorCode);
+
+    int _fd;
+    size_t _length;
+    bool _writable;
+    CanCaptureHeader* _header;
+    CanCaptureRecord* _records;
+    uint64_t _count; // records written, the header is updated after each record
+    std::atomic<uint64_t> _dropped;
+};
+
+#endif // CANCAPTURE_H
@@ -0,0 +1,253 @@
+#include "canreceiver.h"
+#include "cancapture.h"
+
+#include <sys/eventfd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#include <chrono>
+
+#define RX_POLL_MS 100 // the receiver thread checks if it should stop at least every RX_POLL_MS
+#define RX_BATCH 32    // number of frames drained per syscall once the socket is readable
+#define DISPATCH_BATCH 64 // frames dispatched per snapshot of the handlers, bounds the wait of removeHandler
+
+static void stripFlags(CanRxFrame& rx){
+    // the flags of a frame received by RecvBatch are moved from can_id to rx.flags
+    canid_t id = rx.frame.can_id;
+    rx.flags = id & (CAN_EFF_FLAG | CAN_RTR_FLAG | CAN_ERR_FLAG);
+    if(id & CAN_ERR_FLAG){
+        rx.frame.can_id = id & CAN_ERR_MASK; // error class
+    }else if(id & CAN_EFF_FLAG){
+        rx.frame.can_id = id & CAN_EFF_MASK;
+    }else{
+        rx.frame.can_id = id & CAN_SFF_MASK;
+    }
+}
+
+void CanMailbox::post(const CanRxFrame& frame){
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _frames.push_back(frame);
+    }
+    _cond.notify_one();
+}
+
+bool CanMailbox::wait(CanRxFrame& frame, int timeoutMs){
+    std::unique_lock<std::mutex> lock(_mutex);
+    if(!_cond.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this]{ return !_frames.empty(); })){
+        return false;
+    }
+    frame = _frames.front();
+    _frames.pop_front();
+    return true;
+}
+
+int CanMailbox::drain(std::vector<CanRxFrame>& frames){
+    std::lock_guard<std::mutex> lock(_mutex);
+    int n = _frames.size();
+    frames.insert(frames.end(), _frames.begin(), _frames.end());
+    _frames.clear();
+    return n;
+}
+
+CanReceiver::CanReceiver(CanTransport* can){
+    _can = can;
+    _nextId = 1;
+    _handlers = std::make_shared<const Registrations>();
+    _dispatching = false;
+    _dispatchRound = 0;
+    _running = false;
+    _dropped = 0;
+    _eventfd = -1;
+    _capture = NULL;
+}
+
+CanReceiver::~CanReceiver(){
+    stop();
+}
+
+int CanReceiver::addHandler(canid_t cobid, canid_t mask, CanHandler handler){
+    std::lock_guard<std::mutex> lock(_handlersMutex);
+    Registration reg;
+    reg.id = _nextId++;
+    reg.cobid = cobid & CAN_SFF_MASK;
+    reg.mask = mask & CAN_SFF_MASK;
+    reg.handler = handler;
+    std::shared_ptr<Registrations> handlers = std::make_shared<Registrations>(*_handlers);
+    handlers->push_back(reg);
+    _handlers = handlers;
+    updateFilters();
+    return reg.id;
+}
+
+void CanReceiver::removeHandler(int id){
+    std::unique_lock<std::mutex> lock(_handlersMutex);
+    std::shared_ptr<Registrations> handlers = std::make_shared<Registrations>(*_handlers);
+    for(unsigned int i=0; i<handlers->size(); i++){
+        if((*handlers)[i].id == id){
+            handlers->erase(handlers->begin()+i);
+            break;
+        }
+    }
+    _handlers = handlers;
+    updateFilters();
+
+    // the dispatcher may be calling the handler from the previous snapshot: wait for it to be done with it,
+    // so that the caller can release what the handler uses
+    if(std::this_thread::get_id() == _dispatchThread.get_id()) return;
+    unsigned long round = _dispatchRound;
+    _dispatchCond.wait(lock, [&]{ return !_dispatching || _dispatchRound != round; });
+}
+
+void CanReceiver::setCapture(CanCapture* capture){
+    std::lock_guard<std::mutex> lock(_handlersMutex);
+    _capture = capture;
+    updateFilters();
+}
+
+void CanReceiver::updateFilters(){
+    // the kernel filter is the union of the handlers (standard data frames only), called with _handlersMutex locked
+    if(!_can->isInitialized()) return; // applied again by start()
+
+    int errorCode;
+    if(_capture != NULL){
+        _can->ClearFilters(errorCode); // the capture wants the whole bus
+        return;
+    }
+
+    const Registrations& handlers = *_handlers;
+    std::vector<struct can_filter> filters(handlers.size());
+    for(unsigned int i=0; i<handlers.size(); i++){
+        filters[i].can_id = handlers[i].cobid;
+        filters[i].can_mask = handlers[i].mask | CAN_EFF_FLAG | CAN_RTR_FLAG;
+    }
+    _can->SetFilters(filters.empty() ? NULL : &filters[0], filters.size(), errorCode);
+}
+
+bool CanReceiver::start(){
+    if(_running) return true;
+    if(!_can->isInitialized()) return false;
+
+    _eventfd = eventfd(0, EFD_CLOEXEC);
+    if(_eventfd < 0) return false;
+
+    {
+        std::lock_guard<std::mutex> lock(_handlersMutex);
+        updateFilters();
+    }
+
+    _running = true;
+    _rxThread = std::thread(&CanReceiver::rxLoop, this);
+    _dispatchThread = std::thread(&CanReceiver::dispatchLoop, this);
+    return true;
+}
+
+void CanReceiver::stop(){
+    if(!_running) return;
+    _running = false;
+
+    // wake up the dispatcher, the receiver wakes up by itself within RX_POLL_MS
+    uint64_t one = 1;
+    if(write(_eventfd, &one, sizeof(one)) < 0){
+        // nothing to do, the dispatcher will not be blocked on a full counter
+    }
+    if(_rxThread.joinable()) _rxThread.join();
+    if(_dispatchThread.joinable()) _dispatchThread.join();
+
+    close(_eventfd);
+    _eventfd = -1;
+}
+
+void CanReceiver::rxLoop(){
+    struct canfd_frame batch[RX_BATCH];
+    struct can_frame classicbatch[RX_BATCH];
+    bool fdbatch[RX_BATCH];
+    int64_t stamps[RX_BATCH];
+    CanRxFrame rx;
+    int errorCode;
+
+    while(_running){
+        // sleep until a frame arrives
+        if(!_can->WaitReadable(RX_POLL_MS, errorCode)){
+            if(errorCode != ETIMEDOUT){
+                usleep(RX_POLL_MS*1000); // the interface is probably down, do not spin on the error
+            }
+            continue;
+        }
+
+        // take every queued frame, RX_BATCH per syscall: the batches keep the flags in can_id,
+        // so the capture records the frames exactly as received
+        CanCapture* capture = _capture;
+        bool fdsocket = _can->isFdEnabled();
+        int n;
+        do{
+            if(fdsocket){
+                n = _can->RecvFdBatch(batch, fdbatch, RX_BATCH, errorCode, stamps);
+            }else{
+                n = _can->RecvBatch(classicbatch, RX_BATCH, errorCode, stamps);
+            }
+            for(int i=0; i<n; i++){
+                if(fdsocket){
+                    rx.fdframe = batch[i];
+                    rx.fd = fdbatch[i];
+                }else{
+                    rx.frame = classicbatch[i];
+                    rx.fd = false;
+                }
+                rx.timestamp = stamps[i];
+                stripFlags(rx);
+                if(capture) capture->append(rx);
+                if(!_ring.push(rx)) _dropped++;
+            }
+        }while(n == RX_BATCH);
+        if(n < 0 && errorCode != EAGAIN && errorCode != EWOULDBLOCK){
+            usleep(RX_POLL_MS*1000); // readable but not readable: do not spin on the error
+        }
+
+        uint64_t one = 1;
+        if(write(_eventfd, &one, sizeof(one)) < 0){
+            // the counter can not overflow in practice
+        }
+    }
+}
+
+void CanReceiver::dispatchLoop(){
+    CanRxFrame rx;
+    uint64_t count;
+
+    while(_running){
+        if(read(_eventfd, &count, sizeof(count)) < 0 && errno != EINTR){
+            break;
+        }
+
+        // the handlers are called on a snapshot of the list, without the lock: they can register or remove handlers
+        // the snapshot is taken once per batch of frames popped from the ring, removeHandler waits for the end of the batch
+        bool more = true;
+        while(more){
+            std::shared_ptr<const Registrations> handlers;
+            {
+                std::lock_guard<std::mutex> lock(_handlersMutex);
+                handlers = _handlers;
+                _dispatching = true;
+                _dispatchRound++;
+            }
+            for(int n=0; n<DISPATCH_BATCH && (more = _ring.pop(rx)); n++){
+                // the handlers only know standard data frames: the other ones get here during a capture, which already has them
+                if(rx.flags != 0) continue;
+
+                for(unsigned int i=0; i<handlers->size(); i++){
+                    const Registration& reg = (*handlers)[i];
+                    if((rx.frame.can_id & reg.mask) == (reg.cobid & reg.mask)){
+                        reg.handler(rx);
+                    }
+                }
+            }
+            {
+                std::lock_guard<std::mutex> lock(_handlersMutex);
+                _dispatching = false;
+            }
+            _dispatchCond.notify_all();
+        }
+    }
+}
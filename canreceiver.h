@@ -0,0 +1,109 @@
+#ifndef CANRECEIVER_H
+#define CANRECEIVER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "cantransport.h"
+#include "canringbuffer.h"
+
+class CanCapture;
+
+#define CAN_RX_RING_SIZE 1024 // number of frames the receiver can buffer before the dispatcher drops some
+
+struct CanRxFrame
+{
+    union{
+        struct can_frame frame;     // the received frame, flags removed from can_id (see CanWrapper::GetMsg)
+        struct canfd_frame fdframe; // same frame seen as a can fd one, the whole payload is there when fd is true
+    };
+    canid_t flags;          // CAN_EFF_FLAG, CAN_RTR_FLAG and CAN_ERR_FLAG of the frame, removed from can_id
+    bool fd;                // can fd frame (true) or classic can frame (false)
+    int64_t timestamp;      // reception time (ns since epoch, kernel timestamp if enabled on the socket)
+};
+
+typedef std::function<void(const CanRxFrame&)> CanHandler;
+
+// Thread-safe queue of received frames, one consumer waits on it while the dispatcher posts into it
+class CanMailbox
+{
+public:
+    void post(const CanRxFrame& frame);
+    bool wait(CanRxFrame& frame, int timeoutMs); // return false if nothing arrived before timeoutMs
+    int drain(std::vector<CanRxFrame>& frames);  // move every pending frame into frames, return how many
+
+private:
+    std::mutex _mutex;
+    std::condition_variable _cond;
+    std::deque<CanRxFrame> _frames;
+};
+
+// Background reception of a CAN socket:
+// - a receiver thread sleeps on the socket, stamps each frame and pushes it into a lock-free ring
+// - a dispatcher thread pops the ring and calls the handlers registered for the frame COB-ID
+// The kernel filter of the socket is the union of the registered handlers, so unwanted frames never wake us up.
+class CanReceiver
+{
+public:
+    CanReceiver(CanTransport* can);
+    ~CanReceiver();
+
+    int addHandler(canid_t cobid, canid_t mask, CanHandler handler); // function to register a handler
+    // cobid, mask: the handler is called for the standard frames such that (can_id & mask) == (cobid & mask)
+    // handler: called from the dispatcher thread, should be short (post into a CanMailbox for instance)
+    // the handlers are called without any lock of the receiver held, they can add or remove handlers
+    // return an id to give to removeHandler
+
+    void removeHandler(int id);
+    // once it returns, the handler is not called anymore: it waits for the frames being dispatched
+    // (except when called by a handler, from the dispatcher thread itself)
+
+    bool start(); // function to start the receiver and dispatcher threads (the socket should be initialized)
+    void stop();  // function to stop both threads
+    bool isRunning() const { return _running; }
+
+    unsigned long getDropped() const { return _dropped; } // number of frames lost because the ring was full
+
+    void setCapture(CanCapture* capture); // function to record every received frame in capture (NULL to stop)
+    // while a capture is set the socket receives all the frames, not only the ones with a handler
+    // the extended, remote and error frames are recorded but never given to the handlers
+
+private:
+    struct Registration{
+        int id;
+        canid_t cobid;
+        canid_t mask;
+        CanHandler handler;
+    };
+
+    void rxLoop();
+    void dispatchLoop();
+    void updateFilters();
+
+    CanTransport* _can;
+    CanRingBuffer<CanRxFrame, CAN_RX_RING_SIZE> _ring;
+
+    typedef std::vector<Registration> Registrations;
+
+    std::mutex _handlersMutex;
+    std::shared_ptr<const Registrations> _handlers; // replaced as a whole at each change, the dispatcher keeps the one it uses
+    int _nextId;
+    std::condition_variable _dispatchCond;          // notified when the dispatcher is done with a snapshot
+    bool _dispatching;                              // the dispatcher is calling the handlers of a snapshot
+    unsigned long _dispatchRound;                   // snapshots taken by the dispatcher so far
+
+    std::thread _rxThread;
+    std::thread _dispatchThread;
+    std::atomic<CanCapture*> _capture; // written by the receiver thread only
+    std::atomic<bool> _running;
+    std::atomic<unsigned long> _dropped;
+    int _eventfd; // the receiver thread wakes the dispatcher through it
+};
+
+#endif // CANRECEIVER_H
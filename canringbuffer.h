@@ -0,0 +1,51 @@
+#ifndef CANRINGBUFFER_H
+#define CANRINGBUFFER_H
+
+#include <atomic>
+#include <cstddef>
+
+// Lock-free single producer / single consumer ring buffer.
+// One thread only calls push(), one other thread only calls pop().
+// N must be a power of two, one slot is always kept empty.
+template <typename T, size_t N>
+class CanRingBuffer
+{
+public:
+    CanRingBuffer() : _head(0), _tail(0) {
+        static_assert((N & (N - 1)) == 0, "CanRingBuffer size must be a power of two");
+    }
+
+    bool push(const T& item){
+        // producer side, returns false if the buffer is full (the item is not stored)
+        size_t head = _head.load(std::memory_order_relaxed);
+        size_t next = (head + 1) & (N - 1);
+        if(next == _tail.load(std::memory_order_acquire)) return false;
+        _items[head] = item;
+        _head.store(next, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& item){
+        // consumer side, returns false if the buffer is empty
+        size_t tail = _tail.load(std::memory_order_relaxed);
+        if(tail == _head.load(std::memory_order_acquire)) return false;
+        item = _items[tail];
+        _tail.store((tail + 1) & (N - 1), std::memory_order_release);
+        return true;
+    }
+
+    bool empty() const {
+        return _tail.load(std::memory_order_acquire) == _head.load(std::memory_order_acquire);
+    }
+
+private:
+    T _items[N];
+    // head and tail on different cache lines, so producer and consumer do not fight over them
+    // (padding rather than alignas, heap allocation of over-aligned types needs C++17)
+    char _pad0[64];
+    std::atomic<size_t> _head; // next slot written by the producer
+    char _pad1[64];
+    std::atomic<size_t> _tail; // next slot read by the consumer
+};
+
+#endif // CANRINGBUFFER_H
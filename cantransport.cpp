@@ -0,0 +1,21 @@
+#include "cantransport.h"
+#include "canwrapper.h"
+#include "loopbackcan.h"
+
+#include <string.h>
+
+CanTransport* CanTransport::create(const char *interfaceName){
+    if(strncmp(interfaceName, "loop", 4) == 0){
+        return new LoopbackCanTransport();
+    }
+    // real (can0...) and virtual (vcan0...) SocketCAN interfaces
+    return new CanWrapper();
+}
+
+// Restore the default filter (every frame is received)
+bool CanTransport::ClearFilters(int &errorCode){
+    struct can_filter all;
+    all.can_id = 0;
+    all.can_mask = 0;
+    return SetFilters(&all, 1, errorCode);
+}
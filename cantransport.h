@@ -0,0 +1,49 @@
+#ifndef CANTRANSPORT_H
+#define CANTRANSPORT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <linux/can.h>
+#include <linux/can/raw.h>
+
+// Interface of a CAN bus access, as used by the CANopen driver.
+// The semantic of every function is the one of the SocketCAN implementation (see canwrapper.cpp):
+// - CanWrapper: SocketCAN raw socket, for the real interfaces (can0...) and the virtual ones (vcan0...)
+// - LoopbackCanTransport: in-process bus without sockets, for tests and benchmarks (loop0...)
+class CanTransport
+{
+public:
+    virtual ~CanTransport() {}
+
+    static CanTransport* create(const char *interfaceName); // function to create the transport matching an interface name
+    // "loop*" gives a LoopbackCanTransport, any other name a CanWrapper (can*, vcan*...)
+    // the transport still has to be initialized with Init
+
+    virtual bool Init(const char *interfaceName, int &errorCode) = 0;
+    virtual void Close() = 0;
+    virtual bool isInitialized() = 0;
+
+    virtual bool SendMsg(struct can_frame msg, bool extended, bool rtr, int &errorCode) = 0;
+    virtual bool GetMsg(struct can_frame &frame, bool &extended, bool &rtr, bool &error, int &errorCode, int64_t *timestamp = NULL) = 0;
+    virtual bool WaitMsg(struct can_frame &frame, bool &extended, bool &rtr, bool &error, int &errorCode, int timeoutMs, int64_t *timestamp = NULL) = 0;
+    virtual int SendBatch(const struct can_frame *frames, int count, int &errorCode) = 0;
+    virtual int RecvBatch(struct can_frame *frames, int maxCount, int &errorCode, int64_t *timestamps = NULL) = 0;
+    virtual bool WaitReadable(int timeoutMs, int &errorCode) = 0; // function to sleep until a frame can be read, without reading it
+
+    virtual bool SetFilters(const struct can_filter *filters, int count, int &errorCode) = 0;
+    bool ClearFilters(int &errorCode); // function to receive every frame again
+
+    virtual bool EnableFdFrames(int &errorCode) = 0;
+    virtual bool isFdEnabled() = 0;
+    virtual bool SendFdMsg(struct canfd_frame msg, bool extended, bool brs, bool esi, int &errorCode) = 0;
+    virtual bool GetFdMsg(struct canfd_frame &frame, bool &extended, bool &fd, bool &error, int &errorCode, int64_t *timestamp = NULL) = 0;
+    virtual bool WaitFdMsg(struct canfd_frame &frame, bool &extended, bool &fd, bool &error, int &errorCode, int timeoutMs, int64_t *timestamp = NULL) = 0;
+    virtual int RecvFdBatch(struct canfd_frame *frames, bool *fd, int maxCount, int &errorCode, int64_t *timestamps = NULL) = 0;
+
+    virtual bool EnableTimestamps(bool tx, int &errorCode) = 0;
+    virtual int64_t LastTxTimestamp() const = 0;
+    virtual int64_t TxTimestamp(canid_t canId) const = 0; // time at which the last standard frame with canId was sent, 0 if unknown
+};
+
+#endif // CANTRANSPORT_H
@@ -18,6 +18,11 @@
 #include <linux/can/error.h>
 #include <sys/time.h>
 #include <sys/select.h>
+#include <sys/epoll.h>
+#include <poll.h>
+#include <linux/net_tstamp.h>
+#include <linux/errqueue.h>
+#include <time.h>
 
 
 #include <endian.h>
@@ -34,11 +39,45 @@
 #include <cstring>
 
 #define INVALID_SOCKET -1
+#define BATCH_MAX 64 // maximum number of frames moved by a single sendmmsg/recvmmsg call
+#define CTRL_LEN 128 // room for the timestamp control messages of one frame
+
+static int64_t realtimeNowNs(){
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// Get the timestamp from the control messages of a received frame, 0 if there is none
+// Always CLOCK_REALTIME: the driver compares it with its own clock (system_clock)
+static int64_t extractTimestamp(struct msghdr *msg){
+    for(struct cmsghdr *cmsg = CMSG_FIRSTHDR(msg); cmsg != NULL; cmsg = CMSG_NXTHDR(msg, cmsg)){
+        if(cmsg->cmsg_level != SOL_SOCKET) continue;
+        if(cmsg->cmsg_type == SCM_TIMESTAMPING){
+            // ts[0]: software timestamp (CLOCK_REALTIME), ts[2]: raw hardware timestamp, on the free-running clock
+            // of the controller: it can not be compared with the host time, so it is not used
+            struct timespec ts[3];
+            memcpy(ts, CMSG_DATA(cmsg), sizeof(ts));
+            return (int64_t)ts[0].tv_sec * 1000000000LL + ts[0].tv_nsec;
+        }else if(cmsg->cmsg_type == SCM_TIMESTAMPNS){
+            struct timespec ts;
+            memcpy(&ts, CMSG_DATA(cmsg), sizeof(ts));
+            return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+        }
+    }
+    return 0;
+}
 
 CanWrapper::CanWrapper(){
     // constructor of the CANWrapper class
     m_initialized = false;
     m_socket = INVALID_SOCKET;
+    m_epoll = INVALID_SOCKET;
+    m_txTimestamps = false;
+    m_lastTxTimestamp = 0;
+    for(unsigned int i=0; i<=CAN_SFF_MASK; i++) m_txTimestampOf[i] = 0;
+    m_fdEnabled = false;
+    m_interfaceName[0] = '\0';
 }
 
 // Initialize socket. Returns false if socket could not be opened.
@@ -70,6 +109,8 @@ bool CanWrapper::Init(const char *interfaceName, int &errorCode)
 
     addr.can_family = AF_CAN;
     addr.can_ifindex = ifr.ifr_ifindex;
+    strncpy(m_interfaceName, ifr.ifr_name, sizeof(m_interfaceName));
+    m_interfaceName[sizeof(m_interfaceName)-1] = '\0';
 
     ret = bind(m_socket, (struct sockaddr *)&addr, sizeof(addr));
     if(ret){
@@ -78,6 +119,28 @@ bool CanWrapper::Init(const char *interfaceName, int &errorCode)
         m_socket = INVALID_SOCKET;
         return false;
     }
+
+    // epoll instance used by WaitMsg to sleep until the socket is readable
+    m_epoll = epoll_create1(EPOLL_CLOEXEC);
+    if(m_epoll < 0){
+        errorCode = errno;
+        close(m_socket);
+        m_socket = INVALID_SOCKET;
+        m_epoll = INVALID_SOCKET;
+        return false;
+    }
+    struct epoll_event ev;
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN;
+    ev.data.fd = m_socket;
+    if(epoll_ctl(m_epoll, EPOLL_CTL_ADD, m_socket, &ev)){
+        errorCode = errno;
+        close(m_epoll);
+        close(m_socket);
+        m_socket = INVALID_SOCKET;
+        m_epoll = INVALID_SOCKET;
+        return false;
+    }
     // if we arrive there, everything went well, the socket is initialized correctly (hopefully)
     m_initialized = true;
     return true;
@@ -90,6 +153,9 @@ void CanWrapper::Close(){
         shutdown(m_socket, SHUT_RDWR);
         close(m_socket);
         m_socket = INVALID_SOCKET;
+        close(m_epoll);
+        m_epoll = INVALID_SOCKET;
+        m_fdEnabled = false;
         m_initialized = false;
     }
 }
@@ -145,8 +211,8 @@ bool CanWrapper::SendMsg(struct can_frame msg, bool extended, bool rtr, int &err
 //#define ENETDOWN        100     /* Network is down - use ifconfig up to start*/
 //#define EAGAIN          11      /* Try again - no data available*/
 //#define EBADF            9      /* Bad file number - can net not opened */
-// timeout - GetMsg will return false after timeout period
-bool CanWrapper::GetMsg(struct can_frame &frame, bool &extended, bool &rtr, bool &error, int &errorCode)
+// timestamp - if not NULL, set to the reception time of the frame (ns since epoch)
+bool CanWrapper::GetMsg(struct can_frame &frame, bool &extended, bool &rtr, bool &error, int &errorCode, int64_t *timestamp)
 {
     //usleep(4000);
 
@@ -176,7 +242,19 @@ bool CanWrapper::GetMsg(struct can_frame &frame, bool &extended, bool &rtr, bool
     ret =1 ;
     if(ret > 0)
     {
-        bytesRead = read(m_socket, &frame, sizeof(frame));
+        // recvmsg rather than read, to get the timestamp control message along with the frame
+        struct iovec iov;
+        struct msghdr msg;
+        char ctrl[CTRL_LEN];
+        iov.iov_base = &frame;
+        iov.iov_len = sizeof(frame);
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = ctrl;
+        msg.msg_controllen = sizeof(ctrl);
+
+        bytesRead = recvmsg(m_socket, &msg, 0);
 
         if(bytesRead < 0)
         {
@@ -185,7 +263,7 @@ bool CanWrapper::GetMsg(struct can_frame &frame, bool &extended, bool &rtr, bool
             return false;
         }
 
-        if(bytesRead == sizeof(frame))
+        if(bytesRead == sizeof(frame) && !(msg.msg_flags & MSG_TRUNC)) // a CAN FD frame is truncated in a can_frame, it is dropped
         {
             error = frame.can_id & CAN_ERR_FLAG;
 
@@ -193,6 +271,12 @@ bool CanWrapper::GetMsg(struct can_frame &frame, bool &extended, bool &rtr, bool
 
             rtr = frame.can_id & CAN_RTR_FLAG;
 
+            if(timestamp)
+            {
+                *timestamp = extractTimestamp(&msg);
+                if(*timestamp == 0) *timestamp = realtimeNowNs(); // timestamps not enabled on the socket
+            }
+
             if(error)
             {
                 frame.can_id  &= CAN_ERR_MASK;
@@ -214,6 +298,555 @@ bool CanWrapper::GetMsg(struct can_frame &frame, bool &extended, bool &rtr, bool
     return false;
 }
 
+// Wait for a CAN message. The calling thread sleeps in epoll_wait (no CPU used) until the socket is readable
+// or until the deadline expires. Returns true if a frame has been received, false on error or timeout.
+// Parameters:
+// frame, extended, rtr, error, errorCode, timestamp - see GetMsg
+// timeoutMs - maximum time to wait, in milliseconds (0 only polls the socket once)
+// Common errors (in addition to the GetMsg ones):
+//#define ETIMEDOUT       110     /* No frame received before the deadline */
+bool CanWrapper::WaitMsg(struct can_frame &frame, bool &extended, bool &rtr, bool &error, int &errorCode, int timeoutMs, int64_t *timestamp)
+{
+    if(!m_initialized)
+    {
+        errorCode = -1;
+        return false;
+    }
+
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+
+    while(true)
+    {
+        // the tx timestamps are collected first, so that they are known before the response to the frame is returned
+        if(m_txTimestamps)
+        {
+            ReadErrQueue();
+        }
+
+        // a frame may already be queued, in which case we do not need to sleep at all
+        if(GetMsg(frame, extended, rtr, error, errorCode, timestamp))
+        {
+            return true;
+        }
+        if(errorCode != 0 && errorCode != EAGAIN && errorCode != EWOULDBLOCK)
+        {
+            return false;
+        }
+
+        if(!SleepUntilReadable(deadline, errorCode))
+        {
+            return false;
+        }
+    }
+}
+
+// Wait until a frame can be read from the socket, without reading it.
+// The tx timestamps are collected on the way, as in WaitMsg.
+// Parameters:
+// timeoutMs - maximum time to wait, in milliseconds
+// errorcode - will be set to an error code, ETIMEDOUT if no frame arrived before the deadline
+bool CanWrapper::WaitReadable(int timeoutMs, int &errorCode)
+{
+    errorCode = 0;
+    if(!m_initialized)
+    {
+        errorCode = -1;
+        return false;
+    }
+
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+
+    while(true)
+    {
+        // the error queue also wakes epoll up, it is emptied first
+        if(m_txTimestamps)
+        {
+            ReadErrQueue();
+        }
+
+        struct pollfd pfd;
+        pfd.fd = m_socket;
+        pfd.events = POLLIN;
+        pfd.revents = 0;
+        if(poll(&pfd, 1, 0) > 0 && (pfd.revents & POLLIN))
+        {
+            return true;
+        }
+
+        if(!SleepUntilReadable(deadline, errorCode))
+        {
+            return false;
+        }
+    }
+}
+
+// Sleep in epoll_wait until the socket is readable (or has tx timestamps pending). Returns false at the deadline (errorCode = ETIMEDOUT) or on error.
+bool CanWrapper::SleepUntilReadable(const std::chrono::steady_clock::time_point &deadline, int &errorCode)
+{
+    struct epoll_event ev;
+
+    // remaining time, rounded up so that we never wake up before the deadline
+    long long remainingUs = std::chrono::duration_cast<std::chrono::microseconds>(deadline - std::chrono::steady_clock::now()).count();
+    if(remainingUs <= 0)
+    {
+        errorCode = ETIMEDOUT;
+        return false;
+    }
+
+    int ret = epoll_wait(m_epoll, &ev, 1, (int)((remainingUs + 999) / 1000));
+    if(ret < 0 && errno != EINTR)
+    {
+        errorCode = errno;
+        return false;
+    }
+    return true;
+}
+
+// Send several messages on the CAN-bus with as few syscalls as possible (sendmmsg, BATCH_MAX frames per call).
+// Returns the number of frames sent, which is less than count if the socket tx queue got full (errorCode is then EAGAIN/ENOBUFS),
+// or -1 if nothing could be sent.
+// Parameters:
+// frames - the can messages to send, flags (extended, rtr) must already be set in can_id
+// count - the number of messages
+// errorcode - will be set to an error code (see SendMsg)
+int CanWrapper::SendBatch(const struct can_frame *frames, int count, int &errorCode)
+{
+    struct mmsghdr msgs[BATCH_MAX];
+    struct iovec iovs[BATCH_MAX];
+    int sent = 0;
+
+    errorCode = 0;
+    if(!m_initialized){
+        errorCode = -1;
+        return -1;
+    }
+
+    while(sent < count){
+        int n = count - sent;
+        if(n > BATCH_MAX) n = BATCH_MAX;
+
+        memset(msgs, 0, n * sizeof(struct mmsghdr));
+        for(int i=0; i<n; i++){
+            iovs[i].iov_base = (void*)&frames[sent+i];
+            iovs[i].iov_len = sizeof(struct can_frame);
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        int res = sendmmsg(m_socket, msgs, n, 0);
+        if(res < 0){
+            errorCode = errno;
+            return sent > 0 ? sent : -1;
+        }
+        sent += res;
+        if(res < n){
+            // the tx queue is full, let the caller decide what to do with the remaining frames
+            errorCode = EAGAIN;
+            break;
+        }
+    }
+    return sent;
+}
+
+// Get every CAN message currently queued on the socket with as few syscalls as possible (recvmmsg, BATCH_MAX frames per call).
+// Never blocks. Returns the number of frames received (0 if there was nothing to read) or -1 on error.
+// Unlike GetMsg, the CAN_EFF_FLAG/CAN_RTR_FLAG/CAN_ERR_FLAG bits are left in can_id.
+// Parameters:
+// frames - buffer receiving the can messages
+// maxCount - the size of the buffer
+// errorcode - error code (see GetMsg)
+// timestamps - if not NULL, set to the reception time of each frame (ns since epoch)
+int CanWrapper::RecvBatch(struct can_frame *frames, int maxCount, int &errorCode, int64_t *timestamps)
+{
+    struct mmsghdr msgs[BATCH_MAX];
+    struct iovec iovs[BATCH_MAX];
+    char ctrls[BATCH_MAX][CTRL_LEN];
+    int received = 0;
+
+    errorCode = 0;
+    if(!m_initialized){
+        errorCode = -1;
+        return -1;
+    }
+
+    while(received < maxCount){
+        int n = maxCount - received;
+        if(n > BATCH_MAX) n = BATCH_MAX;
+
+        memset(msgs, 0, n * sizeof(struct mmsghdr));
+        for(int i=0; i<n; i++){
+            iovs[i].iov_base = &frames[received+i];
+            iovs[i].iov_len = sizeof(struct can_frame);
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            if(timestamps){
+                msgs[i].msg_hdr.msg_control = ctrls[i];
+                msgs[i].msg_hdr.msg_controllen = CTRL_LEN;
+            }
+        }
+
+        int res = recvmmsg(m_socket, msgs, n, MSG_DONTWAIT, NULL);
+        if(res < 0){
+            if(errno != EAGAIN && errno != EWOULDBLOCK){
+                errorCode = errno;
+                return received > 0 ? received : -1;
+            }
+            break; // nothing more to read
+        }
+        int kept = 0;
+        int64_t now = 0;
+        for(int i=0; i<res; i++){
+            if(msgs[i].msg_len != sizeof(struct can_frame) || (msgs[i].msg_hdr.msg_flags & MSG_TRUNC)){
+                continue; // CAN FD frame received on a classic buffer, see RecvFdBatch
+            }
+            if(kept != i) frames[received+kept] = frames[received+i];
+            if(timestamps){
+                timestamps[received+kept] = extractTimestamp(&msgs[i].msg_hdr);
+                if(timestamps[received+kept] == 0){ // timestamps not enabled on the socket
+                    if(now == 0) now = realtimeNowNs();
+                    timestamps[received+kept] = now;
+                }
+            }
+            kept++;
+        }
+        received += kept;
+        if(res < n){
+            break; // the socket queue is empty
+        }
+    }
+    return received;
+}
+
+// Set the CAN_RAW_FILTER list of the socket: the kernel drops every frame that matches none of the filters,
+// so the reader is not woken up for traffic it does not care about.
+// Frames already queued before the call are not affected.
+// Parameters:
+// filters - the (can_id, can_mask) pairs, CAN_INV_FILTER can be set in can_id to invert a filter
+// count - the number of filters, 0 to receive nothing
+// errorcode - will be set to an error code
+bool CanWrapper::SetFilters(const struct can_filter *filters, int count, int &errorCode)
+{
+    errorCode = 0;
+    if(!m_initialized){
+        errorCode = -1;
+        return false;
+    }
+
+    if(setsockopt(m_socket, SOL_CAN_RAW, CAN_RAW_FILTER, count > 0 ? filters : NULL, count * sizeof(struct can_filter)) < 0){
+        errorCode = errno;
+        return false;
+    }
+    return true;
+}
+
+// Enable CAN FD on the socket (CAN_RAW_FD_FRAMES). Returns false, and the socket stays classic CAN,
+// if the interface is not CAN FD capable (its MTU is not CANFD_MTU, use "ip link set can0 mtu 72" on vcan) or if the kernel does not support it.
+// Once enabled, both classic and FD frames can be sent and received with SendFdMsg/GetFdMsg/WaitFdMsg/RecvFdBatch,
+// the classic functions drop the FD frames.
+// Parameters:
+// errorcode - will be set to an error code
+bool CanWrapper::EnableFdFrames(int &errorCode)
+{
+    struct ifreq ifr;
+    errorCode = 0;
+    if(!m_initialized){
+        errorCode = -1;
+        return false;
+    }
+
+    strncpy(ifr.ifr_name, m_interfaceName, IFNAMSIZ);
+    ifr.ifr_name[IFNAMSIZ-1] = '\0';
+    if(ioctl(m_socket, SIOCGIFMTU, &ifr) < 0){
+        errorCode = errno;
+        return false;
+    }
+    if(ifr.ifr_mtu != CANFD_MTU){
+        errorCode = EOPNOTSUPP; // classic CAN interface
+        return false;
+    }
+
+    int on = 1;
+    if(setsockopt(m_socket, SOL_CAN_RAW, CAN_RAW_FD_FRAMES, &on, sizeof(on)) < 0){
+        errorCode = errno;
+        return false;
+    }
+    m_fdEnabled = true;
+    return true;
+}
+
+// Send a CAN FD message (or a classic one if FD is not enabled on the socket and the payload fits in 8 bytes).
+// Parameters:
+// msg - the message to send, msg.len is the payload length (0..64, rounded up by the caller to a valid FD length)
+// extended - set to true to send an extended frame
+// brs - bit rate switch: the data phase is sent at the higher data bit rate
+// esi - error state indicator (only meaningful for gateways)
+// brs and esi are ignored when the message is sent as a classic frame
+// errorcode - will be set to an error code (EMSGSIZE if the payload does not fit a classic frame and FD is disabled)
+bool CanWrapper::SendFdMsg(struct canfd_frame msg, bool extended, bool brs, bool esi, int &errorCode)
+{
+    int res;
+    errorCode = 0;
+    if(!m_initialized){
+        errorCode = -1;
+        return false;
+    }
+
+    if(extended){
+        msg.can_id |= CAN_EFF_FLAG;
+    }
+
+    if(!m_fdEnabled){
+        // fallback to classic CAN: brs and esi are ignored, flags, __res0 and __res1 would land in the __pad, __res0
+        // and len8_dlc of the can_frame written
+        if(msg.len > CAN_MAX_DLEN){
+            errorCode = EMSGSIZE;
+            return false;
+        }
+        msg.flags = 0;
+        msg.__res0 = 0;
+        msg.__res1 = 0;
+        res = write(m_socket, &msg, CAN_MTU);
+    }else{
+        msg.flags = 0;
+        if(brs) msg.flags |= CANFD_BRS;
+        if(esi) msg.flags |= CANFD_ESI;
+        res = write(m_socket, &msg, CANFD_MTU);
+    }
+
+    if(res < 0){
+        errorCode = errno;
+        return false;
+    }
+    return true;
+}
+
+// Get a CAN or CAN FD message, never blocks (see GetMsg).
+// Parameters:
+// frame - the received frame, frame.len is the payload length
+// extended - will be set to true if the received frame was an extended frame
+// fd - will be set to true if it is a CAN FD frame (BRS/ESI are then in frame.flags), false for a classic one
+// error - will be set to true if it is an error frame
+// errorcode - error code (see GetMsg)
+// timestamp - if not NULL, set to the reception time of the frame (ns since epoch)
+bool CanWrapper::GetFdMsg(struct canfd_frame &frame, bool &extended, bool &fd, bool &error, int &errorCode, int64_t *timestamp)
+{
+    struct iovec iov;
+    struct msghdr msg;
+    char ctrl[CTRL_LEN];
+
+    errorCode = 0;
+    if(!m_initialized){
+        return false;
+    }
+
+    iov.iov_base = &frame;
+    iov.iov_len = sizeof(frame);
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = ctrl;
+    msg.msg_controllen = sizeof(ctrl);
+
+    int bytesRead = recvmsg(m_socket, &msg, 0);
+    if(bytesRead < 0){
+        errorCode = errno;
+        return false;
+    }
+
+    if(bytesRead == CANFD_MTU){
+        fd = true;
+    }else if(bytesRead == CAN_MTU){
+        fd = false;
+        frame.flags = 0;
+    }else{
+        return false;
+    }
+
+    error = frame.can_id & CAN_ERR_FLAG;
+    extended = frame.can_id & CAN_EFF_FLAG;
+    if(error){
+        frame.can_id &= CAN_ERR_MASK;
+    }
+    if(extended){
+        frame.can_id &= CAN_EFF_MASK;
+    }else{
+        frame.can_id &= CAN_SFF_MASK;
+    }
+
+    if(timestamp){
+        *timestamp = extractTimestamp(&msg);
+        if(*timestamp == 0) *timestamp = realtimeNowNs();
+    }
+    return true;
+}
+
+// Wait for a CAN or CAN FD message, see WaitMsg and GetFdMsg
+bool CanWrapper::WaitFdMsg(struct canfd_frame &frame, bool &extended, bool &fd, bool &error, int &errorCode, int timeoutMs, int64_t *timestamp)
+{
+    if(!m_initialized){
+        errorCode = -1;
+        return false;
+    }
+
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+
+    while(true){
+        if(m_txTimestamps){
+            ReadErrQueue();
+        }
+        if(GetFdMsg(frame, extended, fd, error, errorCode, timestamp)){
+            return true;
+        }
+        if(errorCode != 0 && errorCode != EAGAIN && errorCode != EWOULDBLOCK){
+            return false;
+        }
+        if(!SleepUntilReadable(deadline, errorCode)){
+            return false;
+        }
+    }
+}
+
+// Get every CAN and CAN FD message currently queued on the socket, see RecvBatch.
+// Parameters:
+// frames - buffer receiving the messages, flags are left in can_id
+// fd - buffer set to true for the CAN FD frames, false for the classic ones
+// maxCount - the size of the buffers
+// errorcode - error code (see GetMsg)
+// timestamps - if not NULL, set to the reception time of each frame (ns since epoch)
+int CanWrapper::RecvFdBatch(struct canfd_frame *frames, bool *fd, int maxCount, int &errorCode, int64_t *timestamps)
+{
+    struct mmsghdr msgs[BATCH_MAX];
+    struct iovec iovs[BATCH_MAX];
+    char ctrls[BATCH_MAX][CTRL_LEN];
+    int received = 0;
+
+    errorCode = 0;
+    if(!m_initialized){
+        errorCode = -1;
+        return -1;
+    }
+
+    while(received < maxCount){
+        int n = maxCount - received;
+        if(n > BATCH_MAX) n = BATCH_MAX;
+
+        memset(msgs, 0, n * sizeof(struct mmsghdr));
+        for(int i=0; i<n; i++){
+            iovs[i].iov_base = &frames[received+i];
+            iovs[i].iov_len = sizeof(struct canfd_frame);
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+            if(timestamps){
+                msgs[i].msg_hdr.msg_control = ctrls[i];
+                msgs[i].msg_hdr.msg_controllen = CTRL_LEN;
+            }
+        }
+
+        int res = recvmmsg(m_socket, msgs, n, MSG_DONTWAIT, NULL);
+        if(res < 0){
+            if(errno != EAGAIN && errno != EWOULDBLOCK){
+                errorCode = errno;
+                return received > 0 ? received : -1;
+            }
+            break; // nothing more to read
+        }
+
+        int64_t now = 0;
+        for(int i=0; i<res; i++){
+            fd[received+i] = (msgs[i].msg_len == CANFD_MTU);
+            if(!fd[received+i]) frames[received+i].flags = 0;
+            if(timestamps){
+                timestamps[received+i] = extractTimestamp(&msgs[i].msg_hdr);
+                if(timestamps[received+i] == 0){
+                    if(now == 0) now = realtimeNowNs();
+                    timestamps[received+i] = now;
+                }
+            }
+        }
+        received += res;
+        if(res < n){
+            break; // the socket queue is empty
+        }
+    }
+    return received;
+}
+
+// Ask the kernel to timestamp the frames of the socket (SO_TIMESTAMPING, or SO_TIMESTAMPNS on older kernels).
+// The reception timestamps are then returned by GetMsg/WaitMsg/RecvBatch.
+// With tx, the time at which each sent frame left the socket is reported on the error queue with the frame,
+// and can be read with LastTxTimestamp or, for a given COB-ID, TxTimestamp.
+// Only the software timestamps are asked for: they are on CLOCK_REALTIME, like the host time used by the driver,
+// while the hardware ones run on the clock of the controller.
+// Parameters:
+// tx - also enable the transmission timestamps
+// errorcode - will be set to an error code
+bool CanWrapper::EnableTimestamps(bool tx, int &errorCode)
+{
+    errorCode = 0;
+    if(!m_initialized){
+        errorCode = -1;
+        return false;
+    }
+
+    int flags = SOF_TIMESTAMPING_RX_SOFTWARE | SOF_TIMESTAMPING_SOFTWARE;
+    if(tx){
+        // the frame is looped back on the error queue with its timestamp (no OPT_TSONLY), to know which one it is
+        flags |= SOF_TIMESTAMPING_TX_SOFTWARE;
+    }
+
+    if(setsockopt(m_socket, SOL_SOCKET, SO_TIMESTAMPING, &flags, sizeof(flags)) == 0){
+        m_txTimestamps = tx;
+        return true;
+    }
+    errorCode = errno;
+
+    // fallback: software reception timestamps only
+    int on = 1;
+    if(setsockopt(m_socket, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on)) == 0){
+        errorCode = 0; // the error of SO_TIMESTAMPING is not the result of the call
+        m_txTimestamps = false;
+        return true;
+    }
+    errorCode = errno;
+    return false;
+}
+
+// Read every tx timestamp waiting on the socket error queue, the most recent is kept in m_lastTxTimestamp
+// and in m_txTimestampOf for the COB-ID of the frame
+void CanWrapper::ReadErrQueue()
+{
+    char data[sizeof(struct canfd_frame)];
+    char ctrl[CTRL_LEN];
+    struct iovec iov;
+    struct msghdr msg;
+
+    while(true){
+        iov.iov_base = data;
+        iov.iov_len = sizeof(data);
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov = &iov;
+        msg.msg_iovlen = 1;
+        msg.msg_control = ctrl;
+        msg.msg_controllen = sizeof(ctrl);
+
+        if(recvmsg(m_socket, &msg, MSG_ERRQUEUE | MSG_DONTWAIT) < 0){
+            return; // the error queue is empty
+        }
+        int64_t ts = extractTimestamp(&msg);
+        if(ts == 0) continue;
+        m_lastTxTimestamp = ts;
+        canid_t id;
+        memcpy(&id, data, sizeof(id)); // can_id comes first in can_frame and canfd_frame
+        if(!(id & (CAN_EFF_FLAG | CAN_RTR_FLAG | CAN_ERR_FLAG))) m_txTimestampOf[id & CAN_SFF_MASK] = ts;
+    }
+}
+
+int64_t CanWrapper::TxTimestamp(canid_t canId) const
+{
+    if(canId & ~CAN_SFF_MASK) return 0;
+    return m_txTimestampOf[canId];
+}
+
 // Set size of receive buffer. The standard size is usually large enough.
 // Note that getsockopt will return twice the size set
 // If settings a larger size than the system supports, the size will set to a lower value than requested
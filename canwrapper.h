@@ -5,45 +5,113 @@
 
 #include <QString>
 
-#include <linux/can.h>
-#include <linux/can/raw.h>
+#include <atomic>
+#include <chrono>
+#include <stdint.h>
+#include <net/if.h>
 
-class CanWrapper
+#include "cantransport.h"
+
+class CanWrapper : public CanTransport
 {
 public:
     CanWrapper();
 
-    bool Init(const char *interfaceName, int &errorCode); // function to initialize the can_socket
+    bool Init(const char *interfaceName, int &errorCode) override; // function to initialize the can_socket
     // interfaceName: the name of the can interface (i.e. can0 for the raspberry pi)
     // errorCode - error code indicating why init did fail
     // return true if the socket has been opened, false otherwise
 
-    void Close(); // function to close the can_socket
+    void Close() override; // function to close the can_socket
 
-    bool SendMsg(struct can_frame msg, bool extended, bool rtr, int &errorCode); // function to send a can message
+    bool SendMsg(struct can_frame msg, bool extended, bool rtr, int &errorCode) override; // function to send a can message
     // msg: the message to be sent
     // extended: extended can frame or not
     // rtr: remote trame request (or data otherwise)
     // return true is the message has been sent, false otherwise
 
 
-    bool GetMsg(struct can_frame &frame, bool &extended, bool &rtr, bool &error, int &errorCode); // function to het a can message
+    bool GetMsg(struct can_frame &frame, bool &extended, bool &rtr, bool &error, int &errorCode, int64_t *timestamp = NULL) override; // function to het a can message
     // frame: the received can frame
     // extended: is the received can frame an extended can frame or not
     // rtr: is the reveived can frame a request can frame or not
+    // timestamp: if not NULL, reception time of the frame (ns since epoch, kernel time if EnableTimestamps has been called)
     // ??
 
+    bool WaitMsg(struct can_frame &frame, bool &extended, bool &rtr, bool &error, int &errorCode, int timeoutMs, int64_t *timestamp = NULL) override; // function to wait for a can message
+    // same as GetMsg, but sleeps in epoll until a frame arrives or timeoutMs expires
+    // errorCode is set to ETIMEDOUT if no frame arrived before the deadline
+    // return true if a frame has been received, false otherwise
+
+    int SendBatch(const struct can_frame *frames, int count, int &errorCode) override; // function to send several can messages
+    // frames: the messages to be sent (CAN_EFF_FLAG/CAN_RTR_FLAG already set in can_id if needed)
+    // count: the number of messages in frames
+    // return the number of messages sent (may be less than count if the tx queue is full), -1 on error
+
+    int RecvBatch(struct can_frame *frames, int maxCount, int &errorCode, int64_t *timestamps = NULL) override; // function to get all the queued can messages
+    // frames: buffer receiving the messages, flags are left in can_id
+    // maxCount: the size of frames
+    // timestamps: if not NULL, buffer of maxCount reception times (see GetMsg)
+    // return the number of messages received (0 if nothing is queued), -1 on error
+
+    bool WaitReadable(int timeoutMs, int &errorCode) override; // function to sleep until a frame is queued on the socket
+    // the frames are then read with RecvBatch/RecvFdBatch, which keep their flags
+    // errorCode is set to ETIMEDOUT if no frame arrived before timeoutMs
+
+    bool SetFilters(const struct can_filter *filters, int count, int &errorCode) override; // function to set the kernel-side reception filters
+    // filters: the accepted (can_id, can_mask) pairs, a frame is received if (received_id & can_mask) == (can_id & can_mask)
+    // count: the number of filters, 0 means that no frame is received at all
+    // return true if the filters have been applied, false otherwise
+
+    bool EnableFdFrames(int &errorCode) override; // function to enable CAN FD frames on the socket (CAN_RAW_FD_FRAMES)
+    // return false if the interface is not CAN FD capable, the socket then stays classic CAN
+
+    bool isFdEnabled() override { return m_fdEnabled; }
+
+    int GetSocket() { return m_socket; } // the raw socket, to drive it from a DeviceLoop (-1 if not initialized)
+
+    bool SendFdMsg(struct canfd_frame msg, bool extended, bool brs, bool esi, int &errorCode) override; // function to send a can fd message
+    // msg: the message to be sent, msg.len bytes of payload (up to 64)
+    // brs: bit rate switch, esi: error state indicator
+    // if fd is not enabled, the frame is sent as a classic one when it fits in 8 bytes
+
+    bool GetFdMsg(struct canfd_frame &frame, bool &extended, bool &fd, bool &error, int &errorCode, int64_t *timestamp = NULL) override; // function to get a can or can fd message
+    // fd: is the received frame a can fd frame (true) or a classic one (false)
+
+    bool WaitFdMsg(struct canfd_frame &frame, bool &extended, bool &fd, bool &error, int &errorCode, int timeoutMs, int64_t *timestamp = NULL) override;
+    // same as GetFdMsg, but sleeps until a frame arrives or timeoutMs expires (see WaitMsg)
+
+    int RecvFdBatch(struct canfd_frame *frames, bool *fd, int maxCount, int &errorCode, int64_t *timestamps = NULL) override;
+    // same as RecvBatch for can and can fd frames, fd[i] tells if frames[i] is a can fd frame
+
+    bool EnableTimestamps(bool tx, int &errorCode) override; // function to get kernel timestamps on the frames (SO_TIMESTAMPING)
+    // tx: also ask for the transmission timestamps (see LastTxTimestamp)
+    // return true if at least the reception timestamps are enabled
+
+    int64_t LastTxTimestamp() const override { return m_lastTxTimestamp; } // time at which the last sent frame left the socket (ns since epoch, 0 if unknown)
+    int64_t TxTimestamp(canid_t canId) const override; // same for the last standard frame with canId, to match a request with its response
+
     bool SetRecvBufferSize(int size);
     // ??
 
     int EnableErrorMessages();
     // ??
 
-    bool isInitialized() { return m_initialized; } // getter for the initialized boolean attribute
+    bool isInitialized() override { return m_initialized; } // getter for the initialized boolean attribute
 
 private:
     bool m_initialized; // indicates if socket is initialized
     int m_socket;       // id to use the can Socket
+    int m_epoll;        // epoll instance watching m_socket, used by WaitMsg
+    bool m_txTimestamps; // the kernel reports the tx timestamps on the socket error queue
+    std::atomic<int64_t> m_lastTxTimestamp;
+    std::atomic<int64_t> m_txTimestampOf[CAN_SFF_MASK + 1]; // by COB-ID, for the standard frames
+
+    bool m_fdEnabled;   // CAN_RAW_FD_FRAMES is set on the socket
+    char m_interfaceName[IFNAMSIZ];
+
+    void ReadErrQueue(); // function to collect the tx timestamps
+    bool SleepUntilReadable(const std::chrono::steady_clock::time_point &deadline, int &errorCode);
 
 
 };
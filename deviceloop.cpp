@@ -0,0 +1,373 @@
+#include "deviceloop.h"
+
+#include <sys/eventfd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <vector>
+
+#define LOOP_POLL_MS 100 // the loop thread checks if it should stop at least every LOOP_POLL_MS
+#define WAKE_TAG ((uint64_t)1) // user_data of the read on the eventfd (operations are heap pointers, never 1)
+
+static int64_t monotonicNs(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+DeviceLoop::DeviceLoop(){
+    _initialized = false;
+    _eventfd = -1;
+    _running = false;
+}
+
+DeviceLoop::~DeviceLoop(){
+    close();
+}
+
+const char* DeviceLoop::backend(){
+#ifdef POODLE_IO_URING
+    return "io_uring";
+#else
+    return "poll";
+#endif
+}
+
+bool DeviceLoop::init(unsigned int depth, int &errorCode){
+    errorCode = 0;
+    if(_initialized) return true;
+
+    _eventfd = eventfd(0, EFD_CLOEXEC); // blocking: io_uring keeps a read pending on it
+    if(_eventfd < 0){
+        errorCode = errno;
+        return false;
+    }
+#ifdef POODLE_IO_URING
+    int ret = io_uring_queue_init(depth, &_ring, 0);
+    if(ret < 0){
+        errorCode = -ret;
+        ::close(_eventfd);
+        _eventfd = -1;
+        return false;
+    }
+    _initialized = true;
+    _wakeArmed = armWake();
+    io_uring_submit(&_ring);
+#else
+    (void)depth;
+    _initialized = true;
+#endif
+    return true;
+}
+
+void DeviceLoop::close(){
+    stop();
+    if(!_initialized) return;
+
+    drainPending();
+#ifdef POODLE_IO_URING
+    io_uring_queue_exit(&_ring); // cancels the operations still in the kernel
+#endif
+    std::vector<Operation*> ops(_inflight.begin(), _inflight.end());
+    for(unsigned int i=0; i<ops.size(); i++){
+        complete(ops[i], -ECANCELED);
+    }
+    ::close(_eventfd);
+    _eventfd = -1;
+    _initialized = false;
+}
+
+bool DeviceLoop::submitRead(int fd, void *buf, size_t len, int timeoutMs, DeviceCallback callback){
+    Operation* op = new Operation();
+    op->fd = fd;
+    op->write = false;
+    op->buf = (char*)buf;
+    op->len = len;
+    op->deadline = timeoutMs > 0 ? monotonicNs() + (int64_t)timeoutMs * 1000000LL : 0;
+    op->callback = callback;
+    op->polling = false;
+    return submit(op);
+}
+
+bool DeviceLoop::submitWrite(int fd, const void *buf, size_t len, int timeoutMs, DeviceCallback callback){
+    Operation* op = new Operation();
+    op->fd = fd;
+    op->write = true;
+    op->buf = (char*)buf;
+    op->len = len;
+    op->deadline = timeoutMs > 0 ? monotonicNs() + (int64_t)timeoutMs * 1000000LL : 0;
+    op->callback = callback;
+    op->polling = false;
+    return submit(op);
+}
+
+bool DeviceLoop::submit(Operation *op){
+    if(!_initialized){
+        delete op;
+        return false;
+    }
+    {
+        std::lock_guard<std::mutex> lock(_pendingMutex);
+        _pending.push_back(op);
+    }
+    wake();
+    return true;
+}
+
+void DeviceLoop::wake(){
+    uint64_t one = 1;
+    if(write(_eventfd, &one, sizeof(one)) < 0){
+        // the counter is already non-zero, the loop will wake up anyway
+    }
+}
+
+void DeviceLoop::complete(Operation *op, int result){
+    _inflight.erase(op);
+    if(op->callback) op->callback(result);
+    delete op;
+}
+
+bool DeviceLoop::start(){
+    if(!_initialized || _running) return false;
+    _running = true;
+    _thread = std::thread([this]{
+        while(_running){
+            if(runOnce(LOOP_POLL_MS) < 0) break;
+        }
+    });
+    return true;
+}
+
+void DeviceLoop::stop(){
+    if(!_running) return;
+    _running = false;
+    wake();
+    _thread.join();
+}
+
+int DeviceLoop::openGpio(int gpio, bool output, int &errorCode){
+    char path[64];
+    errorCode = 0;
+
+    snprintf(path, sizeof(path), "/sys/class/gpio/gpio%d/value", gpio);
+    if(access(path, F_OK) != 0){
+        int fd = open("/sys/class/gpio/export", O_WRONLY | O_CLOEXEC);
+        if(fd < 0){
+            errorCode = errno;
+            return -1;
+        }
+        char number[16];
+        int n = snprintf(number, sizeof(number), "%d", gpio);
+        if(write(fd, number, n) != n && errno != EBUSY){
+            errorCode = errno;
+            ::close(fd);
+            return -1;
+        }
+        ::close(fd);
+    }
+
+    char direction[64];
+    snprintf(direction, sizeof(direction), "/sys/class/gpio/gpio%d/direction", gpio);
+    int fd = open(direction, O_WRONLY | O_CLOEXEC);
+    if(fd >= 0){
+        const char* value = output ? "out" : "in";
+        if(write(fd, value, strlen(value)) < 0) errorCode = errno;
+        ::close(fd);
+    }
+
+    fd = open(path, (output ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+    if(fd < 0){
+        errorCode = errno;
+        return -1;
+    }
+    return fd;
+}
+
+void DeviceLoop::drainPending(){
+    std::deque<Operation*> pending;
+    {
+        std::lock_guard<std::mutex> lock(_pendingMutex);
+        pending.swap(_pending);
+    }
+    for(unsigned int i=0; i<pending.size(); i++){
+        _inflight.insert(pending[i]);
+#ifdef POODLE_IO_URING
+        int ret = queue(pending[i]);
+        if(ret < 0) complete(pending[i], ret);
+#endif
+    }
+}
+
+#ifdef POODLE_IO_URING
+
+// Make room for count entries in the submission queue, submitting the queued ones if needed.
+// The submission fails while the kernel has no room for more completions (-EBUSY), the queue then stays full.
+bool DeviceLoop::getSqes(unsigned int count){
+    if(io_uring_sq_space_left(&_ring) >= count) return true;
+    io_uring_submit(&_ring);
+    return io_uring_sq_space_left(&_ring) >= count;
+}
+
+// Put the operation in the submission queue: the transfer (or a poll while the fd is not ready),
+// linked to a timeout for the time left before its deadline
+int DeviceLoop::queue(Operation *op){
+    int64_t remaining = 0;
+    if(op->deadline){
+        remaining = op->deadline - monotonicNs();
+        if(remaining <= 0) return -ETIMEDOUT;
+    }
+
+    // the operation and its timeout are queued together, or not at all: a link can not span two submissions
+    if(!getSqes(op->deadline ? 2 : 1)) return -EBUSY;
+    struct io_uring_sqe* sqe = io_uring_get_sqe(&_ring);
+    if(op->polling){
+        io_uring_prep_poll_add(sqe, op->fd, op->write ? POLLOUT : POLLIN);
+    }else if(op->write){
+        io_uring_prep_write(sqe, op->fd, op->buf, op->len, 0);
+    }else{
+        io_uring_prep_read(sqe, op->fd, op->buf, op->len, 0);
+    }
+    io_uring_sqe_set_data(sqe, op);
+
+    if(op->deadline){
+        // the linked timeout cancels the operation above (-ECANCELED) if it is still running when it expires
+        sqe->flags |= IOSQE_IO_LINK;
+        op->timeout.tv_sec = remaining / 1000000000LL;
+        op->timeout.tv_nsec = remaining % 1000000000LL;
+        struct io_uring_sqe* tsqe = io_uring_get_sqe(&_ring);
+        io_uring_prep_link_timeout(tsqe, &op->timeout, 0);
+        io_uring_sqe_set_data(tsqe, NULL);
+    }
+    return 0;
+}
+
+// Queue the read on the eventfd, return false if the submission queue stays full
+bool DeviceLoop::armWake(){
+    if(!getSqes(1)) return false;
+    struct io_uring_sqe* sqe = io_uring_get_sqe(&_ring);
+    io_uring_prep_read(sqe, _eventfd, &_wakeValue, sizeof(_wakeValue), 0);
+    io_uring_sqe_set_data(sqe, (void*)WAKE_TAG);
+    return true;
+}
+
+int DeviceLoop::runOnce(int timeoutMs){
+    if(!_initialized) return -1;
+    // without the read on the eventfd, the submissions of the other threads wait for the timeout: it goes first
+    if(!_wakeArmed) _wakeArmed = armWake();
+    drainPending();
+
+    struct __kernel_timespec ts;
+    ts.tv_sec = timeoutMs / 1000;
+    ts.tv_nsec = (timeoutMs % 1000) * 1000000LL;
+    struct io_uring_cqe* cqe;
+    // submits the queued operations and waits for a completion in the same syscall
+    int ret = io_uring_submit_and_wait_timeout(&_ring, &cqe, 1, &ts, NULL);
+    if(ret < 0 && ret != -ETIME && ret != -EINTR) return -1;
+
+    int called = 0;
+    unsigned int head;
+    unsigned int seen = 0;
+    std::vector<std::pair<Operation*, int> > done;
+    io_uring_for_each_cqe(&_ring, head, cqe){
+        seen++;
+        void* data = io_uring_cqe_get_data(cqe);
+        if(data == NULL) continue; // linked timeout
+        if(data == (void*)WAKE_TAG){
+            _wakeArmed = false;
+            continue;
+        }
+        done.push_back(std::make_pair((Operation*)data, cqe->res));
+    }
+    io_uring_cq_advance(&_ring, seen);
+    if(!_wakeArmed) _wakeArmed = armWake();
+
+    for(unsigned int i=0; i<done.size(); i++){
+        Operation* op = done[i].first;
+        int res = done[i].second;
+        if(res == -ECANCELED) res = -ETIMEDOUT;
+
+        if(!op->polling && res == -EAGAIN){
+            // O_NONBLOCK fd (CAN socket) not ready: wait for it with a poll, then retry the transfer
+            op->polling = true;
+            res = queue(op);
+            if(res == 0) continue;
+        }else if(op->polling && res >= 0){
+            op->polling = false;
+            res = queue(op);
+            if(res == 0) continue;
+        }
+        complete(op, res);
+        called++;
+    }
+    return called;
+}
+
+#else
+
+static int transfer(int fd, bool write, char *buf, size_t len){
+    // same as io_uring: at offset 0 for the files that can seek (sysfs GPIO value), at the current position otherwise
+    ssize_t n = write ? pwrite(fd, buf, len, 0) : pread(fd, buf, len, 0);
+    if(n < 0 && errno == ESPIPE){
+        n = write ? ::write(fd, buf, len) : ::read(fd, buf, len);
+    }
+    return n < 0 ? -errno : (int)n;
+}
+
+int DeviceLoop::runOnce(int timeoutMs){
+    if(!_initialized) return -1;
+    drainPending();
+
+    // one poll on every fd with an operation, the wait ends at the first deadline
+    std::vector<Operation*> ops(_inflight.begin(), _inflight.end());
+    std::vector<struct pollfd> fds(ops.size() + 1);
+    int64_t now = monotonicNs();
+    int64_t waitNs = (int64_t)timeoutMs * 1000000LL;
+    for(unsigned int i=0; i<ops.size(); i++){
+        fds[i].fd = ops[i]->fd;
+        fds[i].events = ops[i]->write ? POLLOUT : POLLIN;
+        fds[i].revents = 0;
+        if(ops[i]->deadline && ops[i]->deadline - now < waitNs){
+            waitNs = ops[i]->deadline - now;
+        }
+    }
+    fds[ops.size()].fd = _eventfd;
+    fds[ops.size()].events = POLLIN;
+    fds[ops.size()].revents = 0;
+    if(waitNs < 0) waitNs = 0;
+
+    int ret = poll(&fds[0], fds.size(), (int)((waitNs + 999999) / 1000000));
+    if(ret < 0 && errno != EINTR) return -1;
+
+    if(fds[ops.size()].revents){
+        uint64_t value;
+        if(read(_eventfd, &value, sizeof(value)) < 0){
+            // already drained
+        }
+    }
+
+    int called = 0;
+    now = monotonicNs();
+    for(unsigned int i=0; i<ops.size(); i++){
+        Operation* op = ops[i];
+        if(fds[i].revents & POLLNVAL){
+            complete(op, -EBADF);
+            called++;
+        }else if(fds[i].revents){
+            int res = transfer(op->fd, op->write, op->buf, op->len);
+            if(res == -EAGAIN) continue; // spurious wake-up, keep waiting
+            complete(op, res);
+            called++;
+        }else if(op->deadline && op->deadline <= now){
+            complete(op, -ETIMEDOUT);
+            called++;
+        }
+    }
+    return called;
+}
+
+#endif
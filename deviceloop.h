@@ -0,0 +1,100 @@
+#ifndef DEVICELOOP_H
+#define DEVICELOOP_H
+
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <stdint.h>
+#include <stddef.h>
+
+#ifdef POODLE_IO_URING
+#include <liburing.h>
+#endif
+
+#define DEVICE_LOOP_DEPTH 64 // default number of submission entries of the ring
+
+typedef std::function<void(int result)> DeviceCallback;
+// result: number of bytes read/written, or -errno (-ETIMEDOUT if the timeout expired first,
+// -EBUSY if the io_uring had no room to submit it)
+
+// One event loop for the device file descriptors of the machine (CAN socket, lens tty, GPIO value files).
+// Reads and writes are submitted asynchronously, each with its own timeout, and complete into a callback
+// called from the loop thread, so a single thread services every device.
+// With POODLE_IO_URING (qmake CONFIG+=io_uring), the operations go through an io_uring with linked
+// timeouts: one syscall submits a batch of operations and reaps the completed ones.
+// Otherwise the loop waits with poll() and does one read/write syscall per operation.
+class DeviceLoop
+{
+public:
+    DeviceLoop();
+    ~DeviceLoop();
+
+    bool init(unsigned int depth, int &errorCode); // function to create the ring (io_uring) and the wake-up eventfd
+    void close();                                  // function to stop the loop, the pending operations complete with -ECANCELED
+
+    bool submitRead(int fd, void *buf, size_t len, int timeoutMs, DeviceCallback callback);
+    bool submitWrite(int fd, const void *buf, size_t len, int timeoutMs, DeviceCallback callback);
+    // function to queue a read/write of len bytes on fd (thread safe)
+    // buf: must stay valid until the callback is called
+    // timeoutMs: 0 for no timeout
+    // return false if the loop is not initialized
+
+    int runOnce(int timeoutMs); // function to process the completed operations, waiting at most timeoutMs for one
+    // return the number of callbacks called, -1 on error
+    // only one thread at a time should call it (the loop thread if start has been called)
+
+    bool start(); // function to run the loop in a background thread
+    void stop();
+    bool isRunning() const { return _running; }
+
+    static const char* backend(); // "io_uring" or "poll"
+
+    static int openGpio(int gpio, bool output, int &errorCode);
+    // function to export a GPIO through sysfs and open its value file, to be used with the loop
+    // gpio: the kernel (BCM) number of the line, not the wiringPi one
+    // return the file descriptor, -1 on error
+
+private:
+    struct Operation{
+        int fd;
+        bool write;
+        char *buf;
+        size_t len;
+        int64_t deadline; // CLOCK_MONOTONIC ns, 0 for no timeout
+        DeviceCallback callback;
+        bool polling;     // waiting for the fd to be ready before retrying the transfer
+#ifdef POODLE_IO_URING
+        struct __kernel_timespec timeout;
+#endif
+    };
+
+    bool submit(Operation *op);
+    void drainPending();
+    void complete(Operation *op, int result);
+    void wake();
+
+#ifdef POODLE_IO_URING
+    int queue(Operation *op); // return 0, -ETIMEDOUT if the deadline is passed, -EBUSY if the submission queue stays full
+    bool getSqes(unsigned int count);
+    bool armWake();
+
+    struct io_uring _ring;
+    uint64_t _wakeValue; // target of the read on the eventfd
+    bool _wakeArmed;     // the read on the eventfd is queued or in the kernel
+#endif
+
+    bool _initialized;
+    int _eventfd; // other threads wake the loop through it when they submit
+
+    std::mutex _pendingMutex;
+    std::deque<Operation*> _pending;           // submitted, not yet seen by the loop
+    std::unordered_set<Operation*> _inflight;  // owned by the loop thread
+
+    std::thread _thread;
+    std::atomic<bool> _running;
+};
+
+#endif // DEVICELOOP_H
@@ -0,0 +1,51 @@
+#include "ioworker.h"
+
+IoWorker::IoWorker(){
+    _busy = false;
+    _stopping = false;
+    _thread = std::thread(&IoWorker::loop, this);
+}
+
+IoWorker::~IoWorker(){
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _cond.notify_all();
+    _thread.join();
+}
+
+void IoWorker::post(std::function<void()> job){
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _jobs.push_back(job);
+    }
+    _cond.notify_one();
+}
+
+size_t IoWorker::pending(){
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _jobs.size() + (_busy ? 1 : 0);
+}
+
+void IoWorker::waitIdle(){
+    std::unique_lock<std::mutex> lock(_mutex);
+    _idleCond.wait(lock, [this]{ return _jobs.empty() && !_busy; });
+}
+
+void IoWorker::loop(){
+    std::unique_lock<std::mutex> lock(_mutex);
+    while(true){
+        _cond.wait(lock, [this]{ return _stopping || !_jobs.empty(); });
+        if(_jobs.empty()) break; // stopping, and nothing left to run
+
+        std::function<void()> job = _jobs.front();
+        _jobs.pop_front();
+        _busy = true;
+        lock.unlock();
+        job();
+        lock.lock();
+        _busy = false;
+        if(_jobs.empty()) _idleCond.notify_all();
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef IOWORKER_H
+#define IOWORKER_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <stddef.h>
+
+// Background thread running jobs in the order they are posted.
+// Used by the driver to run the blocking transactions of a node without blocking the caller (see the *Async functions).
+class IoWorker
+{
+public:
+    IoWorker();
+    ~IoWorker(); // the jobs already posted are run before the thread ends
+
+    void post(std::function<void()> job); // function to queue a job (thread safe)
+    size_t pending();                      // number of jobs queued or running
+    void waitIdle();                       // function to wait until every posted job is done
+
+private:
+    void loop();
+
+    std::mutex _mutex;
+    std::condition_variable _cond;     // notified when a job is posted or the worker should stop
+    std::condition_variable _idleCond; // notified when the queue becomes empty
+    std::deque<std::function<void()> > _jobs;
+    bool _busy;
+    bool _stopping;
+    std::thread _thread;
+};
+
+#endif // IOWORKER_H
@@ -0,0 +1,313 @@
+#include "loopbackcan.h"
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+
+#include <chrono>
+#include <map>
+
+static int64_t realtimeNowNs(){
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+static void decodeId(canid_t &id, bool &extended, bool &rtr, bool &error){
+    // same as CanWrapper::GetMsg: report the flags and remove them from the id
+    error = id & CAN_ERR_FLAG;
+    extended = id & CAN_EFF_FLAG;
+    rtr = id & CAN_RTR_FLAG;
+    if(error){
+        id &= CAN_ERR_MASK;
+    }
+    if(extended){
+        id &= CAN_EFF_MASK;
+    }else{
+        id &= CAN_SFF_MASK;
+    }
+}
+
+LoopbackCanBus* LoopbackCanBus::get(const char *name){
+    static std::mutex registryMutex;
+    static std::map<std::string, LoopbackCanBus*> registry;
+
+    std::lock_guard<std::mutex> lock(registryMutex);
+    LoopbackCanBus*& bus = registry[name];
+    if(bus == NULL) bus = new LoopbackCanBus();
+    return bus;
+}
+
+void LoopbackCanBus::attach(LoopbackCanTransport* endpoint){
+    std::lock_guard<std::mutex> lock(_mutex);
+    _endpoints.push_back(endpoint);
+}
+
+void LoopbackCanBus::detach(LoopbackCanTransport* endpoint){
+    std::lock_guard<std::mutex> lock(_mutex);
+    for(unsigned int i=0; i<_endpoints.size(); i++){
+        if(_endpoints[i] == endpoint){
+            _endpoints.erase(_endpoints.begin()+i);
+            return;
+        }
+    }
+}
+
+void LoopbackCanBus::deliver(const LoopbackCanTransport* sender, const struct canfd_frame& frame, bool fd, int64_t timestamp){
+    std::lock_guard<std::mutex> lock(_mutex);
+    for(unsigned int i=0; i<_endpoints.size(); i++){
+        // as with CAN_RAW_RECV_OWN_MSGS off, the sender does not receive its own frames
+        if(_endpoints[i] != sender) _endpoints[i]->receive(frame, fd, timestamp);
+    }
+}
+
+LoopbackCanTransport::LoopbackCanTransport(){
+    _bus = NULL;
+    _fdEnabled = false;
+    _lastTxTimestamp = 0;
+    for(unsigned int i=0; i<=CAN_SFF_MASK; i++) _txTimestampOf[i] = 0;
+}
+
+LoopbackCanTransport::~LoopbackCanTransport(){
+    Close();
+}
+
+bool LoopbackCanTransport::Init(const char *interfaceName, int &errorCode){
+    errorCode = 0;
+    if(_bus) return true;
+
+    // default filter of a raw socket: every frame
+    struct can_filter all;
+    all.can_id = 0;
+    all.can_mask = 0;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _filters.assign(1, all);
+        _queue.clear();
+    }
+
+    _bus = LoopbackCanBus::get(interfaceName);
+    _bus->attach(this);
+    return true;
+}
+
+void LoopbackCanTransport::Close(){
+    if(_bus){
+        _bus->detach(this);
+        _bus = NULL;
+        _fdEnabled = false;
+    }
+}
+
+bool LoopbackCanTransport::accepted(canid_t id){
+    // same matching as the CAN_RAW_FILTER of the kernel, called with _mutex locked
+    for(unsigned int i=0; i<_filters.size(); i++){
+        bool match = ((id ^ _filters[i].can_id) & _filters[i].can_mask) == 0;
+        if(_filters[i].can_id & CAN_INV_FILTER) match = !match;
+        if(match) return true;
+    }
+    return false;
+}
+
+void LoopbackCanTransport::receive(const struct canfd_frame& frame, bool fd, int64_t timestamp){
+    if(fd && !_fdEnabled) return; // a classic socket does not get the can fd frames
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if(!accepted(frame.can_id)) return;
+        if(_queue.size() >= LOOPBACK_QUEUE_SIZE) return; // the "socket buffer" is full, the frame is lost
+        Entry entry;
+        entry.frame = frame;
+        entry.fd = fd;
+        entry.timestamp = timestamp;
+        _queue.push_back(entry);
+    }
+    _cond.notify_one();
+}
+
+bool LoopbackCanTransport::send(const struct canfd_frame& frame, bool fd, int &errorCode){
+    errorCode = 0;
+    if(!_bus){
+        errorCode = -1;
+        return false;
+    }
+    int64_t now = realtimeNowNs();
+    _lastTxTimestamp = now;
+    if(!(frame.can_id & (CAN_EFF_FLAG | CAN_RTR_FLAG | CAN_ERR_FLAG))) _txTimestampOf[frame.can_id & CAN_SFF_MASK] = now;
+    _bus->deliver(this, frame, fd, now);
+    return true;
+}
+
+int64_t LoopbackCanTransport::TxTimestamp(canid_t canId) const {
+    if(canId & ~CAN_SFF_MASK) return 0;
+    return _txTimestampOf[canId];
+}
+
+bool LoopbackCanTransport::pop(Entry& entry, int timeoutMs, int &errorCode){
+    errorCode = 0;
+    if(!_bus){
+        errorCode = -1;
+        return false;
+    }
+    std::unique_lock<std::mutex> lock(_mutex);
+    if(_queue.empty()){
+        if(timeoutMs <= 0 || !_cond.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this]{ return !_queue.empty(); })){
+            errorCode = timeoutMs > 0 ? ETIMEDOUT : EAGAIN;
+            return false;
+        }
+    }
+    entry = _queue.front();
+    _queue.pop_front();
+    return true;
+}
+
+bool LoopbackCanTransport::WaitReadable(int timeoutMs, int &errorCode){
+    errorCode = 0;
+    if(!_bus){
+        errorCode = -1;
+        return false;
+    }
+    std::unique_lock<std::mutex> lock(_mutex);
+    if(!_cond.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this]{ return !_queue.empty(); })){
+        errorCode = ETIMEDOUT;
+        return false;
+    }
+    return true;
+}
+
+bool LoopbackCanTransport::SendMsg(struct can_frame msg, bool extended, bool rtr, int &errorCode){
+    if(extended) msg.can_id |= CAN_EFF_FLAG;
+    if(rtr) msg.can_id |= CAN_RTR_FLAG;
+
+    struct canfd_frame frame;
+    memset(&frame, 0, sizeof(frame));
+    memcpy(&frame, &msg, sizeof(msg));
+    return send(frame, false, errorCode);
+}
+
+bool LoopbackCanTransport::GetMsg(struct can_frame &frame, bool &extended, bool &rtr, bool &error, int &errorCode, int64_t *timestamp){
+    return WaitMsg(frame, extended, rtr, error, errorCode, 0, timestamp);
+}
+
+bool LoopbackCanTransport::WaitMsg(struct can_frame &frame, bool &extended, bool &rtr, bool &error, int &errorCode, int timeoutMs, int64_t *timestamp){
+    Entry entry;
+    do{
+        if(!pop(entry, timeoutMs, errorCode)) return false;
+    }while(entry.fd); // can fd frames are dropped by the classic functions, as with CanWrapper
+
+    memcpy(&frame, &entry.frame, sizeof(frame));
+    decodeId(frame.can_id, extended, rtr, error);
+    if(timestamp) *timestamp = entry.timestamp;
+    return true;
+}
+
+int LoopbackCanTransport::SendBatch(const struct can_frame *frames, int count, int &errorCode){
+    for(int i=0; i<count; i++){
+        struct canfd_frame frame;
+        memset(&frame, 0, sizeof(frame));
+        memcpy(&frame, &frames[i], sizeof(struct can_frame));
+        if(!send(frame, false, errorCode)) return i > 0 ? i : -1;
+    }
+    return count;
+}
+
+int LoopbackCanTransport::RecvBatch(struct can_frame *frames, int maxCount, int &errorCode, int64_t *timestamps){
+    errorCode = 0;
+    if(!_bus){
+        errorCode = -1;
+        return -1;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    int n = 0;
+    while(n < maxCount && !_queue.empty()){
+        const Entry& entry = _queue.front();
+        if(!entry.fd){
+            memcpy(&frames[n], &entry.frame, sizeof(struct can_frame)); // flags are left in can_id, as with CanWrapper
+            if(timestamps) timestamps[n] = entry.timestamp;
+            n++;
+        }
+        _queue.pop_front();
+    }
+    return n;
+}
+
+bool LoopbackCanTransport::SetFilters(const struct can_filter *filters, int count, int &errorCode){
+    errorCode = 0;
+    if(!_bus){
+        errorCode = -1;
+        return false;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    _filters.assign(filters, filters + count);
+    return true;
+}
+
+bool LoopbackCanTransport::EnableFdFrames(int &errorCode){
+    errorCode = 0;
+    if(!_bus){
+        errorCode = -1;
+        return false;
+    }
+    _fdEnabled = true;
+    return true;
+}
+
+bool LoopbackCanTransport::SendFdMsg(struct canfd_frame msg, bool extended, bool brs, bool esi, int &errorCode){
+    if(extended) msg.can_id |= CAN_EFF_FLAG;
+    if(!_fdEnabled){
+        if(msg.len > CAN_MAX_DLEN){
+            errorCode = EMSGSIZE;
+            return false;
+        }
+        // classic frame, as CanWrapper: brs and esi are ignored, nothing is left in the bytes of __pad, __res0 and len8_dlc
+        msg.flags = 0;
+        msg.__res0 = 0;
+        msg.__res1 = 0;
+        return send(msg, false, errorCode);
+    }
+    msg.flags = 0;
+    if(brs) msg.flags |= CANFD_BRS;
+    if(esi) msg.flags |= CANFD_ESI;
+    return send(msg, true, errorCode);
+}
+
+bool LoopbackCanTransport::GetFdMsg(struct canfd_frame &frame, bool &extended, bool &fd, bool &error, int &errorCode, int64_t *timestamp){
+    return WaitFdMsg(frame, extended, fd, error, errorCode, 0, timestamp);
+}
+
+bool LoopbackCanTransport::WaitFdMsg(struct canfd_frame &frame, bool &extended, bool &fd, bool &error, int &errorCode, int timeoutMs, int64_t *timestamp){
+    Entry entry;
+    if(!pop(entry, timeoutMs, errorCode)) return false;
+
+    bool rtr;
+    frame = entry.frame;
+    fd = entry.fd;
+    decodeId(frame.can_id, extended, rtr, error);
+    if(timestamp) *timestamp = entry.timestamp;
+    return true;
+}
+
+int LoopbackCanTransport::RecvFdBatch(struct canfd_frame *frames, bool *fd, int maxCount, int &errorCode, int64_t *timestamps){
+    errorCode = 0;
+    if(!_bus){
+        errorCode = -1;
+        return -1;
+    }
+    std::lock_guard<std::mutex> lock(_mutex);
+    int n = 0;
+    while(n < maxCount && !_queue.empty()){
+        const Entry& entry = _queue.front();
+        frames[n] = entry.frame;
+        fd[n] = entry.fd;
+        if(timestamps) timestamps[n] = entry.timestamp;
+        n++;
+        _queue.pop_front();
+    }
+    return n;
+}
+
+bool LoopbackCanTransport::EnableTimestamps(bool tx, int &errorCode){
+    (void)tx;
+    errorCode = 0;
+    return _bus != NULL;
+}
@@ -0,0 +1,90 @@
+#ifndef LOOPBACKCAN_H
+#define LOOPBACKCAN_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "cantransport.h"
+
+#define LOOPBACK_QUEUE_SIZE 4096 // frames queued per endpoint before the new ones are dropped (like a full socket buffer)
+
+class LoopbackCanTransport;
+
+// In-process CAN bus: every frame sent by an endpoint is delivered to all the other endpoints of the same bus,
+// with the same filtering rules as a SocketCAN raw socket. The frames are handed over in memory, with no socket
+// and no copy through the kernel: the only syscalls are the futex calls of the condition variable when a reader
+// sleeps, so the driver can be tested and benchmarked at millions of frames per second without any CAN hardware.
+class LoopbackCanBus
+{
+public:
+    static LoopbackCanBus* get(const char *name); // function to get the bus of a name (created on first use, never destroyed)
+
+    void attach(LoopbackCanTransport* endpoint);
+    void detach(LoopbackCanTransport* endpoint);
+    void deliver(const LoopbackCanTransport* sender, const struct canfd_frame& frame, bool fd, int64_t timestamp);
+
+private:
+    std::mutex _mutex;
+    std::vector<LoopbackCanTransport*> _endpoints;
+};
+
+// One endpoint of a LoopbackCanBus, same behaviour as a CanWrapper on a vcan interface
+class LoopbackCanTransport : public CanTransport
+{
+public:
+    LoopbackCanTransport();
+    ~LoopbackCanTransport();
+
+    bool Init(const char *interfaceName, int &errorCode) override; // function to attach to the loopback bus of the given name
+    void Close() override;
+    bool isInitialized() override { return _bus != NULL; }
+
+    bool SendMsg(struct can_frame msg, bool extended, bool rtr, int &errorCode) override;
+    bool GetMsg(struct can_frame &frame, bool &extended, bool &rtr, bool &error, int &errorCode, int64_t *timestamp = NULL) override;
+    bool WaitMsg(struct can_frame &frame, bool &extended, bool &rtr, bool &error, int &errorCode, int timeoutMs, int64_t *timestamp = NULL) override;
+    int SendBatch(const struct can_frame *frames, int count, int &errorCode) override;
+    int RecvBatch(struct can_frame *frames, int maxCount, int &errorCode, int64_t *timestamps = NULL) override;
+    bool WaitReadable(int timeoutMs, int &errorCode) override;
+
+    bool SetFilters(const struct can_filter *filters, int count, int &errorCode) override;
+
+    bool EnableFdFrames(int &errorCode) override;
+    bool isFdEnabled() override { return _fdEnabled; }
+    bool SendFdMsg(struct canfd_frame msg, bool extended, bool brs, bool esi, int &errorCode) override;
+    bool GetFdMsg(struct canfd_frame &frame, bool &extended, bool &fd, bool &error, int &errorCode, int64_t *timestamp = NULL) override;
+    bool WaitFdMsg(struct canfd_frame &frame, bool &extended, bool &fd, bool &error, int &errorCode, int timeoutMs, int64_t *timestamp = NULL) override;
+    int RecvFdBatch(struct canfd_frame *frames, bool *fd, int maxCount, int &errorCode, int64_t *timestamps = NULL) override;
+
+    bool EnableTimestamps(bool tx, int &errorCode) override; // the loopback frames are always timestamped
+    int64_t LastTxTimestamp() const override { return _lastTxTimestamp; }
+    int64_t TxTimestamp(canid_t canId) const override;
+
+    void receive(const struct canfd_frame& frame, bool fd, int64_t timestamp); // called by the bus for each frame sent by another endpoint
+
+private:
+    struct Entry{
+        struct canfd_frame frame; // flags still in can_id
+        bool fd;
+        int64_t timestamp;
+    };
+
+    bool send(const struct canfd_frame& frame, bool fd, int &errorCode);
+    bool pop(Entry& entry, int timeoutMs, int &errorCode);
+    bool accepted(canid_t id);
+
+    LoopbackCanBus* _bus;
+    std::atomic<bool> _fdEnabled; // read by the threads delivering on the bus
+    std::atomic<int64_t> _lastTxTimestamp;
+    std::atomic<int64_t> _txTimestampOf[CAN_SFF_MASK + 1]; // by COB-ID, for the standard frames
+
+    std::mutex _mutex; // protects the queue and the filters
+    std::condition_variable _cond;
+    std::deque<Entry> _queue;
+    std::vector<struct can_filter> _filters;
+};
+
+#endif // LOOPBACKCAN_H
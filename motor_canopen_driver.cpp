@@ -1,9 +1,24 @@
 #include "motor_canopen_driver.h"
 
-#include <QTime>
 #include <QDebug>
+#include <QFile>
+
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
 
 #define WATCHDOG_MS 100
+#define HEARTBEAT_PERIOD_MS 100 // heartbeat of the mirrors, a lost drive is detected in 150ms
+#define MOVE_TIMEOUT_MS 10000 // longest move of a mirror
+#define TPDO_STATUS_TIMEOUT_MS 150 // the TPDO1 of a PDO node is sent at least every 100ms (event timer)
+#define MOVE_POLL_MIN_US 200   // first interval between two statusword reads of the axes without PDO
+#define MOVE_POLL_MAX_US 5000  // the interval doubles at each read up to this one
+#define PROFILE_TOLERANCE 0.01 // relative change under which a profile parameter is not written again
 
 #define STATE_NA 0
 #define STATE_NOTREADY 1
@@ -23,10 +38,233 @@
 #define MODE_TORQUE 4
 #define MODE_HOMING 5
 #define MODE_IPOS 7
+#define MODE_CSP 8
+
+#define CSP_RT_PRIORITY 80          // SCHED_FIFO priority of the CSP thread
+#define CSP_DEFAULT_SPEED 200000.0  // counts/s
+#define CSP_POSITION_WINDOW 10      // counts, a CSP move is over once the actual position is this close to the target
+#define IP_BUFFER_MARGIN 2          // free entries kept in the FIFO of the drives, for the error of the fill estimation
+
+Motor_CANOpen_Driver::Motor_CANOpen_Driver(Log_handler* logs, const char* interfaceName){
+    // the transport (SocketCAN or in-process loopback) is chosen from the interface name
+    setup(logs, NULL, interfaceName);
+}
+
+Motor_CANOpen_Driver::Motor_CANOpen_Driver(Log_handler* logs, CanTransport* transport, const char* interfaceName){
+    // the transport is given by the caller and is not deleted by the driver
+    setup(logs, transport, interfaceName);
+}
 
-Motor_CANOpen_Driver::Motor_CANOpen_Driver(Log_handler* logs){
-    _can = new CanWrapper(); // to handle the can socket
+void Motor_CANOpen_Driver::setup(Log_handler* logs, CanTransport* transport, const char* interfaceName){
     _logs = logs;
+    _captureCan = NULL;
+    _captureRx = NULL;
+    _capture = NULL;
+    for(int i=0; i<128; i++){
+        _nodeBus[i] = -1;
+        _pdoEnabled[i] = false;
+        _tpdoHandler[i] = 0;
+        _pdoControlword[i] = 0;
+        _workers[i] = NULL;
+    }
+    memset(_pdoStatus, 0, sizeof(_pdoStatus));
+
+    // objects only written by us: once known, they are never read again from the nodes
+    _odCache.declare(REG_CTRLWORD, 0, OdCache::HOST_OWNED);
+    _odCache.declare(REG_OPMODE, 0, OdCache::HOST_OWNED);
+    _odCache.declare(REG_PVEL_MAXPVEL, 0, OdCache::HOST_OWNED);
+    _odCache.declare(REG_PPOS_PVEL, 0, OdCache::HOST_OWNED);
+    _odCache.declare(REG_PVEL_PACC, 0, OdCache::HOST_OWNED);
+    _odCache.declare(REG_PVEL_PDEC, 0, OdCache::HOST_OWNED);
+    // objects of the drives, known while the TPDO streams them
+    _odCache.declare(REG_STATUSWORD, 0, OdCache::DRIVE_OWNED);
+    _odCache.declare(REG_PPOS_ACPO2, 0, OdCache::DRIVE_OWNED);
+    _nodeMonitor.addListener([this](const NodeEvent& event){ onNodeEvent(event); });
+    _cspRunning = false;
+    _cspPeriodUs = 0;
+    _cspSpeed = CSP_DEFAULT_SPEED;
+    _syncProfiles = true;
+    memset(_profileParameters, 0, sizeof(_profileParameters));
+    memset(_profileKnown, 0, sizeof(_profileKnown));
+    _profilesChanged = false;
+    _cspMissed = 0;
+    _ipRunning = false;
+    _ipPeriodUs = 0;
+    _ipBufferSize = 0;
+    _ipOwnSync = false;
+    _syncRunning = false;
+    resetSdoLatency();
+    resetMoveTelemetry();
+
+    // the first bus holds both mirrors of the default table, addBus or loadAxisConfig can move them to other buses
+    _axes = defaultAxes(interfaceName);
+    addBus(interfaceName, getAxisNodes(), transport);
+}
+
+Motor_CANOpen_Driver::~Motor_CANOpen_Driver(){
+    for(int i=0; i<128; i++){
+        delete _workers[i]; // runs the jobs already posted, while the buses are still there
+        _nodeMonitor.watch(i, 0); // the heartbeats stop being received with the buses, the nodes are not lost
+    }
+    disableCsp();
+    disableIpMode();
+    stopCapture();
+    stopSimulation();
+    for(unsigned int i=0; i<_buses.size(); i++){
+        CanBus* bus = _buses[i];
+        delete bus->bcm; // the kernel removes the cyclic jobs with the socket
+        delete bus->rx;  // stops the reception threads before the socket is closed
+        if(bus->ownCan){
+            bus->can->Close();
+            delete bus->can;
+        }
+        delete bus;
+    }
+}
+
+int Motor_CANOpen_Driver::addBus(const char* interfaceName, const std::vector<unsigned char>& nodes, CanTransport* transport){
+    // each bus has its own socket and reception threads: the buses are serviced in parallel,
+    // and all of them post into the same mailboxes, so the rest of the driver only deals with node ids
+    CanBus* bus = new CanBus();
+    bus->interfaceName = interfaceName;
+    bus->ownCan = (transport == NULL);
+    bus->can = transport ? transport : CanTransport::create(interfaceName); // SocketCAN or in-process loopback, from the name
+    bus->rx = new CanReceiver(bus->can); // background reception, frames are routed by COB-ID to the mailboxes below
+    bus->bcm = NULL;
+
+    // SDO responses (0x580+nodeid) go to the mailbox of their node
+    bus->rx->addHandler(0x580, 0x780, [this](const CanRxFrame& rx){ _sdoBox[rx.frame.can_id & 0x7F].post(rx); });
+    // boot-up/heartbeat frames (0x700+nodeid), for connect() and the state table
+    bus->rx->addHandler(0x700, 0x780, [this, bus](const CanRxFrame& rx){
+        bus->nmtBox.post(rx);
+        if(rx.frame.can_dlc >= 1) _nodeMonitor.onHeartbeat(rx.frame.can_id & 0x7F, rx.frame.data[0] & 0x7F, rx.timestamp);
+    });
+    // emergency frames (0x080+nodeid, 0x080 alone is the SYNC)
+    bus->rx->addHandler(0x080, 0x780, [this](const CanRxFrame& rx){
+        if((rx.frame.can_id & 0x7F) != 0) _nodeMonitor.onEmcy(rx.frame.can_id & 0x7F, rx.frame.data, rx.frame.can_dlc);
+    });
+
+    int index = _buses.size();
+    _buses.push_back(bus);
+    for(unsigned int i=0; i<nodes.size(); i++){
+        assignNode(index, nodes[i]);
+    }
+    return index;
+}
+
+void Motor_CANOpen_Driver::assignNode(int busIndex, unsigned char nodeid){
+    // function to move a node to a bus, from the bus it was on if any
+    nodeid &= 0x7F;
+    if(_nodeBus[nodeid] >= 0){
+        std::vector<unsigned char>& previous = _buses[_nodeBus[nodeid]]->nodes;
+        previous.erase(std::remove(previous.begin(), previous.end(), nodeid), previous.end());
+    }
+    _nodeBus[nodeid] = busIndex;
+    _buses[busIndex]->nodes.push_back(nodeid);
+}
+
+bool Motor_CANOpen_Driver::loadAxisConfig(const char* path){
+    // function to read the axis table of the machine, the default one is kept if there is no file
+    if(!QFile::exists(path)){
+        _logs->addLog(QString("No ") + path + ", using the default axes");
+        return true;
+    }
+    std::vector<AxisConfig> axes;
+    QString error;
+    if(!loadAxes(path, _buses[0]->interfaceName.c_str(), axes, error)){
+        _logs->addLog(error, LOG_ERR);
+        return false;
+    }
+    setAxes(axes);
+    _logs->addLog(QString::number(axes.size()) + " axes loaded from " + path);
+    return true;
+}
+
+void Motor_CANOpen_Driver::setAxes(const std::vector<AxisConfig>& axes){
+    // the nodes of the previous table are removed from their bus, then each node goes to the bus of its axis
+    // (a bus is added for each interface not opened yet)
+    for(unsigned int i=0; i<_axes.size(); i++){
+        unsigned char nodeid = _axes[i].nodeid & 0x7F;
+        if(_nodeBus[nodeid] < 0) continue;
+        std::vector<unsigned char>& previous = _buses[_nodeBus[nodeid]]->nodes;
+        previous.erase(std::remove(previous.begin(), previous.end(), nodeid), previous.end());
+        _nodeBus[nodeid] = -1;
+    }
+    _axes = axes;
+    _profileLimits.clear(); // read again by configureMirrors
+    for(unsigned int i=0; i<_axes.size(); i++){
+        int index = -1;
+        for(unsigned int j=0; j<_buses.size(); j++){
+            if(_buses[j]->interfaceName == _axes[i].bus) index = j;
+        }
+        if(index < 0) index = addBus(_axes[i].bus.c_str(), std::vector<unsigned char>());
+        assignNode(index, _axes[i].nodeid);
+    }
+}
+
+bool Motor_CANOpen_Driver::startSimulation(const VirtualDriveConfig& config, const std::string& bus){
+    // one simulated drive per axis, on the bus of the axis: the driver talks to them as to real drives
+    stopSimulation();
+    if(!bus.empty()){
+        std::vector<AxisConfig> axes = _axes;
+        for(unsigned int i=0; i<axes.size(); i++){
+            axes[i].bus = bus;
+        }
+        setAxes(axes);
+    }
+    for(unsigned int i=0; i<_axes.size(); i++){
+        const std::string& name = _axes[i].bus;
+        if(name.compare(0, 4, "vcan") != 0 && name.compare(0, 4, "loop") != 0){
+            _logs->addLog(QString("No simulated drive on ") + name.c_str() + ", only on a vcan or loopback bus", LOG_ERR);
+            stopSimulation();
+            return false;
+        }
+        VirtualDrive* drive = new VirtualDrive(_axes[i].nodeid, config);
+        int errorCode;
+        if(!drive->start(name.c_str(), errorCode)){
+            _logs->addLog(QString("Failed to start the simulated drive of ") + _axes[i].name + " (error " + QString::number(errorCode) + ")", LOG_ERR);
+            delete drive;
+            stopSimulation();
+            return false;
+        }
+        _simulation.push_back(drive);
+        _logs->addLog(_axes[i].name + " simulated on " + name.c_str(), LOG_WARN);
+    }
+    return true;
+}
+
+void Motor_CANOpen_Driver::stopSimulation(){
+    for(unsigned int i=0; i<_simulation.size(); i++){
+        delete _simulation[i];
+    }
+    _simulation.clear();
+}
+
+VirtualDrive* Motor_CANOpen_Driver::getSimulatedDrive(uint32_t nodeid){
+    for(unsigned int i=0; i<_simulation.size(); i++){
+        if(_simulation[i]->getNodeId() == (nodeid & 0x7F)) return _simulation[i];
+    }
+    return NULL;
+}
+
+std::vector<unsigned char> Motor_CANOpen_Driver::getAxisNodes() const {
+    std::vector<unsigned char> nodes;
+    for(unsigned int i=0; i<_axes.size(); i++){
+        nodes.push_back(_axes[i].nodeid);
+    }
+    return nodes;
+}
+
+int Motor_CANOpen_Driver::getAxisOfNode(uint32_t nodeid) const {
+    for(unsigned int i=0; i<_axes.size(); i++){
+        if(_axes[i].nodeid == nodeid) return i;
+    }
+    return -1;
+}
+
+int Motor_CANOpen_Driver::getBusOfNode(uint32_t nodeid) const {
+    int index = _nodeBus[nodeid & 0x7F];
+    return index < 0 ? 0 : index;
 }
 
 QString Motor_CANOpen_Driver::canFrame2QString(const struct can_frame& canframe){
@@ -41,73 +279,1298 @@ QString Motor_CANOpen_Driver::canFrame2QString(const struct can_frame& canframe)
     return retval;
 }
 
+void Motor_CANOpen_Driver::flush(uint32_t nodeid, bool verbose, const char* caller){
+    // function to drop every SDO response of nodeid received while nobody was waiting for it
+    // verbose: to add (true) or not (false) the dropped frames to the logs
+    // caller: name of the calling function, for the log message
+    std::vector<CanRxFrame> frames;
+    _sdoBox[nodeid & 0x7F].drain(frames);
+    if(verbose){
+        for(unsigned int i=0; i<frames.size(); i++){
+            _logs->addLog(QString("Unexpected CAN frame - ") + caller, LOG_WARN);
+            _logs->addLog(canFrame2QString(frames[i].frame), LOG_CAN);
+        }
+    }
+}
+
+bool Motor_CANOpen_Driver::startCapture(const char* path, uint64_t maxFrames){
+    // function to record the traffic of the first bus into a binary capture file (see CanCapture)
+    // path: the capture file
+    // maxFrames: the capture is preallocated for maxFrames frames, the next ones are dropped
+    stopCapture();
+
+    int errorCode;
+    _capture = new CanCapture();
+    if(!_capture->create(path, maxFrames, errorCode)){
+        _logs->addLog(QString("Failed to create the capture file ") + path + " (error " + QString::number(errorCode) + ")", LOG_ERR);
+        delete _capture;
+        _capture = NULL;
+        return false;
+    }
+
+    // a socket of its own, so that the frames we send are captured too
+    const char* interfaceName = _buses[0]->interfaceName.c_str();
+    _captureCan = CanTransport::create(interfaceName);
+    if(!_captureCan->Init(interfaceName, errorCode)){
+        _logs->addLog("Failed to open the capture socket", LOG_ERR);
+        stopCapture();
+        return false;
+    }
+    _captureCan->EnableFdFrames(errorCode);
+    _captureCan->EnableTimestamps(false, errorCode);
+    _captureRx = new CanReceiver(_captureCan);
+    _captureRx->setCapture(_capture);
+    if(!_captureRx->start()){
+        _logs->addLog("Failed to start the capture thread", LOG_ERR);
+        stopCapture();
+        return false;
+    }
+    _logs->addLog(QString("Capturing the CAN traffic into ") + path);
+    return true;
+}
+
+void Motor_CANOpen_Driver::stopCapture(){
+    // function to stop the capture started by startCapture, the file is flushed and closed
+    if(_captureRx){
+        delete _captureRx; // stops the thread appending to the capture
+        _captureRx = NULL;
+    }
+    if(_captureCan){
+        _captureCan->Close();
+        delete _captureCan;
+        _captureCan = NULL;
+    }
+    if(_capture){
+        _logs->addLog(QString::number(_capture->size()) + " frames captured, " + QString::number(_capture->getDropped()) + " dropped");
+        delete _capture;
+        _capture = NULL;
+    }
+}
+
+bool Motor_CANOpen_Driver::startSync(uint32_t periodUs){
+    // function to send the SYNC object (COB-ID 0x080) every periodUs on every bus
+    // the frames are sent by the broadcast manager of the kernel, the period does not depend on our threads being scheduled
+    // calling it again changes the period
+    int errorCode;
+    for(unsigned int i=0; i<_buses.size(); i++){
+        CanBus* bus = _buses[i];
+        if(bus->interfaceName.compare(0, 4, "loop") == 0){
+            _logs->addLog("SYNC generation needs a SocketCAN interface (broadcast manager)", LOG_ERR);
+            return false;
+        }
+
+        if(bus->bcm == NULL) bus->bcm = new CanBcm();
+        if(!bus->bcm->Init(bus->interfaceName.c_str(), errorCode)){
+            _logs->addLog("Failed to open the broadcast manager socket (error " + QString::number(errorCode) + ")", LOG_ERR);
+            return false;
+        }
+
+        struct can_frame sync;
+        memset(&sync, 0, sizeof(sync));
+        sync.can_id = 0x080;
+        sync.can_dlc = 0;
+        if(!bus->bcm->AddCyclicTx(0x080, &sync, 1, periodUs, errorCode)){
+            _logs->addLog("Failed to start the SYNC generation (error " + QString::number(errorCode) + ")", LOG_ERR);
+            return false;
+        }
+        _logs->addLog(QString("SYNC every ") + QString::number(periodUs) + "us on " + bus->interfaceName.c_str());
+        _syncRunning = true;
+    }
+    return true;
+}
+
+void Motor_CANOpen_Driver::stopSync(){
+    // function to stop the SYNC started by startSync
+    int errorCode;
+    for(unsigned int i=0; i<_buses.size(); i++){
+        if(_buses[i]->bcm && _buses[i]->bcm->isInitialized()){
+            _buses[i]->bcm->RemoveCyclicTx(0x080, errorCode);
+        }
+    }
+    _syncRunning = false;
+}
+
+static int64_t nowNs(){
+    // same clock as the kernel timestamps of the CAN frames
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+}
+
+void Motor_CANOpen_Driver::recordSdoLatency(uint32_t nodeid, int64_t sent, int64_t received){
+    // function to add an SDO round trip to the statistics of nodeid
+    // sent: time at which the request was sent, replaced by the kernel tx timestamp of the request when it is known
+    // (by COB-ID: the other nodes send their SDO requests at the same time, the last frame of the bus may be one of them)
+    // received: kernel timestamp of the response
+    int64_t tx = canOf(nodeid)->TxTimestamp(0x600 + (nodeid & 0x7F));
+    if(tx >= sent && tx <= received) sent = tx;
+    int64_t rtt = received - sent;
+    if(rtt < 0) return;
+
+    std::lock_guard<std::mutex> lock(_latencyMutex);
+    SdoLatencyStats& stats = _sdoLatency[nodeid & 0x7F];
+    if(stats.count == 0 || rtt < stats.minNs) stats.minNs = rtt;
+    if(rtt > stats.maxNs) stats.maxNs = rtt;
+    stats.sumNs += rtt;
+    stats.count++;
+
+    int bucket = 0;
+    int64_t limit = 32000; // upper bound of bucket 0, in ns
+    while(rtt >= limit && bucket < SDO_LATENCY_BUCKETS-1){
+        limit *= 2;
+        bucket++;
+    }
+    stats.histogram[bucket]++;
+}
+
+SdoLatencyStats Motor_CANOpen_Driver::getSdoLatency(uint32_t nodeid){
+    std::lock_guard<std::mutex> lock(_latencyMutex);
+    return _sdoLatency[nodeid & 0x7F];
+}
+
+void Motor_CANOpen_Driver::resetSdoLatency(){
+    std::lock_guard<std::mutex> lock(_latencyMutex);
+    memset(_sdoLatency, 0, sizeof(_sdoLatency));
+}
+
+QString Motor_CANOpen_Driver::sdoLatency2QString(uint32_t nodeid){
+    // function that convert the SDO round trip statistics of a node to a QString for display purpose
+    SdoLatencyStats stats = getSdoLatency(nodeid);
+    if(stats.count == 0) return "no SDO round trip measured";
+
+    QString retval;
+    retval += QString::number(stats.count) + " SDO, min " + QString::number(stats.minNs/1000) + "us";
+    retval += ", mean " + QString::number(stats.sumNs/(int64_t)stats.count/1000) + "us";
+    retval += ", max " + QString::number(stats.maxNs/1000) + "us";
+    return retval;
+}
+
+SdoTransfer SdoTransfer::makeRead(uint32_t nodeid, uint16_t regadd, void* regval, size_t size, unsigned char subindex){
+    SdoTransfer t;
+    memset(&t, 0, sizeof(t));
+    t.nodeid = nodeid;
+    t.regadd = regadd;
+    t.subindex = subindex;
+    t.write = false;
+    t.regval = regval;
+    t.size = size;
+    return t;
+}
+
+SdoTransfer SdoTransfer::makeWrite(uint32_t nodeid, uint16_t regadd, const void* regval, size_t size, unsigned char subindex){
+    SdoTransfer t;
+    memset(&t, 0, sizeof(t));
+    t.nodeid = nodeid;
+    t.regadd = regadd;
+    t.subindex = subindex;
+    t.write = true;
+    t.size = size > 4 ? 4 : size;
+    memcpy(t.value, regval, t.size);
+    return t;
+}
+
+bool Motor_CANOpen_Driver::sdoSend(SdoTransfer& transfer, bool verbose){
+    // function to send the request of an SDO transfer, the response is waited by sdoWait
+    const char* caller = transfer.write ? "setRegister" : "getRegister";
+    int errorCode = 0;
+    transfer.done = false;
+
+    // we flush the CAN buffer just in case
+    flush(transfer.nodeid, verbose, caller);
+
+    // initialization of the request
+    struct can_frame msg_scan;
+    msg_scan.can_id  = 0x600+transfer.nodeid;
+    msg_scan.can_dlc = 8;
+    if(transfer.write){
+        // the first byte change depending of the size to write
+        msg_scan.data[0] = 0x2 << 4;
+        msg_scan.data[0] += 0x3;
+        msg_scan.data[0] += (4-transfer.size) << 2;
+    }else{
+        msg_scan.data[0] = 0x40;
+    }
+
+    // setting the register address
+    msg_scan.data[1] = transfer.regadd;
+    msg_scan.data[2] = (transfer.regadd >> 8);
+
+    // subindex
+    msg_scan.data[3] = transfer.subindex;
+
+    //setting the register value
+    memset(&msg_scan.data[4], 0, 4);
+    if(transfer.write){
+        memcpy(&msg_scan.data[4], transfer.value, transfer.size);
+    }
+
+    // sending the request
+    transfer.sent = nowNs();
+    if(!canOf(transfer.nodeid)->SendMsg(msg_scan, 0, 0, errorCode)){
+        if(verbose) _logs->addLog(QString("Failed to send the request - ") + caller, LOG_ERR);
+        return false;
+    }
+    if(verbose) _logs->addLog(canFrame2QString(msg_scan), LOG_CAN);
+    return true;
+}
+
+bool Motor_CANOpen_Driver::sdoWait(SdoTransfer& transfer, bool verbose){
+    // function to wait for the response of an SDO transfer sent by sdoSend
+    const char* caller = transfer.write ? "setRegister" : "getRegister";
+
+    // the response is routed to the node mailbox by the receiver thread
+    CanRxFrame rsp;
+    if(!_sdoBox[transfer.nodeid & 0x7F].wait(rsp, WATCHDOG_MS)){ // if we did not received a can message before the watchog timed out
+        if(verbose) _logs->addLog(QString("Can response not received - ") + caller, LOG_ERR);
+        return false;
+    }
+    struct can_frame msg_rcvd = rsp.frame;
+    recordSdoLatency(transfer.nodeid, transfer.sent, rsp.timestamp);
+    if(verbose) _logs->addLog(canFrame2QString(msg_rcvd), LOG_CAN);
+
+    if(msg_rcvd.can_id != (transfer.nodeid + 0x580)){ // the response is tested
+        if(verbose) _logs->addLog(QString("Unexpected response - ") + caller, LOG_ERR);
+        return false;
+    }
+
+    // we test if it is an abort frame, the reason is in the 4 data bytes
+    if(msg_rcvd.data[0] == 0x80){
+        uint32_t abortCode = msg_rcvd.data[4] | (msg_rcvd.data[5] << 8) | (msg_rcvd.data[6] << 16) | ((uint32_t)msg_rcvd.data[7] << 24);
+        if(verbose) _logs->addLog(QString("SDO abort ") + sdoAbort2QString(abortCode) + " - " + caller, LOG_ERR);
+        return false;
+    }
+
+    // the response should be about the requested object
+    if(msg_rcvd.data[1] != (transfer.regadd & 0xFF) || msg_rcvd.data[2] != (transfer.regadd >> 8) || msg_rcvd.data[3] != transfer.subindex){
+        if(verbose) _logs->addLog(QString("Response to another object - ") + caller, LOG_ERR);
+        return false;
+    }
+
+    if(transfer.write){
+        // download initiate response
+        if(msg_rcvd.data[0] != 0x60){
+            if(verbose) _logs->addLog(QString("Unexpected command specifier - ") + caller, LOG_ERR);
+            return false;
+        }
+    }else{
+        // upload initiate response, the value should be in the frame (expedited transfer)
+        if((msg_rcvd.data[0] & 0xE0) != 0x40){
+            if(verbose) _logs->addLog(QString("Unexpected command specifier - ") + caller, LOG_ERR);
+            return false;
+        }
+        if(!(msg_rcvd.data[0] & 0x02)){
+            // the object is larger than 4 bytes, the server waits for segment requests: readObject should be used
+            sdoAbort(transfer.nodeid, transfer.regadd, transfer.subindex, SDO_ABORT_GENERAL);
+            if(verbose) _logs->addLog(QString("Segmented response, the object is larger than 4 bytes - ") + caller, LOG_ERR);
+            return false;
+        }
+        // save the gotten value in the regval address variable
+        // when the size is indicated, only the bytes containing data are copied, the remaining ones are set to 0
+        size_t n = (msg_rcvd.data[0] & 0x01) ? 4 - ((msg_rcvd.data[0] >> 2) & 0x03) : 4;
+        if(n > transfer.size) n = transfer.size;
+        memset(transfer.regval, 0, transfer.size);
+        memcpy(transfer.regval, &msg_rcvd.data[4], n);
+    }
+    _odCache.update(transfer.nodeid, transfer.regadd, transfer.subindex, transfer.write ? transfer.value : transfer.regval, transfer.size);
+    if(transfer.regadd == REG_CTRLWORD && transfer.subindex == 0){
+        // the RPDO set points keep the state bits the node has been given over SDO (enable operation...)
+        uint16_t controlword = 0;
+        memcpy(&controlword, transfer.write ? transfer.value : transfer.regval, std::min(transfer.size, sizeof(controlword)));
+        _pdoControlword[transfer.nodeid & 0x7F] = controlword;
+    }
+    transfer.done = true;
+    return true;
+}
+
+bool Motor_CANOpen_Driver::sdoFromCache(SdoTransfer& transfer){
+    // function to answer a read from the shadow copy of the object, without any frame
+    if(transfer.write) return false;
+    if(!_odCache.get(transfer.nodeid, transfer.regadd, transfer.subindex, transfer.regval, transfer.size)) return false;
+    transfer.done = true;
+    return true;
+}
+
 bool Motor_CANOpen_Driver::readRegister (uint16_t regadd, uint32_t nodeid, void* regval, size_t size, unsigned char subindex, bool verbose){
     //function to read a register of a controller
     // regadd : the register address
     // nodeid: the id of the controller node
     // regval: the value of the read register
-    // size: the size of the register value
+    // size: the size of the register value (above 4 bytes, the register is read with a segmented transfer)
     // subindex: the subindex we want to read (default value = 0)
     // verbose: to add (true) or not (false) log messages (default value = true)
+    std::lock_guard<std::recursive_mutex> lock(_sdoLock[nodeid & 0x7F]);
+    if(size > 4){
+        std::vector<uint8_t> data;
+        if(!readObject(nodeid, regadd, subindex, data, false, verbose)) return false;
+        memset(regval, 0, size);
+        memcpy(regval, data.data(), std::min(size, data.size()));
+        return true;
+    }
+    SdoTransfer transfer = SdoTransfer::makeRead(nodeid, regadd, regval, size, subindex);
+    if(sdoFromCache(transfer)) return true;
+    return sdoSend(transfer, verbose) && sdoWait(transfer, verbose);
+}
 
-    // we flush the CAN buffer just in case
-    struct can_frame msg_rcvd;
-    int errorCode = 0;
-    bool extended, rtr, error;
-    while(_can->GetMsg(msg_rcvd, extended, rtr, error, errorCode)){
-        if(verbose) _logs->addLog("Unexpected CAN frame - getRegister", LOG_WARN);
-        if(verbose) _logs->addLog(canFrame2QString(msg_rcvd), LOG_CAN);
+bool Motor_CANOpen_Driver::setRegister (uint16_t regadd, uint32_t nodeid, const void* regval, size_t size, unsigned char subindex, bool verbose){
+    // function to set the value of a register in the controller
+    // regadd: the register address
+    // nodeid: the id of the controller
+    // regval: the value we want to write
+    // size: the size of the value (byte number, above 4 bytes the register is written with a segmented transfer)
+    // subindex: the subindex we want to write (default value: 0)
+    // verbose: to add (true) or not (false) the messages to the listwidget log (fault value:true)
+    std::lock_guard<std::recursive_mutex> lock(_sdoLock[nodeid & 0x7F]);
+    if(size > 4) return writeObject(nodeid, regadd, subindex, regval, size, false, verbose);
+    SdoTransfer transfer = SdoTransfer::makeWrite(nodeid, regadd, regval, size, subindex);
+    return sdoSend(transfer, verbose) && sdoWait(transfer, verbose);
+}
+
+bool Motor_CANOpen_Driver::readObject(uint32_t nodeid, uint16_t index, unsigned char subindex, std::vector<uint8_t>& data, bool block, bool verbose){
+    // function to read an object of any size (strings, tables, files...) with an SDO upload
+    // block: to use the block transfer (large objects, checked with a CRC) instead of the segmented one
+    // the server decides whether a small object is sent expedited
+    std::lock_guard<std::recursive_mutex> lock(_sdoLock[nodeid & 0x7F]);
+    flush(nodeid, verbose, "readObject");
+    SdoClient client(canOf(nodeid), &_sdoBox[nodeid & 0x7F], nodeid, WATCHDOG_MS);
+    bool ok = block ? client.blockUpload(index, subindex, data) : client.upload(index, subindex, data);
+    if(!ok){
+        logSdoFailure(client, "readObject", verbose);
+        return false;
     }
+    if(verbose) _logs->addLog(QString("Object ") + QString::number(index, 16) + "sub" + QString::number(subindex) + " of node " + QString::number(nodeid) + ": "
+                              + QString::number(data.size()) + " bytes read in " + QString::number(client.getFrameCount()) + " frames");
+    if(data.size() <= 4) _odCache.update(nodeid, index, subindex, data.data(), data.size());
+    return true;
+}
 
-    // initialization of the request
-    struct can_frame msg_scan;
-    msg_scan.can_id  = 0x600+nodeid;
-    msg_scan.can_dlc = 8;
-    msg_scan.data[0] = 0x40;
-    msg_scan.data[1] = regadd;
-    msg_scan.data[2] = (regadd >> 8);
-    msg_scan.data[3] = subindex;
-    msg_scan.data[4] = 0x00;
-    msg_scan.data[5] = 0x00;
-    msg_scan.data[6] = 0x00;
-    msg_scan.data[7] = 0x00;
+bool Motor_CANOpen_Driver::writeObject(uint32_t nodeid, uint16_t index, unsigned char subindex, const void* data, size_t size, bool block, bool verbose){
+    // function to write an object of any size with an SDO download (expedited up to 4 bytes, segmented above)
+    // block: to use the block transfer (large objects, checked with a CRC) instead of the segmented one
+    std::lock_guard<std::recursive_mutex> lock(_sdoLock[nodeid & 0x7F]);
+    flush(nodeid, verbose, "writeObject");
+    SdoClient client(canOf(nodeid), &_sdoBox[nodeid & 0x7F], nodeid, WATCHDOG_MS);
+    bool ok = block ? client.blockDownload(index, subindex, data, size) : client.download(index, subindex, data, size);
+    if(!ok){
+        logSdoFailure(client, "writeObject", verbose);
+        return false;
+    }
+    if(verbose) _logs->addLog(QString("Object ") + QString::number(index, 16) + "sub" + QString::number(subindex) + " of node " + QString::number(nodeid) + ": "
+                              + QString::number(size) + " bytes written in " + QString::number(client.getFrameCount()) + " frames");
+    if(size <= 4) _odCache.update(nodeid, index, subindex, data, size);
+    else _odCache.invalidate(nodeid, index, subindex);
+    return true;
+}
 
-    // sending the request
-    if(!_can->SendMsg(msg_scan, 0, 0, errorCode)){
-        if(verbose) _logs->addLog("Failed to send the request - getRegister", LOG_ERR);
+void Motor_CANOpen_Driver::logSdoFailure(const SdoClient& client, const char* caller, bool verbose){
+    // function to log why a transfer of an SdoClient failed
+    if(!verbose) return;
+    if(client.getAbortCode() == 0){
+        _logs->addLog(QString("Failed to send the request (error ") + QString::number(client.getErrorCode()) + ") - " + caller, LOG_ERR);
+    }else if(client.isAbortedByServer()){
+        _logs->addLog(QString("SDO abort ") + sdoAbort2QString(client.getAbortCode()) + " - " + caller, LOG_ERR);
+    }else{
+        _logs->addLog(QString("Transfer aborted ") + sdoAbort2QString(client.getAbortCode()) + " - " + caller, LOG_ERR);
+    }
+}
+
+void Motor_CANOpen_Driver::sdoAbort(uint32_t nodeid, uint16_t regadd, unsigned char subindex, uint32_t abortCode){
+    // function to end the SDO transaction in progress with a node
+    int errorCode;
+    struct can_frame msg;
+    msg.can_id  = 0x600+nodeid;
+    msg.can_dlc = 8;
+    msg.data[0] = 0x80;
+    msg.data[1] = regadd;
+    msg.data[2] = (regadd >> 8);
+    msg.data[3] = subindex;
+    msg.data[4] = abortCode;
+    msg.data[5] = abortCode >> 8;
+    msg.data[6] = abortCode >> 16;
+    msg.data[7] = abortCode >> 24;
+    canOf(nodeid)->SendMsg(msg, 0, 0, errorCode);
+}
+
+QString Motor_CANOpen_Driver::sdoAbort2QString(uint32_t abortCode){
+    // function that convert an SDO abort code to a QString for display purpose
+    return QString("0x") + QString::number(abortCode, 16).rightJustified(8, '0') + " (" + SdoClient::abortDescription(abortCode) + ")";
+}
+
+IoWorker* Motor_CANOpen_Driver::workerOf(uint32_t nodeid){
+    // function to get the I/O thread of a node, created at the first asynchronous call
+    std::lock_guard<std::mutex> lock(_workerMutex);
+    IoWorker*& worker = _workers[nodeid & 0x7F];
+    if(worker == NULL) worker = new IoWorker();
+    return worker;
+}
+
+std::future<bool> Motor_CANOpen_Driver::runAsync(uint32_t nodeid, std::function<bool()> job, DriverCallback callback){
+    // the promise is shared: std::function needs a copyable job
+    std::shared_ptr<std::promise<bool> > promise = std::make_shared<std::promise<bool> >();
+    std::future<bool> result = promise->get_future();
+    workerOf(nodeid)->post([job, callback, promise]{
+        bool ok = job();
+        if(callback) callback(ok);
+        promise->set_value(ok);
+    });
+    return result;
+}
+
+std::future<bool> Motor_CANOpen_Driver::readRegisterAsync(uint16_t regadd, uint32_t nodeid, void* regval, size_t size, unsigned char subindex, DriverCallback callback){
+    return runAsync(nodeid, [=]{ return readRegister(regadd, nodeid, regval, size, subindex); }, callback);
+}
+
+std::future<bool> Motor_CANOpen_Driver::setRegisterAsync(uint16_t regadd, uint32_t nodeid, const void* regval, size_t size, unsigned char subindex, DriverCallback callback){
+    std::vector<uint8_t> value((const uint8_t*)regval, (const uint8_t*)regval + size);
+    return runAsync(nodeid, [=]{ return setRegister(regadd, nodeid, value.data(), value.size(), subindex); }, callback);
+}
+
+std::future<bool> Motor_CANOpen_Driver::setPositionAsync(uint32_t nodeid, int32_t tpos, uint16_t controlword, DriverCallback callback){
+    return runAsync(nodeid, [=]{ return setPosition(nodeid, tpos, controlword); }, callback);
+}
+
+std::future<bool> Motor_CANOpen_Driver::configureNodeAsync(unsigned char nodeid, DriverCallback callback){
+    return runAsync(nodeid, [=]{ return configureNode(nodeid); }, callback);
+}
+
+void Motor_CANOpen_Driver::waitAsyncIdle(){
+    for(int i=0; i<128; i++){
+        IoWorker* worker;
+        {
+            std::lock_guard<std::mutex> lock(_workerMutex);
+            worker = _workers[i];
+        }
+        if(worker) worker->waitIdle();
+    }
+}
+
+bool Motor_CANOpen_Driver::sdoTransfers(std::vector<SdoTransfer>& transfers, bool verbose){
+    // CANopen allows one SDO transaction in progress per node: each node gets its next request as soon as
+    // the previous one is answered, while the other nodes are answering theirs
+    // the reads answered by the shadow copy are done without waiting for anything
+    std::vector<int> pending; // index in transfers of the request in progress of each node
+    std::vector<bool> started(transfers.size(), false);
+
+    // the nodes are locked in increasing id order, so two threads locking several nodes can not deadlock
+    std::vector<uint32_t> nodes;
+    for(unsigned int i=0; i<transfers.size(); i++){
+        nodes.push_back(transfers[i].nodeid & 0x7F);
+    }
+    std::sort(nodes.begin(), nodes.end());
+    nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+    std::vector<std::unique_lock<std::recursive_mutex> > locks;
+    for(unsigned int i=0; i<nodes.size(); i++){
+        locks.push_back(std::unique_lock<std::recursive_mutex>(_sdoLock[nodes[i]]));
+    }
+
+    for(unsigned int i=0; i<transfers.size(); i++){
+        transfers[i].done = false;
+    }
+
+    // function to send the next transfer of the node of transfers[from], return its index or -1 if the node is finished
+    auto startNext = [&](unsigned int from) -> int {
+        uint32_t nodeid = transfers[from].nodeid;
+        for(unsigned int i=from; i<transfers.size(); i++){
+            if(started[i] || transfers[i].nodeid != nodeid) continue;
+            started[i] = true;
+            if(sdoFromCache(transfers[i])) continue;
+            if(!sdoSend(transfers[i], verbose)) return -1; // the node failed, its remaining transfers are cancelled
+            return i;
+        }
+        return -1;
+    };
+
+    // first request of each node
+    for(unsigned int i=0; i<transfers.size(); i++){
+        if(started[i]) continue;
+        bool nodeSeen = false;
+        for(unsigned int j=0; j<i; j++){
+            if(transfers[j].nodeid == transfers[i].nodeid) nodeSeen = true;
+        }
+        if(nodeSeen) continue;
+        int next = startNext(i);
+        if(next >= 0) pending.push_back(next);
+    }
+
+    while(!pending.empty()){
+        std::vector<int> next;
+        for(unsigned int j=0; j<pending.size(); j++){
+            if(!sdoWait(transfers[pending[j]], verbose)) continue; // the node failed, its remaining transfers are cancelled
+            int n = startNext(pending[j]);
+            if(n >= 0) next.push_back(n);
+        }
+        pending.swap(next);
+    }
+
+    bool ok = true;
+    for(unsigned int i=0; i<transfers.size(); i++){
+        ok = ok && transfers[i].done;
+    }
+    return ok;
+}
+
+bool Motor_CANOpen_Driver::configureHeartbeat(const std::vector<unsigned char>& nodes, uint16_t periodMs){
+    // function to set the producer heartbeat time of the nodes and watch their heartbeat
+    std::vector<SdoTransfer> transfers;
+    for(unsigned int i=0; i<nodes.size(); i++){
+        transfers.push_back(SdoTransfer::makeWrite(nodes[i], REG_HEARTBEAT, &periodMs, sizeof(periodMs)));
+    }
+    bool ok = sdoTransfers(transfers);
+    for(unsigned int i=0; i<nodes.size(); i++){
+        if(!transfers[i].done){
+            _logs->addLog("Failed to set the heartbeat of node " + QString::number(nodes[i]), LOG_ERR);
+            continue;
+        }
+        // late by half a period: lost (the heartbeats are not sent with a perfect period)
+        _nodeMonitor.watch(nodes[i], periodMs + periodMs / 2);
+    }
+    if(ok && periodMs > 0) _logs->addLog("Heartbeat every " + QString::number(periodMs) + "ms");
+    return ok;
+}
+
+void Motor_CANOpen_Driver::onNodeEvent(const NodeEvent& event){
+    // function called by the node monitor (reception or monitor thread) when the state of a node changes
+    QString node = "Node " + QString::number(event.nodeid);
+    switch(event.type){
+    case NODE_BOOTUP:
+        _odCache.invalidateNode(event.nodeid); // the node restarted with its default values
+        _logs->addLog(node + " booted up");
+        break;
+    case NODE_STATE_CHANGED:
+        _logs->addLog(node + ": " + NodeMonitor::nmtState2String(event.status.nmtState));
+        break;
+    case NODE_LOST:
+        _odCache.invalidateDriveOwned(event.nodeid);
+        _logs->addLog(node + " lost: no heartbeat", LOG_ERR);
+        break;
+    case NODE_FOUND:
+        _logs->addLog(node + " heartbeat received again", LOG_WARN);
+        break;
+    case NODE_EMCY:
+        _logs->addLog(node + " emergency 0x" + QString::number(event.status.emcyCode, 16) + " (" + NodeMonitor::emcyCode2String(event.status.emcyCode)
+                      + "), error register 0x" + QString::number(event.status.errorRegister, 16), LOG_ERR);
+        break;
+    case NODE_ERROR_RESET:
+        _logs->addLog(node + ": errors reset");
+        break;
+    }
+}
+
+QString Motor_CANOpen_Driver::nodeStatus2QString(uint32_t nodeid){
+    // function that convert the live state of a node to a QString for display purpose
+    NodeStatus status = getNodeStatus(nodeid);
+    QString retval = NodeMonitor::nmtState2String(status.nmtState);
+    if(status.watched) retval += status.alive ? ", alive" : ", lost";
+    if(status.emcyCode != 0){
+        retval += ", error 0x" + QString::number(status.emcyCode, 16) + " (" + NodeMonitor::emcyCode2String(status.emcyCode) + ")";
+    }
+    return retval;
+}
+
+bool Motor_CANOpen_Driver::sendNmt(uint8_t command, uint8_t nodeid){
+    // function to send an NMT command (NMT_START, NMT_PREOPERATIONAL...)
+    // nodeid: the node, 0 for every node (the command is then sent on every bus)
+    int errorCode;
+    struct can_frame msg;
+    msg.can_id  = 0x000;
+    msg.can_dlc = 2;
+    msg.data[0] = command;
+    msg.data[1] = nodeid;
+
+    for(unsigned int i=0; i<_buses.size(); i++){
+        if(nodeid != 0 && (int)i != getBusOfNode(nodeid)) continue;
+        if(nodeid == 0 && !_buses[i]->can->isInitialized()) continue; // bus without node, not opened
+        if(!_buses[i]->can->SendMsg(msg, 0, 0, errorCode)){
+            _logs->addLog("Failed to send the NMT command", LOG_ERR);
+            return false;
+        }
+        _logs->addLog(canFrame2QString(msg), LOG_CAN);
+    }
+
+    if(command == NMT_RESET_NODE || command == NMT_RESET_COMM){
+        _odCache.invalidateNode(nodeid); // back to the default values
+        // the heartbeat time is reset too, the nodes have to be configured again before we watch them
+        for(int i=1; i<128; i++){
+            if(nodeid == 0 || nodeid == i) _nodeMonitor.watch(i, 0);
+        }
+    }else if(command != NMT_START){
+        _odCache.invalidateDriveOwned(nodeid); // the PDO are not sent anymore
+    }
+    return true;
+}
+
+void Motor_CANOpen_Driver::addPdoConfig(std::vector<SdoTransfer>& transfers, uint8_t nodeid, uint16_t commIndex, uint16_t mapIndex, uint32_t cobid,
+                                        const std::vector<uint32_t>& mapping, uint8_t transmissionType, bool tpdo, uint16_t inhibitTime, uint16_t eventTimer){
+    // function to add the transfers configuring a PDO to a list for sdoTransfers (sequence of CiA 301)
+    // commIndex, mapIndex: the communication and mapping parameters of the PDO (0x14xx/0x16xx or 0x18xx/0x1Axx)
+
+    // the PDO is disabled (bit 31 of its COB-ID) while it is changed
+    uint32_t disabled = cobid | 0x80000000;
+    transfers.push_back(SdoTransfer::makeWrite(nodeid, commIndex, &disabled, sizeof(disabled), 1));
+    transfers.push_back(SdoTransfer::makeWrite(nodeid, commIndex, &transmissionType, sizeof(transmissionType), 2));
+    if(tpdo){
+        transfers.push_back(SdoTransfer::makeWrite(nodeid, commIndex, &inhibitTime, sizeof(inhibitTime), 3));
+        transfers.push_back(SdoTransfer::makeWrite(nodeid, commIndex, &eventTimer, sizeof(eventTimer), 5));
+    }
+
+    // the number of mapped objects is set to 0 before the entries are written, then to the real number
+    uint8_t count = 0;
+    transfers.push_back(SdoTransfer::makeWrite(nodeid, mapIndex, &count, sizeof(count), 0));
+    for(unsigned int i=0; i<mapping.size(); i++){
+        transfers.push_back(SdoTransfer::makeWrite(nodeid, mapIndex, &mapping[i], sizeof(mapping[i]), i+1));
+    }
+    count = mapping.size();
+    transfers.push_back(SdoTransfer::makeWrite(nodeid, mapIndex, &count, sizeof(count), 0));
+
+    transfers.push_back(SdoTransfer::makeWrite(nodeid, commIndex, &cobid, sizeof(cobid), 1));
+}
+
+bool Motor_CANOpen_Driver::configureRpdo(uint8_t nodeid, int pdo, const std::vector<uint32_t>& mapping, uint8_t transmissionType){
+    std::vector<SdoTransfer> transfers;
+    addPdoConfig(transfers, nodeid, REG_RPDO_COMM + pdo, REG_RPDO_MAP + pdo, 0x200 + 0x100*pdo + nodeid, mapping, transmissionType, false, 0, 0);
+    if(!sdoTransfers(transfers)){
+        _logs->addLog("Fail to configure the RPDO " + QString::number(pdo+1) + " of node " + QString::number(nodeid), LOG_ERR);
         return false;
     }
-    if(verbose) _logs->addLog(canFrame2QString(msg_scan), LOG_CAN);
+    return true;
+}
 
-    QTime myTimer; // watchdog not the indefenetely blocked by the reading
-    myTimer.start();
-    int nMilliseconds = 0;
+bool Motor_CANOpen_Driver::configureTpdo(uint8_t nodeid, int pdo, const std::vector<uint32_t>& mapping, uint8_t transmissionType, uint16_t inhibitTime, uint16_t eventTimer){
+    std::vector<SdoTransfer> transfers;
+    addPdoConfig(transfers, nodeid, REG_TPDO_COMM + pdo, REG_TPDO_MAP + pdo, 0x180 + 0x100*pdo + nodeid, mapping, transmissionType, true, inhibitTime, eventTimer);
+    if(!sdoTransfers(transfers)){
+        _logs->addLog("Fail to configure the TPDO " + QString::number(pdo+1) + " of node " + QString::number(nodeid), LOG_ERR);
+        return false;
+    }
+    return true;
+}
 
-    // getting the response from the node
-    while((!_can->GetMsg(msg_rcvd, extended, rtr, error, errorCode)) && (nMilliseconds < WATCHDOG_MS)){
-        nMilliseconds = myTimer.elapsed();
-    }// we want to get out of the loop if we received a can message or if we wait more than WATCHDOG_MS ms
+bool Motor_CANOpen_Driver::enablePdoPositioning(const std::vector<unsigned char>& nodes){
+    // function to replace the SDO of the positioning by PDO:
+    // RPDO1 (0x200+nodeid): target position + controlword, a new set point in one frame instead of 3 SDO
+    // TPDO1 (0x180+nodeid): statusword + actual position, sent by the node when they change (at most every 1ms, at least every 100ms)
+    std::vector<uint32_t> rpdo;
+    rpdo.push_back(PDO_MAP(REG_PPOS_TPOS, 0, 32));
+    rpdo.push_back(PDO_MAP(REG_CTRLWORD, 0, 16));
+    std::vector<uint32_t> tpdo;
+    tpdo.push_back(PDO_MAP(REG_STATUSWORD, 0, 16));
+    tpdo.push_back(PDO_MAP(REG_PPOS_ACPO2, 0, 32));
+
+    // the mapping can only be changed in the pre-operational state
+    for(unsigned int i=0; i<nodes.size(); i++){
+        _pdoEnabled[nodes[i] & 0x7F] = false;
+        if(!sendNmt(NMT_PREOPERATIONAL, nodes[i])) return false;
+    }
 
-    if(nMilliseconds >= WATCHDOG_MS){ // if we did not reveiced a can message before the watchdog
-        if(verbose) _logs->addLog("Can response not received - getRegister", LOG_ERR);
+    // every node is configured at the same time
+    std::vector<uint16_t> controlword(nodes.size(), 0);
+    std::vector<SdoTransfer> transfers;
+    for(unsigned int i=0; i<nodes.size(); i++){
+        transfers.push_back(SdoTransfer::makeRead(nodes[i], REG_CTRLWORD, &controlword[i], sizeof(controlword[i])));
+        addPdoConfig(transfers, nodes[i], REG_RPDO_COMM, REG_RPDO_MAP, 0x200 + nodes[i], rpdo, 255, false, 0, 0);
+        addPdoConfig(transfers, nodes[i], REG_TPDO_COMM, REG_TPDO_MAP, 0x180 + nodes[i], tpdo, 255, true, 10, 100);
+    }
+    if(!sdoTransfers(transfers)){
+        _logs->addLog("Fail to configure the PDO, the positioning stays on SDO", LOG_WARN);
         return false;
     }
 
-    if(verbose) _logs->addLog(canFrame2QString(msg_rcvd), LOG_CAN);
+    for(unsigned int i=0; i<nodes.size(); i++){
+        unsigned char nodeid = nodes[i] & 0x7F;
+        registerTpdoHandler(nodeid);
+        _pdoControlword[nodeid] = controlword[i];
+        if(!sendNmt(NMT_START, nodeid)) return false;
+        _pdoEnabled[nodeid] = true;
+    }
+    _logs->addLog("PDO positioning enabled");
+    return true;
+}
+
+void Motor_CANOpen_Driver::registerTpdoHandler(uint8_t nodeid){
+    // function to follow the TPDO1 of nodeid (statusword + actual position), once per node
+    nodeid &= 0x7F;
+    if(_tpdoHandler[nodeid] != 0) return;
+    // the TPDO of the node update its status, and wake up the threads waiting for it
+    _tpdoHandler[nodeid] = _buses[getBusOfNode(nodeid)]->rx->addHandler(0x180 + nodeid, 0x7FF, [this, nodeid](const CanRxFrame& rx){
+        if(rx.frame.can_dlc < 6) return;
+        {
+            std::lock_guard<std::mutex> lock(_pdoMutex);
+            PdoStatus& status = _pdoStatus[nodeid];
+            memcpy(&status.statusword, &rx.frame.data[0], sizeof(status.statusword));
+            memcpy(&status.position, &rx.frame.data[2], sizeof(status.position));
+            status.timestamp = rx.timestamp;
+        }
+        _odCache.updateFromPdo(nodeid, REG_STATUSWORD, 0, &rx.frame.data[0], sizeof(uint16_t));
+        _odCache.updateFromPdo(nodeid, REG_PPOS_ACPO2, 0, &rx.frame.data[2], sizeof(int32_t));
+        _pdoCond.notify_all();
+    });
+}
 
-    if(msg_rcvd.can_id != (nodeid + 0x580)){ // the response is tested
-        // note: TODO: check if the answer is an error frame or not
-        if(verbose) _logs->addLog("Unexpected response - getRegister", LOG_ERR);
+bool Motor_CANOpen_Driver::sendRpdo(uint32_t nodeid, int32_t tpos, uint16_t controlword){
+    // function to send the RPDO1 of nodeid (see enablePdoPositioning)
+    int errorCode;
+    struct can_frame msg;
+    msg.can_id = 0x200 + nodeid;
+    msg.can_dlc = 6;
+    memcpy(&msg.data[0], &tpos, sizeof(tpos));
+    memcpy(&msg.data[4], &controlword, sizeof(controlword));
+    if(!canOf(nodeid)->SendMsg(msg, 0, 0, errorCode)){
+        _logs->addLog("Failed to send the RPDO", LOG_ERR);
         return false;
     }
+    _pdoControlword[nodeid & 0x7F] = controlword;
+    _odCache.updateFromPdo(nodeid, REG_CTRLWORD, 0, &controlword, sizeof(controlword));
+    return true;
+}
 
-    for(unsigned int i=0; i< size; i++){
-        // save the gotten value in the regval address variable
-        memcpy((unsigned char*)regval+i, &msg_rcvd.data[4+i], 1);
+bool Motor_CANOpen_Driver::pdoSetPosition(uint32_t nodeid, int32_t tpos, uint16_t controlword){
+    // function to set a new target position through the RPDO (same controlword bits as setPosition)
+    controlword = controlword & 0xFFEF; // set bit 4 to 0
+    controlword = controlword & 0xFFDF; // set bit 5 to 0
+    controlword = controlword & 0xFFBF; // set bit 6 to 0
+    controlword = controlword & 0xFEFF; // set bit 8 to 0
+
+    // the node takes the set point on the rising edge of bit 4: it is cleared first if the previous move did not release it
+    if(_pdoControlword[nodeid & 0x7F] & 0x0010){
+        if(!sendRpdo(nodeid, tpos, controlword)) return false;
+    }
+    return sendRpdo(nodeid, tpos, controlword | 0x0010);
+}
+
+PdoStatus Motor_CANOpen_Driver::getPdoStatus(uint32_t nodeid){
+    std::lock_guard<std::mutex> lock(_pdoMutex);
+    return _pdoStatus[nodeid & 0x7F];
+}
+
+bool Motor_CANOpen_Driver::waitPdoStatus(uint32_t nodeid, uint16_t mask, uint16_t value, int64_t after, int timeoutMs, int64_t* timestamp){
+    std::unique_lock<std::mutex> lock(_pdoMutex);
+    PdoStatus& status = _pdoStatus[nodeid & 0x7F];
+    bool ok = _pdoCond.wait_for(lock, std::chrono::milliseconds(timeoutMs), [&]{
+        return status.timestamp >= after && (status.statusword & mask) == value;
+    });
+    if(ok && timestamp != NULL) *timestamp = status.timestamp;
+    return ok;
+}
+
+static int64_t monotonicNs(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+bool Motor_CANOpen_Driver::enableCsp(const std::vector<unsigned char>& nodes, uint32_t periodUs){
+    // function to switch the nodes (already in the state ENABLE) to the cyclic synchronous position mode
+    // nodes: the axes streamed by the real-time thread
+    // periodUs: the cycle, from 100us to 25ms (the interpolation period is written in 100us unit)
+    disableCsp();
+    disableIpMode();
+    if(_syncRunning){
+        _logs->addLog("The SYNC of startSync is stopped, the CSP thread sends its own", LOG_WARN);
+    }
+    stopSync(); // the SYNC is sent by the real-time thread, right after the set points
+
+    if(periodUs < 100 || periodUs > 25500){
+        _logs->addLog("CSP period out of range", LOG_ERR);
+        return false;
+    }
+    if(periodUs % 100 != 0){
+        _logs->addLog("CSP period not a multiple of 100us (unit of the interpolation period of the drives)", LOG_ERR);
+        return false;
+    }
+
+    std::vector<uint32_t> rpdo;
+    rpdo.push_back(PDO_MAP(REG_PPOS_TPOS, 0, 32));
+    rpdo.push_back(PDO_MAP(REG_CTRLWORD, 0, 16));
+    std::vector<uint32_t> tpdo;
+    tpdo.push_back(PDO_MAP(REG_STATUSWORD, 0, 16));
+    tpdo.push_back(PDO_MAP(REG_PPOS_ACPO2, 0, 32));
+
+    // the mapping can only be changed in the pre-operational state
+    for(unsigned int i=0; i<nodes.size(); i++){
+        _pdoEnabled[nodes[i] & 0x7F] = false; // the RPDO set points are not profile position ones anymore
+        if(!sendNmt(NMT_PREOPERATIONAL, nodes[i])) return false;
+    }
+
+    uint8_t periodValue = periodUs / 100;
+    int8_t periodExponent = -4;
+    int8_t mode = MODE_CSP;
+    std::vector<int32_t> position(nodes.size(), 0);
+    std::vector<SdoTransfer> transfers;
+    for(unsigned int i=0; i<nodes.size(); i++){
+        // the axes start from where they are, so the first set points do not move them
+        transfers.push_back(SdoTransfer::makeRead(nodes[i], REG_PPOS_ACPO2, &position[i], sizeof(position[i])));
+        // transmission type 1: the RPDO is applied and the TPDO is sent at each SYNC
+        addPdoConfig(transfers, nodes[i], REG_RPDO_COMM, REG_RPDO_MAP, 0x200 + nodes[i], rpdo, 1, false, 0, 0);
+        addPdoConfig(transfers, nodes[i], REG_TPDO_COMM, REG_TPDO_MAP, 0x180 + nodes[i], tpdo, 1, true, 0, 0);
+        transfers.push_back(SdoTransfer::makeWrite(nodes[i], REG_INTERP_PERIOD, &periodValue, sizeof(periodValue), 1));
+        transfers.push_back(SdoTransfer::makeWrite(nodes[i], REG_INTERP_PERIOD, &periodExponent, sizeof(periodExponent), 2));
+        transfers.push_back(SdoTransfer::makeWrite(nodes[i], REG_OPMODE, &mode, sizeof(mode)));
+    }
+    if(!sdoTransfers(transfers)){
+        _logs->addLog("Fail to configure the cyclic synchronous position mode", LOG_ERR);
+        return false;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(_cspMutex);
+        _cspAxes.clear();
+        for(unsigned int i=0; i<nodes.size(); i++){
+            CspAxis axis;
+            axis.nodeid = nodes[i] & 0x7F;
+            axis.trajectory.hold(position[i]);
+            axis.start = monotonicNs();
+            axis.setpoint = position[i];
+            _cspAxes.push_back(axis);
+            uint16_t controlword = 0x000F; // enable operation, no handshake in CSP
+            _pdoControlword[axis.nodeid] = controlword;
+            _odCache.updateFromPdo(axis.nodeid, REG_CTRLWORD, 0, &controlword, sizeof(controlword));
+        }
+    }
+    for(unsigned int i=0; i<nodes.size(); i++){
+        registerTpdoHandler(nodes[i]);
+        if(!sendNmt(NMT_START, nodes[i])) return false;
+    }
+
+    _cspPeriodUs = periodUs;
+    _cspMissed = 0;
+    _cspRunning = true;
+    _cspThread = std::thread(&Motor_CANOpen_Driver::cspLoop, this);
+    _logs->addLog("Cyclic synchronous position enabled, period " + QString::number(periodUs) + "us");
+    return true;
+}
+
+void Motor_CANOpen_Driver::disableCsp(){
+    if(!_cspRunning) return;
+    _cspRunning = false;
+    _cspThread.join();
+    std::vector<uint32_t> nodes;
+    {
+        std::lock_guard<std::mutex> lock(_cspMutex);
+        for(unsigned int i=0; i<_cspAxes.size(); i++){
+            nodes.push_back(_cspAxes[i].nodeid);
+        }
+        _cspAxes.clear();
+    }
+    // in CSP the statusword bit 12 is always set: left as they are, the drives would never acknowledge
+    // the set points of the profile position moves
+    if(!setProfilePositionMode(nodes)){
+        _logs->addLog("The axes may still be in cyclic synchronous position, configure them again", LOG_WARN);
+    }
+}
+
+bool Motor_CANOpen_Driver::setProfilePositionMode(const std::vector<uint32_t>& nodes){
+    // function to put back the axes of a cyclic mode in profile position, bit 4 of the controlword released
+    std::vector<SdoTransfer> transfers;
+    uint16_t controlword = 0x000F; // enable operation
+    int8_t mode = MODE_PPOS;
+    for(unsigned int i=0; i<nodes.size(); i++){
+        transfers.push_back(SdoTransfer::makeWrite(nodes[i], REG_CTRLWORD, &controlword, sizeof(controlword)));
+        transfers.push_back(SdoTransfer::makeWrite(nodes[i], REG_OPMODE, &mode, sizeof(mode)));
+    }
+    if(transfers.empty()) return true;
+    bool ok = sdoTransfers(transfers);
+    for(unsigned int i=0; i<nodes.size(); i++){
+        // the TPDO of the cyclic mode was only sent on SYNC: the statusword it left in the cache is the one of that mode
+        _odCache.invalidateDriveOwned(nodes[i]);
+    }
+    if(!ok){
+        _logs->addLog("Fail to set the profile position mode", LOG_ERR);
+        return false;
+    }
+    return true;
+}
+
+bool Motor_CANOpen_Driver::isCspAxis(uint32_t nodeid){
+    std::lock_guard<std::mutex> lock(_cspMutex);
+    for(unsigned int i=0; i<_cspAxes.size(); i++){
+        if(_cspAxes[i].nodeid == (nodeid & 0x7F)) return true;
+    }
+    return false;
+}
+
+bool Motor_CANOpen_Driver::cspMoveTo(uint32_t nodeid, int32_t target, double duration){
+    // function to start a new trajectory from the current set point of the axis
+    // duration: seconds, the move ends on a cycle (at least one cycle)
+    std::lock_guard<std::mutex> lock(_cspMutex);
+    for(unsigned int i=0; i<_cspAxes.size(); i++){
+        CspAxis& axis = _cspAxes[i];
+        if(axis.nodeid != (nodeid & 0x7F)) continue;
+        double period = _cspPeriodUs * 1e-6;
+        double cycles = ceil(duration / period);
+        if(cycles < 1) cycles = 1;
+        axis.trajectory.start(axis.setpoint, target, cycles * period);
+        axis.start = monotonicNs();
+        return true;
+    }
+    _logs->addLog("Node " + QString::number(nodeid) + " is not streamed in cyclic synchronous position", LOG_ERR);
+    return false;
+}
+
+bool Motor_CANOpen_Driver::cspWaitIdle(int timeoutMs){
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeoutMs);
+
+    // the last set point of every axis has been sent
+    std::vector<uint32_t> nodes;
+    std::vector<int32_t> targets;
+    {
+        std::unique_lock<std::mutex> lock(_cspMutex);
+        bool streamed = _cspIdle.wait_until(lock, deadline, [this]{
+            for(unsigned int i=0; i<_cspAxes.size(); i++){
+                if(_cspAxes[i].setpoint != _cspAxes[i].trajectory.getTarget()) return false;
+            }
+            return true;
+        });
+        if(!streamed) return false;
+        for(unsigned int i=0; i<_cspAxes.size(); i++){
+            nodes.push_back(_cspAxes[i].nodeid);
+            targets.push_back(_cspAxes[i].trajectory.getTarget());
+        }
+    }
+
+    // then the drives are there: a TPDO sent since then gives an actual position within the window of the target
+    int64_t after = nowNs();
+    uint32_t failed = 0;
+    std::unique_lock<std::mutex> lock(_pdoMutex);
+    bool reached = _pdoCond.wait_until(lock, deadline, [&]{
+        for(unsigned int i=0; i<nodes.size(); i++){
+            const PdoStatus& status = _pdoStatus[nodes[i]];
+            if(status.timestamp >= after && (status.statusword & 0x2008)){
+                failed = nodes[i]; // fault (bit 3) or following error (bit 13): it will not get there
+                return true;
+            }
+            if(status.timestamp < after || llabs((int64_t)status.position - targets[i]) > CSP_POSITION_WINDOW) return false;
+        }
+        return true;
+    });
+    lock.unlock();
+    if(failed != 0){
+        _logs->addLog("Node " + QString::number(failed) + " stopped on a fault or a following error", LOG_ERR);
+        return false;
+    }
+    return reached;
+}
+
+void Motor_CANOpen_Driver::cspLoop(){
+    // real-time thread of the CSP mode: at each period, the set points of the axes (RPDO1)
+    // then the SYNC that makes the drives apply them (absolute deadlines, the error does not accumulate)
+    struct sched_param param;
+    param.sched_priority = CSP_RT_PRIORITY;
+    if(pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) != 0){
+        _logs->addLog("No real-time priority for the CSP thread (CAP_SYS_NICE needed), the cycle may jitter", LOG_WARN);
+    }
+
+    // the SYNC is sent on every bus with a streamed axis
+    std::vector<CanTransport*> syncBuses;
+    {
+        std::lock_guard<std::mutex> lock(_cspMutex);
+        for(unsigned int i=0; i<_cspAxes.size(); i++){
+            CanTransport* can = canOf(_cspAxes[i].nodeid);
+            if(std::find(syncBuses.begin(), syncBuses.end(), can) == syncBuses.end()) syncBuses.push_back(can);
+        }
+    }
+    struct can_frame sync;
+    memset(&sync, 0, sizeof(sync));
+    sync.can_id = 0x080;
+    sync.can_dlc = 0;
+
+    int64_t period = (int64_t)_cspPeriodUs * 1000;
+    int64_t next = monotonicNs();
+    int errorCode;
+    while(_cspRunning){
+        next += period;
+        struct timespec deadline;
+        deadline.tv_sec = next / 1000000000LL;
+        deadline.tv_nsec = next % 1000000000LL;
+        while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR);
+
+        int64_t now = monotonicNs();
+        if(now - next > period){
+            // a whole cycle has been missed, we restart from now instead of sending a burst of late cycles
+            _cspMissed++;
+            next = now;
+        }
+
+        bool idle = true;
+        {
+            std::lock_guard<std::mutex> lock(_cspMutex);
+            for(unsigned int i=0; i<_cspAxes.size(); i++){
+                CspAxis& axis = _cspAxes[i];
+                axis.setpoint = axis.trajectory.at((now - axis.start) * 1e-9);
+                if(axis.setpoint != axis.trajectory.getTarget()) idle = false;
+
+                struct can_frame msg;
+                msg.can_id = 0x200 + axis.nodeid;
+                msg.can_dlc = 6;
+                memcpy(&msg.data[0], &axis.setpoint, sizeof(axis.setpoint));
+                uint16_t controlword = _pdoControlword[axis.nodeid];
+                memcpy(&msg.data[4], &controlword, sizeof(controlword));
+                if(!canOf(axis.nodeid)->SendMsg(msg, 0, 0, errorCode)) _cspMissed++;
+            }
+        }
+        for(unsigned int i=0; i<syncBuses.size(); i++){
+            if(!syncBuses[i]->SendMsg(sync, 0, 0, errorCode)) _cspMissed++;
+        }
+        if(idle) _cspIdle.notify_all();
+    }
+}
+
+bool Motor_CANOpen_Driver::enableIpMode(const std::vector<unsigned char>& nodes, uint32_t periodUs){
+    // function to switch the nodes (already in the state ENABLE) to the interpolated position mode
+    // nodes: the axes fed by the feeder thread
+    // periodUs: the interpolation period, from 100us to 25ms
+    disableCsp();
+    disableIpMode();
+
+    if(periodUs < 100 || periodUs > 25500){
+        _logs->addLog("Interpolation period out of range", LOG_ERR);
+        return false;
+    }
+    if(periodUs % 100 != 0){
+        _logs->addLog("Interpolation period not a multiple of 100us (unit of the interpolation period of the drives)", LOG_ERR);
+        return false;
+    }
+
+    std::vector<uint32_t> rpdo;
+    rpdo.push_back(PDO_MAP(REG_IP_DATA, 1, 32));
+    std::vector<uint32_t> tpdo;
+    tpdo.push_back(PDO_MAP(REG_STATUSWORD, 0, 16));
+    tpdo.push_back(PDO_MAP(REG_PPOS_ACPO2, 0, 32));
+
+    // the mapping can only be changed in the pre-operational state
+    for(unsigned int i=0; i<nodes.size(); i++){
+        _pdoEnabled[nodes[i] & 0x7F] = false;
+        if(!sendNmt(NMT_PREOPERATIONAL, nodes[i])) return false;
+    }
+
+    int16_t submode = 0;        // linear interpolation
+    uint8_t periodValue = periodUs / 100;
+    int8_t periodExponent = -4;
+    uint8_t fifo = 0;           // buffer organization: FIFO
+    uint8_t bufferClear = 0;    // clears the buffer and disables the access to it
+    uint8_t bufferEnable = 1;
+    int8_t mode = MODE_IPOS;
+    std::vector<int32_t> position(nodes.size(), 0);
+    std::vector<uint32_t> bufferSize(nodes.size(), 0);
+    std::vector<SdoTransfer> transfers;
+    for(unsigned int i=0; i<nodes.size(); i++){
+        transfers.push_back(SdoTransfer::makeRead(nodes[i], REG_PPOS_ACPO2, &position[i], sizeof(position[i])));
+        transfers.push_back(SdoTransfer::makeRead(nodes[i], REG_IP_CONFIG, &bufferSize[i], sizeof(bufferSize[i]), 1));
+        // transmission type 255: each set point received goes into the FIFO, the drive takes them at the SYNC
+        addPdoConfig(transfers, nodes[i], REG_RPDO_COMM + 1, REG_RPDO_MAP + 1, 0x300 + nodes[i], rpdo, 255, false, 0, 0);
+        addPdoConfig(transfers, nodes[i], REG_TPDO_COMM, REG_TPDO_MAP, 0x180 + nodes[i], tpdo, 255, true, 10, 100);
+        transfers.push_back(SdoTransfer::makeWrite(nodes[i], REG_IP_SUBMODE, &submode, sizeof(submode)));
+        transfers.push_back(SdoTransfer::makeWrite(nodes[i], REG_INTERP_PERIOD, &periodValue, sizeof(periodValue), 1));
+        transfers.push_back(SdoTransfer::makeWrite(nodes[i], REG_INTERP_PERIOD, &periodExponent, sizeof(periodExponent), 2));
+        transfers.push_back(SdoTransfer::makeWrite(nodes[i], REG_IP_CONFIG, &fifo, sizeof(fifo), 3));
+        transfers.push_back(SdoTransfer::makeWrite(nodes[i], REG_IP_CONFIG, &bufferClear, sizeof(bufferClear), 6));
+        transfers.push_back(SdoTransfer::makeWrite(nodes[i], REG_IP_CONFIG, &bufferEnable, sizeof(bufferEnable), 6));
+        transfers.push_back(SdoTransfer::makeWrite(nodes[i], REG_OPMODE, &mode, sizeof(mode)));
+    }
+    if(!sdoTransfers(transfers)){
+        _logs->addLog("Fail to configure the interpolated position mode", LOG_ERR);
+        return false;
+    }
+
+    uint32_t smallest = 0;
+    for(unsigned int i=0; i<nodes.size(); i++){
+        if(i == 0 || bufferSize[i] < smallest) smallest = bufferSize[i];
+    }
+    if(smallest <= IP_BUFFER_MARGIN){
+        _logs->addLog("The set point buffer of the drives is too small", LOG_ERR);
+        return false;
+    }
+
+    for(unsigned int i=0; i<nodes.size(); i++){
+        registerTpdoHandler(nodes[i]);
+        if(!sendNmt(NMT_START, nodes[i])) return false;
+    }
+
+    // enable operation + bit 4: interpolation active
+    std::vector<SdoTransfer> enable;
+    for(unsigned int i=0; i<nodes.size(); i++){
+        uint16_t controlword = 0x001F;
+        _pdoControlword[nodes[i] & 0x7F] = controlword;
+        enable.push_back(SdoTransfer::makeWrite(nodes[i], REG_CTRLWORD, &controlword, sizeof(controlword)));
+    }
+    if(!sdoTransfers(enable)){
+        _logs->addLog("Fail to start the interpolation", LOG_ERR);
+        return false;
     }
 
+    {
+        std::lock_guard<std::mutex> lock(_ipMutex);
+        _ipAxes.clear();
+        for(unsigned int i=0; i<nodes.size(); i++){
+            IpAxis axis;
+            axis.nodeid = nodes[i] & 0x7F;
+            axis.last = position[i];
+            axis.inDrive = 0;
+            _ipAxes.push_back(axis);
+        }
+    }
+
+    // the SYNC comes from the broadcast manager when it is available: the feeder only wakes up a few times per buffer
+    _ipOwnSync = false;
+    for(unsigned int i=0; i<_buses.size(); i++){
+        if(_buses[i]->interfaceName.compare(0, 4, "loop") == 0) _ipOwnSync = true;
+    }
+    if(!_ipOwnSync && !startSync(periodUs)) _ipOwnSync = true;
+    if(_ipOwnSync) _logs->addLog("The SYNC of the interpolation is sent by the feeder thread", LOG_WARN);
+
+    _ipPeriodUs = periodUs;
+    _ipBufferSize = smallest;
+    _ipRunning = true;
+    _ipThread = std::thread(&Motor_CANOpen_Driver::ipLoop, this);
+    _logs->addLog("Interpolated position enabled, period " + QString::number(periodUs) + "us, buffer of " + QString::number(smallest) + " set points");
     return true;
+}
+
+void Motor_CANOpen_Driver::disableIpMode(){
+    if(!_ipRunning) return;
+    _ipRunning = false;
+    _ipThread.join();
+    if(!_ipOwnSync) stopSync();
+    std::vector<uint32_t> nodes;
+    {
+        std::lock_guard<std::mutex> lock(_ipMutex);
+        for(unsigned int i=0; i<_ipAxes.size(); i++){
+            nodes.push_back(_ipAxes[i].nodeid);
+        }
+        _ipAxes.clear();
+    }
+
+    // interpolation stopped (bit 4 released) and profile position, then the set points left in the buffer are dropped
+    bool ok = setProfilePositionMode(nodes);
+    uint8_t bufferClear = 0; // clears the buffer and disables the access to it
+    std::vector<SdoTransfer> transfers;
+    for(unsigned int i=0; i<nodes.size(); i++){
+        transfers.push_back(SdoTransfer::makeWrite(nodes[i], REG_IP_CONFIG, &bufferClear, sizeof(bufferClear), 6));
+    }
+    if(!transfers.empty() && !sdoTransfers(transfers)) ok = false;
+    if(!ok){
+        _logs->addLog("The axes may still be in interpolated position, configure them again", LOG_WARN);
+    }
+}
+
+bool Motor_CANOpen_Driver::ipFollowPath(uint32_t nodeid, const std::vector<int32_t>& points){
+    // function to add set points after the ones already queued for the axis
+    std::lock_guard<std::mutex> lock(_ipMutex);
+    for(unsigned int i=0; i<_ipAxes.size(); i++){
+        IpAxis& axis = _ipAxes[i];
+        if(axis.nodeid != (nodeid & 0x7F)) continue;
+        axis.points.insert(axis.points.end(), points.begin(), points.end());
+        if(!points.empty()) axis.last = points.back();
+        return true;
+    }
+    _logs->addLog("Node " + QString::number(nodeid) + " is not in interpolated position", LOG_ERR);
+    return false;
+}
 
+bool Motor_CANOpen_Driver::ipFollowTargets(uint32_t nodeid, const std::vector<int32_t>& targets, double speed){
+    int32_t from = 0;
+    bool found = false;
+    {
+        std::lock_guard<std::mutex> lock(_ipMutex);
+        for(unsigned int i=0; i<_ipAxes.size(); i++){
+            if(_ipAxes[i].nodeid == (nodeid & 0x7F)){
+                from = _ipAxes[i].last;
+                found = true;
+            }
+        }
+    }
+    if(!found){
+        _logs->addLog("Node " + QString::number(nodeid) + " is not in interpolated position", LOG_ERR);
+        return false;
+    }
+
+    // one set point per interpolation period along each segment
+    double period = _ipPeriodUs * 1e-6;
+    std::vector<int32_t> points;
+    AxisTrajectory trajectory;
+    for(unsigned int i=0; i<targets.size(); i++){
+        double cycles = ceil(AxisTrajectory::minimumDuration(from, targets[i], speed) / period);
+        if(cycles < 1) cycles = 1;
+        trajectory.start(from, targets[i], cycles * period);
+        for(int k=1; k<=(int)cycles; k++){
+            points.push_back(trajectory.at(k * period));
+        }
+        from = targets[i];
+    }
+    return ipFollowPath(nodeid, points);
+}
+
+bool Motor_CANOpen_Driver::ipWaitDone(int timeoutMs){
+    std::unique_lock<std::mutex> lock(_ipMutex);
+    return _ipDone.wait_for(lock, std::chrono::milliseconds(timeoutMs), [this]{
+        for(unsigned int i=0; i<_ipAxes.size(); i++){
+            if(!_ipAxes[i].points.empty() || _ipAxes[i].inDrive > 0) return false;
+        }
+        return true;
+    });
+}
+
+void Motor_CANOpen_Driver::ipLoop(){
+    // feeder thread of the interpolated position mode: the drives take one set point per SYNC,
+    // so the number of periods elapsed tells how much room has been freed in their FIFO
+    int64_t period = (int64_t)_ipPeriodUs * 1000;
+    int64_t wake = period;
+    if(!_ipOwnSync && _ipBufferSize / 4 > 1) wake = period * (_ipBufferSize / 4);
+
+    std::vector<CanTransport*> syncBuses;
+    {
+        std::lock_guard<std::mutex> lock(_ipMutex);
+        for(unsigned int i=0; i<_ipAxes.size(); i++){
+            CanTransport* can = canOf(_ipAxes[i].nodeid);
+            if(std::find(syncBuses.begin(), syncBuses.end(), can) == syncBuses.end()) syncBuses.push_back(can);
+        }
+    }
+    struct can_frame sync;
+    memset(&sync, 0, sizeof(sync));
+    sync.can_id = 0x080;
+    sync.can_dlc = 0;
+
+    int64_t next = monotonicNs();
+    int64_t counted = next; // time up to which the periods have been counted
+    int errorCode;
+    while(_ipRunning){
+        int64_t taken;
+        if(_ipOwnSync){
+            taken = 1; // one SYNC per wake up
+        }else{
+            int64_t now = monotonicNs();
+            taken = (now - counted) / period;
+            counted += taken * period;
+        }
+
+        bool done = true;
+        {
+            std::lock_guard<std::mutex> lock(_ipMutex);
+            for(unsigned int i=0; i<_ipAxes.size(); i++){
+                IpAxis& axis = _ipAxes[i];
+                axis.inDrive = std::max((int64_t)0, axis.inDrive - taken);
+                // fill the FIFO of the drive, minus a margin
+                while(!axis.points.empty() && axis.inDrive < (int64_t)_ipBufferSize - IP_BUFFER_MARGIN){
+                    struct can_frame msg;
+                    msg.can_id = 0x300 + axis.nodeid;
+                    msg.can_dlc = 4;
+                    memcpy(&msg.data[0], &axis.points.front(), sizeof(int32_t));
+                    if(!canOf(axis.nodeid)->SendMsg(msg, 0, 0, errorCode)) break; // retried at the next wake up
+                    axis.points.pop_front();
+                    axis.inDrive++;
+                }
+                if(!axis.points.empty() || axis.inDrive > 0) done = false;
+            }
+        }
+        if(_ipOwnSync){
+            for(unsigned int i=0; i<syncBuses.size(); i++){
+                syncBuses[i]->SendMsg(sync, 0, 0, errorCode);
+            }
+        }
+        if(done) _ipDone.notify_all();
+
+        next += wake;
+        struct timespec deadline;
+        deadline.tv_sec = next / 1000000000LL;
+        deadline.tv_nsec = next % 1000000000LL;
+        while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR);
+    }
 }
 
 QString Motor_CANOpen_Driver::state2QString(unsigned int state){
@@ -168,218 +1631,160 @@ QString Motor_CANOpen_Driver::mode2QString(int8_t mode){
         break;
     case MODE_IPOS:
         retval = "Interpolated position";
-        break;
-    default:
-        retval = "Not a valide mode";
-    }
-    return retval;
-}
-
-unsigned int Motor_CANOpen_Driver::getStateFromStatusWord(uint16_t statusword){
-    // processing the status word to display the status of the node
-    unsigned int state = STATE_NA;
-    if((statusword & 0x004F) == 0){ // xxxx xxxx x0xx 0000
-        state = STATE_NOTREADY;
-    }else if((statusword & 0x005F) == 0x50){ // xxxx xxxx x1x1 0000
-        state = STATE_DISABLED;
-    }else if((statusword & 0x007F) == 0x31){ // xxxx xxxx x011 0001
-        state = STATE_READY;
-    }else if((statusword & 0x007F) == 0x33){ // xxxx xxxx x011 0011
-        state = STATE_SWITCHEDON;
-    }else if((statusword & 0x007F) == 0x37){ // xxxx xxxx x011 0111
-        state = STATE_ENABLED;
-    }else if((statusword & 0x007F) == 0x17){ // xxxx xxxx x001 0111
-        state = STATE_QUICKSTOP;
-    }else if((statusword & 0x004F) == 0x0F){ // xxxx xxxx x001 0111
-        state = STATE_FAULTACTIVE;
-    }else if((statusword & 0x004F) == 0x08){ // xxxx xxxx x001 0111
-        state = STATE_FAULT;
-    }
-    return state;
-}
-
-bool Motor_CANOpen_Driver::setRegister (uint16_t regadd, uint32_t nodeid, const void* regval, size_t size, unsigned char subindex, bool verbose){
-    // function to set the value of a register in the controller
-    // regadd: the register address
-    // nodeid: the id of the controller
-    // regval: the value we want to write
-    // size: the size of the value (byte number)
-    // subindex: the subindex we want to write (default value: 0)
-    // verbose: to add (true) or not (false) the messages to the listwidget log (fault value:true)
-
-    // we flush the CAN buffer just in case
-    struct can_frame msg_rcvd;
-    int errorCode = 0;
-    bool extended, rtr, error;
-    while(_can->GetMsg(msg_rcvd, extended, rtr, error, errorCode)){
-        if(verbose) _logs->addLog("Unexpected CAN frame - setRegister", LOG_WARN);
-        if(verbose) _logs->addLog(canFrame2QString(msg_rcvd), LOG_CAN);
-    }
-
-
-    struct can_frame msg_scan;
-
-    // initialization of the request
-    msg_scan.can_id  = 0x600+nodeid;
-    msg_scan.can_dlc = 8;
-
-    // the first byte change depending of the size to write
-    msg_scan.data[0] = 0x2 << 4;
-    msg_scan.data[0] += 0x3;
-    msg_scan.data[0] += (4-size) << 2;
-
-    // setting the register address
-    msg_scan.data[1] = regadd;
-    msg_scan.data[2] = (regadd >> 8);
-
-    // subindex
-    msg_scan.data[3] = subindex;
-
-    //setting the register value
-    for(unsigned int i=0; i<size; i++){
-        memcpy(&msg_scan.data[4+i], (unsigned char*)regval+i, 1);
-    }
-    for(unsigned int i=size; i<4; i++){
-       msg_scan.data[4+i]=0;
-    }
-
-    // sending the request
-    if(!_can->SendMsg(msg_scan, 0, 0, errorCode)){
-        if(verbose) _logs->addLog("Failed to send the request - setRegister", LOG_ERR);
-        return false;
-    }
-    if(verbose) _logs->addLog(canFrame2QString(msg_scan), LOG_CAN);
-
-    QTime mytime; // to handle the watchdog
-    int nbms = 0;
-
-    mytime.start();
-    while((!_can->GetMsg(msg_rcvd, extended, rtr, error, errorCode)) && nbms < WATCHDOG_MS){
-        nbms = mytime.elapsed();
-    }// we want to end the loop if we received a can message or if the watchdog time out
-
-    if(nbms >= WATCHDOG_MS){ // if we did not received a can message before the watchog timed out
-        if(verbose) _logs->addLog("Can response not received - setRegister", LOG_ERR);
-        return false;
+        break;
+    case MODE_CSP:
+        retval = "Cyclic synchronous position";
+        break;
+    default:
+        retval = "Not a valide mode";
     }
-    if(verbose) _logs->addLog(canFrame2QString(msg_rcvd), LOG_CAN);
+    return retval;
+}
 
-    if(msg_rcvd.can_id != (nodeid + 0x580)){ // the response is tested
-        if(verbose) _logs->addLog("Unexpected response - setRegister", LOG_ERR);
-        return false;
-    }else{
-        // we test if it is an error can frame
-        if (msg_rcvd.data[0]==0x80){
-            if(verbose) _logs->addLog("Error frame received - setRegister", LOG_ERR);
-            return false;
-        }
+unsigned int Motor_CANOpen_Driver::getStateFromStatusWord(uint16_t statusword){
+    // processing the status word to display the status of the node
+    unsigned int state = STATE_NA;
+    if((statusword & 0x004F) == 0){ // xxxx xxxx x0xx 0000
+        state = STATE_NOTREADY;
+    }else if((statusword & 0x005F) == 0x50){ // xxxx xxxx x1x1 0000
+        state = STATE_DISABLED;
+    }else if((statusword & 0x007F) == 0x31){ // xxxx xxxx x011 0001
+        state = STATE_READY;
+    }else if((statusword & 0x007F) == 0x33){ // xxxx xxxx x011 0011
+        state = STATE_SWITCHEDON;
+    }else if((statusword & 0x007F) == 0x37){ // xxxx xxxx x011 0111
+        state = STATE_ENABLED;
+    }else if((statusword & 0x007F) == 0x17){ // xxxx xxxx x001 0111
+        state = STATE_QUICKSTOP;
+    }else if((statusword & 0x004F) == 0x0F){ // xxxx xxxx x001 0111
+        state = STATE_FAULTACTIVE;
+    }else if((statusword & 0x004F) == 0x08){ // xxxx xxxx x001 0111
+        state = STATE_FAULT;
     }
-    return true;
+    return state;
 }
 
 bool Motor_CANOpen_Driver::addStates2logs(){
     // function to update the labels according to the controller's status word (controller mode and state)
     _logs->addLog("Updating states...");
-    uint16_t statusword;
-    if(!readRegister(REG_STATUSWORD, ID_MIRROR_1, &statusword, sizeof(statusword))){
-        _logs->addLog(QString("Fail to read the control word of mirror ")+QString::number(ID_MIRROR_1), LOG_ERR);
-        return false;
-    }
-    _logs->addLog(QString("State of mirror ")+QString::number(ID_MIRROR_1) + QString(" : ") +
-                  state2QString(getStateFromStatusWord(statusword)), LOG_INFO);
-
-    if(!readRegister(REG_STATUSWORD, ID_MIRROR_2, &statusword, sizeof(statusword))){
-        _logs->addLog(QString("Fail to read the control word of mirror ")+QString::number(ID_MIRROR_2), LOG_ERR);
-        return false;
+    unsigned int n = _axes.size();
+    std::vector<uint16_t> statusword(n);
+    std::vector<int8_t> mode(n);
+
+    // the registers of every axis are read at the same time
+    std::vector<SdoTransfer> transfers;
+    for(unsigned int i=0; i<n; i++){
+        transfers.push_back(SdoTransfer::makeRead(_axes[i].nodeid, REG_STATUSWORD, &statusword[i], sizeof(statusword[i])));
+        transfers.push_back(SdoTransfer::makeRead(_axes[i].nodeid, REG_OPMODE, &mode[i], sizeof(mode[i])));
     }
-    _logs->addLog(QString("State of mirror ")+QString::number(ID_MIRROR_2) + QString(" : ") +
-                  state2QString(getStateFromStatusWord(statusword)), LOG_INFO);
+    sdoTransfers(transfers);
 
-    int8_t mode;
-    if(!readRegister(REG_OPMODE, ID_MIRROR_1, &mode, sizeof(mode))){
-        _logs->addLog(QString("Fail to read the Operation mode register of mirror")+QString::number(ID_MIRROR_1), LOG_ERR);
-        return false;
+    for(unsigned int i=0; i<n; i++){
+        if(!transfers[2*i].done){
+            _logs->addLog(QString("Fail to read the control word of ")+_axes[i].name, LOG_ERR);
+            return false;
+        }
+        _logs->addLog(QString("State of ")+_axes[i].name + QString(" : ") +
+                      state2QString(getStateFromStatusWord(statusword[i])), LOG_INFO);
     }
-
-    _logs->addLog(QString("Mode of mirror ")+QString::number(ID_MIRROR_1) + QString(" : ") +
-                  mode2QString(mode), LOG_INFO);
-
-    if(!readRegister(REG_OPMODE, ID_MIRROR_2, &mode, sizeof(mode))){
-        _logs->addLog(QString("Fail to read the Operation mode register of mirror")+QString::number(ID_MIRROR_2), LOG_ERR);
-        return false;
+    for(unsigned int i=0; i<n; i++){
+        if(!transfers[2*i+1].done){
+            _logs->addLog(QString("Fail to read the Operation mode register of ")+_axes[i].name, LOG_ERR);
+            return false;
+        }
+        _logs->addLog(QString("Mode of ")+_axes[i].name + QString(" : ") +
+                      mode2QString(mode[i]), LOG_INFO);
+        _logs->addLog(QString("SDO latency of ")+_axes[i].name + QString(" : ") +
+                      sdoLatency2QString(_axes[i].nodeid), LOG_INFO);
+        _logs->addLog(QString("NMT state of ")+_axes[i].name + QString(" : ") +
+                      nodeStatus2QString(_axes[i].nodeid), LOG_INFO);
     }
-    _logs->addLog(QString("Mode of mirror ")+QString::number(ID_MIRROR_2) + QString(" : ") +
-                  mode2QString(mode), LOG_INFO);
+    _logs->addLog(QString("Object dictionary cache : ") + QString::number(_odCache.getHits()) + " hits, " +
+                  QString::number(_odCache.getMisses()) + " misses", LOG_INFO);
 
     return true;
 }
 
 bool Motor_CANOpen_Driver::connect(){
-    // function to connect the can socket and check if the controllers are up
+    // function to connect the can sockets and check if the controllers are up on each bus
     int errorCode;
-    // Connect the CAN socket
-    if(!_can->isInitialized()){
-        if(_can->Init("can0",errorCode)){
-            _logs->addLog("Can initialized");
+    for(unsigned int i=0; i<_buses.size(); i++){
+        CanBus* bus = _buses[i];
+        QString name = bus->interfaceName.c_str();
+        // a bus left without any node (every axis moved to another interface) is not opened
+        if(bus->nodes.empty() && !bus->can->isInitialized()) continue;
+        // Connect the CAN socket
+        if(!bus->can->isInitialized()){
+            if(bus->can->Init(bus->interfaceName.c_str(),errorCode)){
+                _logs->addLog(QString("Can initialized on ") + name);
+            }else{
+                _logs->addLog("Failed to initialized CanBus " + name,LOG_ERR);
+                return false;
+            }
         }else{
-            _logs->addLog("Failed to initialized CanBus",LOG_ERR);
+            _logs->addLog("CANbus " + name + " already initialized",LOG_WARN);
+        }
+        // CAN FD if the interface supports it (newer drives accept FD-mapped PDOs), classic CAN otherwise
+        if(bus->can->EnableFdFrames(errorCode)){
+            _logs->addLog("CAN FD enabled on " + name);
+        }
+
+        // kernel timestamps, to measure the SDO round trips
+        if(!bus->can->EnableTimestamps(true, errorCode)){
+            _logs->addLog("Kernel timestamps not available on " + name,LOG_WARN);
+        }
+
+        if(!bus->rx->isRunning() && !bus->rx->start()){
+            _logs->addLog("Failed to start the CAN reception thread of " + name,LOG_ERR);
             return false;
         }
-    }else{
-        _logs->addLog("CANbus already initialized",LOG_WARN);
-    }
 
-    // can frame to list the connected can nodes
-    struct can_frame msg_scan;
-    msg_scan.can_id  = 0x000;
-    msg_scan.can_dlc = 2;
-    msg_scan.data[0] = 0x81;
-    msg_scan.data[1] = 0x00;
+        // we drop the boot-up frames received before the scan
+        std::vector<CanRxFrame> stale;
+        bus->nmtBox.drain(stale);
+    }
 
-    if(_can->SendMsg(msg_scan, 0, 0, errorCode)){
-        _logs->addLog(canFrame2QString(msg_scan), LOG_CAN);
-    }else{
-        _logs->addLog("Failed to send the request", LOG_ERR);
+    // NMT reset to list the connected can nodes, sent on every bus before waiting, so the buses answer in parallel
+    if(!sendNmt(NMT_RESET_NODE, 0)){
         return false;
     }
+    for(int i=0; i<128; i++){
+        _pdoEnabled[i] = false; // the reset restores the default mapping of the nodes
+    }
 
-    bool m1found = false;
-    bool m2found = false;
+    for(unsigned int i=0; i<_buses.size(); i++){
+        CanBus* bus = _buses[i];
+        if(!bus->can->isInitialized()) continue;
+        std::vector<bool> found(bus->nodes.size(), false);
 
-    struct can_frame msg_rcvd;
-    bool extended, rtr, error;
-    bool brcvd;
-    QTime mytimer; // to handle the watch dog
-    mytimer.start();
-    int nbms = 0;
-    do{
-        mytimer.restart(); // restart the watch after each can message received
+        struct can_frame msg_rcvd;
+        CanRxFrame rx;
+        bool brcvd;
         do{
-            brcvd = _can->GetMsg(msg_rcvd, extended, rtr, error, errorCode);
-            nbms = mytimer.elapsed();
-        }while((!brcvd) && (nbms < WATCHDOG_MS)); // we loop until we get a can message or the watchdog is over
-
-        if(brcvd){
-            // if we received a CAN message
-            _logs->addLog(canFrame2QString(msg_rcvd), LOG_CAN);
-            if((msg_rcvd.can_id) - 0x700 == ID_MIRROR_1){ // we check if it is a controller that indicated it is up
-                m1found = true;
-            }else if((msg_rcvd.can_id) - 0x700 == ID_MIRROR_2){
-                m2found = true;
-            }else{
-                _logs->addLog("unexpexted can node!", LOG_ERR);
+            // the watchdog restarts after each can message received
+            brcvd = bus->nmtBox.wait(rx, WATCHDOG_MS);
+            msg_rcvd = rx.frame;
+
+            if(brcvd){
+                // if we received a CAN message
+                _logs->addLog(canFrame2QString(msg_rcvd), LOG_CAN);
+                // we check if it is a controller of this bus that indicated it is up
+                std::vector<unsigned char>::iterator it = std::find(bus->nodes.begin(), bus->nodes.end(), msg_rcvd.can_id - 0x700);
+                if(it != bus->nodes.end()){
+                    found[it - bus->nodes.begin()] = true;
+                }else{
+                    // a node of another machine part sharing the bus: not driven by us
+                    _logs->addLog(QString("Node ") + QString::number(msg_rcvd.can_id - 0x700) + " on " + bus->interfaceName.c_str() + " is not an axis, ignored", LOG_WARN);
+                }
+            }
+        }while(brcvd);
+
+        for(unsigned int j=0; j<bus->nodes.size(); j++){
+            if(!found[j]){
+                _logs->addLog(QString("Node ")+ QString::number(bus->nodes[j])+" has not been found on " + bus->interfaceName.c_str(), LOG_ERR);
                 return false;
             }
         }
-    }while(brcvd);
-
-    if(!m1found){
-        _logs->addLog(QString("Mirror ")+ QString::number(ID_MIRROR_1)+" has not been found", LOG_ERR);
-        return false;
-    }
-    if(!m2found){
-        _logs->addLog(QString("Mirror ")+ QString::number(ID_MIRROR_2)+" has not been found", LOG_ERR);
-        return false;
     }
 
     _logs->addLog("Connexion OK");
@@ -389,50 +1794,88 @@ bool Motor_CANOpen_Driver::connect(){
 
 bool Motor_CANOpen_Driver::configureNode(unsigned char nodeid){
     //function to configure a node into the state ENABLE and the mode Profile Position
-    bool end = false;
-    int state;
-    uint16_t controlword = 0;
+    std::vector<unsigned char> nodes(1, nodeid);
+    return configureNodes(nodes);
+}
+
+bool Motor_CANOpen_Driver::configureNodes(const std::vector<unsigned char>& nodes){
+    // function to configure several nodes into the state ENABLE and the mode Profile Position
+    // the nodes go through the state machine at the same time (one SDO transaction in progress per node)
+    unsigned int n = nodes.size();
+    std::vector<uint16_t> controlword(n, 0);
+    std::vector<uint16_t> statusword(n, 0);
+    std::vector<bool> enabled(n, false);
+    std::vector<int64_t> written(n, 0); // when the controlword of a PDO node was last written, 0 if not yet
+    std::vector<uint16_t> expected(n, 0); // state asked by that write (bits 0-6 of the statusword)
 
     // configure the state
-    while(!end){
-        //get the state:
-        uint16_t statusword;
-        if(!readRegister(REG_STATUSWORD, nodeid, &statusword, sizeof(statusword))){
+    while(true){
+        if(std::find(enabled.begin(), enabled.end(), false) == enabled.end()) break;
+
+        //get the state of the nodes not enabled yet:
+        // the statusword of a PDO node is in the cache fed by its TPDO, which still holds the state from before the
+        // controlword write: it is taken from a TPDO showing the state asked by the write, or read over SDO if none comes
+        std::vector<SdoTransfer> reads;
+        for(unsigned int i=0; i<n; i++){
+            if(enabled[i]) continue;
+            if(written[i] != 0){
+                if(waitPdoStatus(nodes[i], 0x007F, expected[i], written[i], TPDO_STATUS_TIMEOUT_MS)){
+                    statusword[i] = getPdoStatus(nodes[i]).statusword;
+                    continue;
+                }
+                _odCache.invalidateDriveOwned(nodes[i]);
+            }
+            reads.push_back(SdoTransfer::makeRead(nodes[i], REG_STATUSWORD, &statusword[i], sizeof(statusword[i])));
+        }
+        if(!reads.empty() && !sdoTransfers(reads)){
             _logs->addLog("Fail to read the control word", LOG_ERR);
             return false;
         }
-        state = getStateFromStatusWord(statusword);
 
-        switch (state) { // according to the current state we modify the control word to change it if needed
-        case STATE_DISABLED: // STOP to go to state READY
-            controlword = ((controlword & 0xFF7E) | 0x06); // 0xxx x110
-            break;
-        case STATE_READY: // SWITCH ON to go to state SWITCH ON
-            controlword = ((controlword & 0xFF7F) | 0x07); // 0xxx x111
-            break;
-        case STATE_SWITCHEDON: // ENABLE OPERATION to go to state ENABLE
-            controlword = ((controlword & 0xFF7F) | 0x0F); // 0xxx 1111
-            break;
-        case STATE_ENABLED:
-            end = true;
-            break;
-        default:
-            _logs->addLog("Error regarding the state", LOG_ERR);
-            return false;
-        }
-        if(!end){
-            controlword = controlword | 0x0100; // set bit 8 to 1, to pause it
-            // we update the controlword in the controller
-            if(!setRegister(REG_CTRLWORD, nodeid, &controlword, sizeof(controlword))){
-                _logs->addLog("Fail to set the control word! - configureNode", LOG_ERR);
+        std::vector<SdoTransfer> writes;
+        for(unsigned int i=0; i<n; i++){
+            if(enabled[i]) continue;
+            switch (getStateFromStatusWord(statusword[i])) { // according to the current state we modify the control word to change it if needed
+            case STATE_DISABLED: // STOP to go to state READY
+                controlword[i] = ((controlword[i] & 0xFF7E) | 0x06); // 0xxx x110
+                expected[i] = 0x31;
+                break;
+            case STATE_READY: // SWITCH ON to go to state SWITCH ON
+                controlword[i] = ((controlword[i] & 0xFF7F) | 0x07); // 0xxx x111
+                expected[i] = 0x33;
+                break;
+            case STATE_SWITCHEDON: // ENABLE OPERATION to go to state ENABLE
+                controlword[i] = ((controlword[i] & 0xFF7F) | 0x0F); // 0xxx 1111
+                expected[i] = 0x37;
+                break;
+            case STATE_ENABLED:
+                enabled[i] = true;
+                continue;
+            default:
+                _logs->addLog("Error regarding the state of node " + QString::number(nodes[i]), LOG_ERR);
                 return false;
             }
+            controlword[i] = controlword[i] | 0x0100; // set bit 8 to 1, to pause it
+            // we update the controlword in the controller
+            writes.push_back(SdoTransfer::makeWrite(nodes[i], REG_CTRLWORD, &controlword[i], sizeof(controlword[i])));
+        }
+        int64_t now = nowNs(); // the drive may send its TPDO before answering the SDO write
+        if(!writes.empty() && !sdoTransfers(writes)){
+            _logs->addLog("Fail to set the control word! - configureNode", LOG_ERR);
+            return false;
+        }
+        for(unsigned int i=0; i<n; i++){
+            if(!enabled[i] && isPdoEnabled(nodes[i])) written[i] = now;
         }
     }
 
     //configure the mode
     int8_t mode = MODE_PPOS;
-    if(!setRegister(REG_OPMODE, nodeid, &mode, sizeof(mode))){
+    std::vector<SdoTransfer> writes;
+    for(unsigned int i=0; i<n; i++){
+        writes.push_back(SdoTransfer::makeWrite(nodes[i], REG_OPMODE, &mode, sizeof(mode)));
+    }
+    if(!sdoTransfers(writes)){
         _logs->addLog("Fail to set the operation mode register", LOG_ERR);
         return false;
     }
@@ -442,20 +1885,63 @@ bool Motor_CANOpen_Driver::configureNode(unsigned char nodeid){
 
 void Motor_CANOpen_Driver::configureMirrors(){
     // slot connected to the button configure,
-    // function that calls configureNode() for both controller
+    // function that configures every axis at the same time
+
+    std::vector<unsigned char> mirrors = getAxisNodes();
+
+    // PDO fast path for the positioning if the nodes accept the mapping, SDO otherwise
+    enablePdoPositioning(mirrors);
 
-    QString txt = "Error configuring the node ";
-    if(!configureNode(ID_MIRROR_1)){
-        _logs->addLog(txt+QString::number(ID_MIRROR_1), LOG_ERR);
+    // loss of a drive detected from its heartbeat, without polling
+    configureHeartbeat(mirrors, HEARTBEAT_PERIOD_MS);
+
+    if(!configureNodes(mirrors)){
+        _logs->addLog("Error configuring the axes", LOG_ERR);
         return;
     }
-    _logs->addLog("Mirror "+ QString::number(ID_MIRROR_1) + " configured");
 
-    if(!configureNode(ID_MIRROR_2)){
-        _logs->addLog(txt+QString::number(ID_MIRROR_2), LOG_ERR);
+    // the drives may still have the synchronized profiles of the previous configuration
+    if(!restoreProfiles()){
+        _logs->addLog("The profiles of the previous configuration could not be restored", LOG_WARN);
+    }
+
+    // profile parameters of the table, the ones set to 0 are left to the drive
+    std::vector<SdoTransfer> profiles;
+    for(unsigned int i=0; i<_axes.size(); i++){
+        const AxisConfig& axis = _axes[i];
+        if(axis.profileVelocity) profiles.push_back(SdoTransfer::makeWrite(axis.nodeid, REG_PPOS_PVEL, &axis.profileVelocity, sizeof(axis.profileVelocity)));
+        if(axis.profileAcceleration) profiles.push_back(SdoTransfer::makeWrite(axis.nodeid, REG_PVEL_PACC, &axis.profileAcceleration, sizeof(axis.profileAcceleration)));
+        if(axis.profileDeceleration) profiles.push_back(SdoTransfer::makeWrite(axis.nodeid, REG_PVEL_PDEC, &axis.profileDeceleration, sizeof(axis.profileDeceleration)));
+    }
+    if(!profiles.empty() && !sdoTransfers(profiles)){
+        _logs->addLog("Fail to set the profile parameters", LOG_ERR);
         return;
     }
-    _logs->addLog("Mirror "+ QString::number(ID_MIRROR_2) + " configured");
+
+    // limits of the synchronized profiles of go2positions, read from the drives: the cache may hold a synchronized profile
+    _profileLimits.clear();
+    for(unsigned int i=0; i<_axes.size(); i++){
+        _odCache.invalidate(_axes[i].nodeid, REG_PPOS_PVEL, 0);
+        _odCache.invalidate(_axes[i].nodeid, REG_PVEL_MAXPVEL, 0);
+        _odCache.invalidate(_axes[i].nodeid, REG_PVEL_PACC, 0);
+        _odCache.invalidate(_axes[i].nodeid, REG_PVEL_PDEC, 0);
+    }
+    std::vector<uint32_t> values;
+    std::vector<AxisDynamics> limits;
+    if(readProfiles(_axes.size(), values, limits)){
+        _profileLimits = limits;
+        for(unsigned int i=0; i<_axes.size(); i++){
+            uint8_t nodeid = _axes[i].nodeid & 0x7F;
+            _profileParameters[nodeid][0] = values[4*i];
+            _profileParameters[nodeid][1] = values[4*i+2];
+            _profileParameters[nodeid][2] = values[4*i+3];
+            _profileKnown[nodeid] = true;
+        }
+    }
+
+    for(unsigned int i=0; i<_axes.size(); i++){
+        _logs->addLog(_axes[i].name + " configured");
+    }
 
     // update the User Interface
     addStates2logs();
@@ -465,6 +1951,12 @@ bool Motor_CANOpen_Driver::isarrived(uint32_t nodeid){
     // function to test if the motor has reached its position according to the target position
     // nodeid: the id of the controller to the corresponding motor
 
+    // with the PDO fast path, the last statusword sent by the node is enough
+    if(isPdoEnabled(nodeid)){
+        PdoStatus status = getPdoStatus(nodeid);
+        if(status.timestamp != 0) return (status.statusword & 0x0400) != 0;
+    }
+
     // get the state
     uint16_t statusword;
     if(!readRegister(REG_STATUSWORD, nodeid, &statusword, sizeof(statusword),0,false)){
@@ -478,46 +1970,568 @@ bool Motor_CANOpen_Driver::isarrived(uint32_t nodeid){
     }else return false; // the motor has not reached its positon yet
 }
 
+bool Motor_CANOpen_Driver::waitMoveDone(const std::vector<uint32_t>& nodes, const std::vector<int64_t>& acked, int timeoutMs, std::vector<AxisMoveStatus>& status){
+    unsigned int n = nodes.size();
+    status.resize(n);
+    for(unsigned int i=0; i<n; i++){
+        status[i].nodeid = nodes[i];
+        status[i].result = MOVE_PENDING;
+        status[i].statusword = 0;
+        status[i].arrivalNs = -1;
+    }
+    int64_t deadline = monotonicNs() + (int64_t)timeoutMs * 1000000LL;
+    int pollUs = MOVE_POLL_MIN_US;
+    std::vector<int64_t> seen(n, 0); // timestamp of the last TPDO looked at, for the PDO axes
+
+    while(true){
+        // statusword of each axis still moving: the last TPDO received after the acknowledge, or an SDO read
+        std::vector<uint16_t> statusword(n, 0);
+        std::vector<int64_t> received(n, 0);
+        std::vector<bool> known(n, false);
+        std::vector<SdoTransfer> reads;
+        std::vector<unsigned int> readAxis;
+        bool polling = false;
+        for(unsigned int i=0; i<n; i++){
+            if(status[i].result != MOVE_PENDING) continue;
+            if(isPdoEnabled(nodes[i])){
+                PdoStatus pdo = getPdoStatus(nodes[i]);
+                seen[i] = pdo.timestamp;
+                if(pdo.timestamp > acked[i]){
+                    statusword[i] = pdo.statusword;
+                    received[i] = pdo.timestamp;
+                    known[i] = true;
+                }
+            }else{
+                polling = true;
+                reads.push_back(SdoTransfer::makeRead(nodes[i], REG_STATUSWORD, &statusword[i], sizeof(statusword[i])));
+                readAxis.push_back(i);
+            }
+        }
+        if(!reads.empty()){
+            sdoTransfers(reads, false);
+            int64_t now = nowNs();
+            for(unsigned int j=0; j<reads.size(); j++){
+                if(!reads[j].done) continue; // retried at the next round, the heartbeat tells if the node is gone
+                known[readAxis[j]] = true;
+                received[readAxis[j]] = now;
+            }
+        }
+
+        bool pending = false;
+        for(unsigned int i=0; i<n; i++){
+            if(status[i].result != MOVE_PENDING) continue;
+            NodeStatus node = _nodeMonitor.getStatus(nodes[i]);
+            if(node.watched && !node.alive){
+                status[i].result = MOVE_LOST;
+                continue;
+            }
+            if(!known[i]){
+                pending = true;
+                continue;
+            }
+            status[i].statusword = statusword[i];
+            if(statusword[i] & 0x0008){
+                status[i].result = MOVE_FAULT;
+            }else if(statusword[i] & 0x2000){
+                status[i].result = MOVE_FOLLOWING_ERROR;
+            }else if(statusword[i] & 0x0400){
+                // the set point was acknowledged before: bit 10 is about the new target, even once bit 12 is released
+                status[i].result = MOVE_REACHED;
+                status[i].arrivalNs = received[i] - acked[i];
+            }else{
+                pending = true;
+            }
+        }
+
+        bool failed = false;
+        for(unsigned int i=0; i<n; i++){
+            if(status[i].result != MOVE_PENDING && status[i].result != MOVE_REACHED) failed = true;
+        }
+        if(!pending || failed) break;
+
+        int64_t left = deadline - monotonicNs();
+        if(left <= 0){
+            for(unsigned int i=0; i<n; i++){
+                if(status[i].result == MOVE_PENDING) status[i].result = MOVE_TIMEOUT;
+            }
+            break;
+        }
+
+        if(polling){
+            // adaptive backoff: short moves are seen quickly, long ones do not load the bus
+            usleep(std::min<int64_t>(pollUs, left / 1000));
+            pollUs = std::min(pollUs * 2, MOVE_POLL_MAX_US);
+        }else{
+            // only PDO axes: sleep until one of them sends a new statusword (the watchdog checks the heartbeats)
+            std::unique_lock<std::mutex> lock(_pdoMutex);
+            _pdoCond.wait_for(lock, std::chrono::nanoseconds(std::min<int64_t>(left, (int64_t)WATCHDOG_MS * 1000000LL)), [&]{
+                for(unsigned int i=0; i<n; i++){
+                    if(status[i].result == MOVE_PENDING && _pdoStatus[nodes[i] & 0x7F].timestamp != seen[i]) return true;
+                }
+                return false;
+            });
+        }
+    }
+
+    // telemetry: settling time of the slowest axis
+    bool ok = true;
+    int64_t settle = 0;
+    for(unsigned int i=0; i<n; i++){
+        if(status[i].result != MOVE_REACHED) ok = false;
+        else settle = std::max(settle, status[i].arrivalNs);
+    }
+    std::lock_guard<std::mutex> lock(_moveMutex);
+    _lastMove = status;
+    if(!ok){
+        _moveTelemetry.failures++;
+        return false;
+    }
+    if(_moveTelemetry.count == 0 || settle < _moveTelemetry.minNs) _moveTelemetry.minNs = settle;
+    if(settle > _moveTelemetry.maxNs) _moveTelemetry.maxNs = settle;
+    _moveTelemetry.lastNs = settle;
+    _moveTelemetry.sumNs += settle;
+    _moveTelemetry.count++;
+    return true;
+}
+
+std::vector<AxisMoveStatus> Motor_CANOpen_Driver::getLastMove(){
+    std::lock_guard<std::mutex> lock(_moveMutex);
+    return _lastMove;
+}
+
+MoveTelemetry Motor_CANOpen_Driver::getMoveTelemetry(){
+    std::lock_guard<std::mutex> lock(_moveMutex);
+    return _moveTelemetry;
+}
+
+void Motor_CANOpen_Driver::resetMoveTelemetry(){
+    std::lock_guard<std::mutex> lock(_moveMutex);
+    memset(&_moveTelemetry, 0, sizeof(_moveTelemetry));
+}
+
+QString Motor_CANOpen_Driver::moveResult2QString(MoveResult result){
+    // function that convert the result of a move to a QString for display purpose
+    switch(result){
+    case MOVE_PENDING: return "Moving";
+    case MOVE_REACHED: return "Target reached";
+    case MOVE_FOLLOWING_ERROR: return "Following error";
+    case MOVE_FAULT: return "Fault";
+    case MOVE_LOST: return "Node lost";
+    case MOVE_TIMEOUT: return "Timeout";
+    default: return "Not a valid result";
+    }
+}
+
+bool Motor_CANOpen_Driver::reportMove(const std::vector<AxisMoveStatus>& status){
+    // function to log the axes that did not reach their target, and the settling time of the move
+    bool ok = true;
+    for(unsigned int i=0; i<status.size(); i++){
+        if(status[i].result == MOVE_REACHED) continue;
+        _logs->addLog(_axes[getAxisOfNode(status[i].nodeid)].name + " did not reach its position: " + moveResult2QString(status[i].result)
+                      + " (statusword 0x" + QString::number(status[i].statusword, 16) + ")", LOG_ERR);
+        ok = false;
+    }
+    if(ok) _logs->addLog(QString("Mirrors arrived in ") + QString::number(getMoveTelemetry().lastNs / 1000) + "us", LOG_INFO);
+    return ok;
+}
+
 bool Motor_CANOpen_Driver::go2position_angle(int phi1, int phi2){
-    // we get the current controlword, in order not to have to ask for them each time we update a position
-    uint16_t controlword1;
-    if(!readRegister(REG_CTRLWORD, ID_MIRROR_1, &controlword1, sizeof(controlword1)),false){
-        _logs->addLog(QString("Fail to read the control word of mirror ")+QString::number(ID_MIRROR_1), LOG_ERR);
+    std::vector<int32_t> angles;
+    angles.push_back(phi1);
+    angles.push_back(phi2);
+    return go2positions(angles);
+}
+
+bool Motor_CANOpen_Driver::getAngles(std::vector<int32_t>& angles, unsigned int count){
+    if(count > _axes.size()) return false;
+    std::vector<int32_t> position(count);
+    std::vector<SdoTransfer> reads;
+    for(unsigned int i=0; i<count; i++){
+        reads.push_back(SdoTransfer::makeRead(_axes[i].nodeid, REG_PPOS_ACPO2, &position[i], sizeof(position[i])));
+    }
+    if(!sdoTransfers(reads, false)){
+        _logs->addLog("Fail to read the position of the mirrors", LOG_ERR);
+        return false;
+    }
+    angles.resize(count);
+    for(unsigned int i=0; i<count; i++){
+        angles[i] = position[i] - _axes[i].offset;
+    }
+    return true;
+}
+
+bool Motor_CANOpen_Driver::getAxisDynamics(std::vector<AxisDynamics>& dynamics, unsigned int count){
+    if(count > _axes.size()) return false;
+    if(_syncProfiles && count <= _profileLimits.size()){
+        dynamics.assign(_profileLimits.begin(), _profileLimits.begin() + count);
+        return true;
+    }
+    std::vector<uint32_t> values;
+    return readProfiles(count, values, dynamics);
+}
+
+bool Motor_CANOpen_Driver::readProfiles(unsigned int count, std::vector<uint32_t>& values, std::vector<AxisDynamics>& dynamics){
+    // function to read the profile velocity, max profile velocity, acceleration and deceleration of the first count axes
+    // (4 values per axis), and the profile they give
+    values.assign(4 * count, 0);
+    std::vector<SdoTransfer> reads;
+    for(unsigned int i=0; i<count; i++){
+        reads.push_back(SdoTransfer::makeRead(_axes[i].nodeid, REG_PPOS_PVEL, &values[4*i], sizeof(uint32_t)));
+        reads.push_back(SdoTransfer::makeRead(_axes[i].nodeid, REG_PVEL_MAXPVEL, &values[4*i+1], sizeof(uint32_t)));
+        reads.push_back(SdoTransfer::makeRead(_axes[i].nodeid, REG_PVEL_PACC, &values[4*i+2], sizeof(uint32_t)));
+        reads.push_back(SdoTransfer::makeRead(_axes[i].nodeid, REG_PVEL_PDEC, &values[4*i+3], sizeof(uint32_t)));
+    }
+    if(!sdoTransfers(reads, false)){
+        _logs->addLog("Fail to read the profile parameters of the mirrors", LOG_ERR);
         return false;
     }
-    uint16_t controlword2;
-    if(!readRegister(REG_CTRLWORD, ID_MIRROR_2, &controlword2, sizeof(controlword2)),false){
-        _logs->addLog(QString("Fail to read the control word of mirror ")+QString::number(ID_MIRROR_2), LOG_ERR);
+    dynamics.resize(count);
+    for(unsigned int i=0; i<count; i++){
+        // the drive limits the profile velocity to the max profile velocity (0: no limit)
+        uint32_t velocity = values[4*i];
+        if(values[4*i+1] != 0 && values[4*i+1] < velocity) velocity = values[4*i+1];
+        dynamics[i].velocity = velocity;
+        dynamics[i].acceleration = values[4*i+2];
+        dynamics[i].deceleration = values[4*i+3];
+    }
+    return true;
+}
+
+bool Motor_CANOpen_Driver::go2positions(const std::vector<int32_t>& angles){
+    std::vector<uint32_t> mirrors;
+    std::vector<int32_t> tpos;
+    if(!axisTargets(angles, mirrors, tpos)) return false;
+    unsigned int n = mirrors.size();
+    bool allCsp = _cspRunning;
+    for(unsigned int i=0; i<n; i++){
+        allCsp = allCsp && isCspAxis(mirrors[i]);
+    }
+
+    if(allCsp){
+        // cyclic synchronous position: every axis follows a trajectory of the same duration, so they arrive together
+        double duration = 0;
+        {
+            std::lock_guard<std::mutex> lock(_cspMutex);
+            for(unsigned int i=0; i<_cspAxes.size(); i++){
+                for(unsigned int j=0; j<n; j++){
+                    if(_cspAxes[i].nodeid != mirrors[j]) continue;
+                    duration = std::max(duration, AxisTrajectory::minimumDuration(_cspAxes[i].setpoint, tpos[j], _cspSpeed));
+                }
+            }
+        }
+        for(unsigned int i=0; i<n; i++){
+            if(!cspMoveTo(mirrors[i], tpos[i], duration)) return false;
+        }
+        if(!cspWaitIdle((int)(duration * 1000) + MOVE_TIMEOUT_MS)){
+            _logs->addLog("The mirrors did not reach their position", LOG_ERR);
+            return false;
+        }
+        return true;
+    }
+
+    if(_syncProfiles && !writeSyncProfiles(mirrors, tpos)){
+        _logs->addLog("The mirrors move with their previous profiles", LOG_WARN);
+    }
+
+    // profile position: the set points are taken at once (through the RPDO when every axis has them, by SDO otherwise),
+    // the handshake is over before the mirrors arrive, so the next target can be given as soon as they are there
+    if(!giveTargets(angles, true)) return false;
+    _logs->addLog(QString("Waiting for the mirrors to arrived"), LOG_INFO);
+    return waitTargetsDone(MOVE_TIMEOUT_MS);
+}
+
+bool Motor_CANOpen_Driver::writeSyncProfiles(const std::vector<uint32_t>& nodes, const std::vector<int32_t>& tpos){
+    // function to write the profiles that make the axes arrive together at tpos, only the parameters that changed
+    unsigned int n = nodes.size();
+    if(n > _profileLimits.size()) return true; // not configured yet: the profiles of the drives are kept
+
+    std::vector<int32_t> angles;
+    if(!getAngles(angles, n)) return false;
+    std::vector<double> distances(n);
+    std::vector<AxisDynamics> limits(_profileLimits.begin(), _profileLimits.begin() + n);
+    for(unsigned int i=0; i<n; i++){
+        distances[i] = (double)tpos[i] - (double)(angles[i] + _axes[i].offset);
+    }
+    std::vector<AxisDynamics> profiles;
+    AxisTrajectory::synchronize(distances, limits, profiles);
+
+    std::vector<uint32_t> values(3 * n);
+    std::vector<SdoTransfer> writes;
+    for(unsigned int i=0; i<n; i++){
+        if(profiles[i].velocity <= 0) continue; // the axis does not move, its profile does not matter
+        const uint16_t regs[3] = {REG_PPOS_PVEL, REG_PVEL_PACC, REG_PVEL_PDEC};
+        const double planned[3] = {profiles[i].velocity, profiles[i].acceleration, profiles[i].deceleration};
+        for(int j=0; j<3; j++){
+            if(planned[j] <= 0) continue; // no limit known: the value of the drive is kept
+            uint32_t& value = values[3*i+j];
+            value = std::max(1.0, floor(planned[j])); // rounded down: the limits are never exceeded
+            uint32_t current;
+            if(_odCache.get(nodes[i], regs[j], current) && fabs((double)current - value) <= PROFILE_TOLERANCE * value) continue;
+            writes.push_back(SdoTransfer::makeWrite(nodes[i], regs[j], &value, sizeof(value)));
+        }
+    }
+    if(writes.empty()) return true;
+    _profilesChanged = true;
+    if(!sdoTransfers(writes, false)){
+        _logs->addLog("Fail to write the profiles of the mirrors", LOG_ERR);
         return false;
     }
+    return true;
+}
 
-    if(!setPosition(ID_MIRROR_1, OFFCET_MIRROR_1 + phi1, controlword1)){
-        _logs->addLog(QString("Fail to set position of mirror ")+QString::number(ID_MIRROR_1), LOG_ERR);
+bool Motor_CANOpen_Driver::restoreProfiles(){
+    // function to write back the profile parameters read at the configuration, in place of the synchronized ones
+    if(!_profilesChanged) return true;
+
+    const uint16_t regs[3] = {REG_PPOS_PVEL, REG_PVEL_PACC, REG_PVEL_PDEC};
+    std::vector<SdoTransfer> writes;
+    for(unsigned int nodeid=0; nodeid<128; nodeid++){
+        if(!_profileKnown[nodeid]) continue;
+        for(int j=0; j<3; j++){
+            uint32_t current;
+            if(_odCache.get(nodeid, regs[j], current) && current == _profileParameters[nodeid][j]) continue;
+            writes.push_back(SdoTransfer::makeWrite(nodeid, regs[j], &_profileParameters[nodeid][j], sizeof(uint32_t)));
+        }
+    }
+    if(!writes.empty() && !sdoTransfers(writes, false)){
+        _logs->addLog("Fail to restore the profiles of the mirrors", LOG_ERR);
         return false;
     }
-    if(!setPosition(ID_MIRROR_2, OFFCET_MIRROR_2 + phi2, controlword2)){
-        _logs->addLog(QString("Fail to set position of mirror ")+QString::number(ID_MIRROR_1), LOG_ERR);
+    _profilesChanged = false;
+    return true;
+}
+
+void Motor_CANOpen_Driver::setSynchronizedProfiles(bool enabled){
+    _syncProfiles = enabled;
+    if(!enabled) restoreProfiles();
+}
+
+bool Motor_CANOpen_Driver::axisTargets(const std::vector<int32_t>& angles, std::vector<uint32_t>& nodes, std::vector<int32_t>& tpos){
+    // function to get the nodes and the target positions of the first angles.size() axes, after checking their limits
+    unsigned int n = angles.size();
+    if(n > _axes.size()){
+        _logs->addLog(QString("Only ") + QString::number(_axes.size()) + " axes configured", LOG_ERR);
         return false;
     }
-    _logs->addLog(QString("Waiting for the mirrors to arrived"), LOG_INFO);
+    nodes.resize(n);
+    tpos.resize(n);
+    for(unsigned int i=0; i<n; i++){
+        if(!_axes[i].isAllowed(angles[i])){
+            _logs->addLog(QString("Target ") + QString::number(angles[i]) + " of " + _axes[i].name + " out of its limits", LOG_ERR);
+            return false;
+        }
+        nodes[i] = _axes[i].nodeid;
+        tpos[i] = _axes[i].offset + angles[i];
+    }
+    return true;
+}
+
+bool Motor_CANOpen_Driver::waitStatuswords(const std::vector<uint32_t>& nodes, uint16_t mask, uint16_t value, int64_t after, int timeoutMs, std::vector<int64_t>& received){
+    // function to wait for (statusword & mask) == value on several nodes
+    // the PDO nodes are woken up by their TPDO received after the time after, the others are polled like in waitMoveDone
+    // received: when the statusword was seen on each node, 0 if it was not
+    unsigned int n = nodes.size();
+    received.assign(n, 0);
+    int64_t deadline = monotonicNs() + (int64_t)timeoutMs * 1000000LL;
+    int pollUs = MOVE_POLL_MIN_US;
+    bool ok = true;
+    for(unsigned int i=0; i<n; i++){
+        if(!isPdoEnabled(nodes[i])) continue;
+        int left = (int)std::max<int64_t>(0, (deadline - monotonicNs()) / 1000000LL);
+        if(!waitPdoStatus(nodes[i], mask, value, after, left, &received[i])) ok = false;
+    }
+    while(true){
+        std::vector<uint16_t> statusword(n, 0);
+        std::vector<SdoTransfer> reads;
+        std::vector<unsigned int> readAxis;
+        for(unsigned int i=0; i<n; i++){
+            if(isPdoEnabled(nodes[i]) || received[i] != 0) continue;
+            reads.push_back(SdoTransfer::makeRead(nodes[i], REG_STATUSWORD, &statusword[i], sizeof(statusword[i])));
+            readAxis.push_back(i);
+        }
+        if(reads.empty()) return ok;
+        sdoTransfers(reads, false);
+        int64_t now = nowNs();
+        for(unsigned int j=0; j<reads.size(); j++){
+            if(reads[j].done && (statusword[readAxis[j]] & mask) == value) received[readAxis[j]] = now;
+        }
+        int64_t left = deadline - monotonicNs();
+        if(left <= 0){
+            for(unsigned int i=0; i<n; i++){
+                if(!isPdoEnabled(nodes[i]) && received[i] == 0) ok = false;
+            }
+            return ok;
+        }
+        usleep(std::min<int64_t>(pollUs, left / 1000));
+        pollUs = std::min(pollUs * 2, MOVE_POLL_MAX_US);
+    }
+}
+
+bool Motor_CANOpen_Driver::sendSetPoints(const std::vector<uint32_t>& nodes, const std::vector<int32_t>& tpos, bool immediate, std::vector<int64_t>& acked){
+    unsigned int n = nodes.size();
+    acked.assign(n, 0);
+    bool allPdo = true;
+    for(unsigned int i=0; i<n; i++){
+        allPdo = allPdo && isPdoEnabled(nodes[i]);
+    }
+
+    // current controlwords, without the bits of the set point (4, 5, 6 and 8, see addSetPosition)
+    // a set point still held by bit 4 is released first, the drive only takes a new one on the rising edge
+    std::vector<uint16_t> controlword(n);
+    if(allPdo){
+        for(unsigned int i=0; i<n; i++){
+            uint16_t current = _pdoControlword[nodes[i] & 0x7F];
+            controlword[i] = current & 0xFE8F;
+            if((current & 0x0010) && !sendRpdo(nodes[i], tpos[i], controlword[i])) return false;
+        }
+    }else{
+        // every axis is asked at the same time, and then moved at the same time
+        std::vector<SdoTransfer> reads;
+        for(unsigned int i=0; i<n; i++){
+            reads.push_back(SdoTransfer::makeRead(nodes[i], REG_CTRLWORD, &controlword[i], sizeof(controlword[i])));
+        }
+        if(!sdoTransfers(reads, false)){
+            for(unsigned int i=0; i<n; i++){
+                if(!reads[i].done) _logs->addLog(QString("Fail to read the control word of ")+_axes[getAxisOfNode(nodes[i])].name, LOG_ERR);
+            }
+            return false;
+        }
+        std::vector<SdoTransfer> releases;
+        for(unsigned int i=0; i<n; i++){
+            bool held = controlword[i] & 0x0010;
+            controlword[i] = controlword[i] & 0xFE8F;
+            if(held) releases.push_back(SdoTransfer::makeWrite(nodes[i], REG_CTRLWORD, &controlword[i], sizeof(controlword[i])));
+        }
+        if(!releases.empty() && !sdoTransfers(releases, false)){
+            _logs->addLog("Fail to release the previous set points", LOG_ERR);
+            return false;
+        }
+    }
+
+    // the drives take a new set point only when their buffer is free (bit 12 at 0):
+    // a target queued before is waited for until it is started, that is until the current one is reached
+    std::vector<int64_t> received;
+    if(!waitStatuswords(nodes, 0x1000, 0, 0, MOVE_TIMEOUT_MS, received)){
+        for(unsigned int i=0; i<n; i++){
+            if(received[i] == 0) _logs->addLog(_axes[getAxisOfNode(nodes[i])].name + " did not start its queued set point", LOG_ERR);
+        }
+        return false;
+    }
+
+    int64_t sent = nowNs();
+    if(allPdo){
+        for(unsigned int i=0; i<n; i++){
+            if(!sendRpdo(nodes[i], tpos[i], controlword[i] | (immediate ? 0x0030 : 0x0010))){
+                _logs->addLog(QString("Fail to set position of ")+_axes[getAxisOfNode(nodes[i])].name, LOG_ERR);
+                return false;
+            }
+        }
+    }else{
+        std::vector<SdoTransfer> moves;
+        for(unsigned int i=0; i<n; i++){
+            addSetPosition(moves, nodes[i], tpos[i], controlword[i], immediate);
+        }
+        if(!sdoTransfers(moves, false)){
+            for(unsigned int i=0; i<n; i++){
+                if(!moves[3*i].done || !moves[3*i+1].done || !moves[3*i+2].done){
+                    _logs->addLog(QString("Fail to set position of ")+_axes[getAxisOfNode(nodes[i])].name, LOG_ERR);
+                }
+            }
+            return false;
+        }
+    }
 
-    while(!isarrived(ID_MIRROR_1) || !isarrived(ID_MIRROR_2));
+    // acknowledge of the drives (bit 12), then end of the handshake at once: bit 4 back to 0 while the axes are moving
+    bool ok = waitStatuswords(nodes, 0x1000, 0x1000, sent, WATCHDOG_MS, acked);
+    if(allPdo){
+        for(unsigned int i=0; i<n; i++){
+            sendRpdo(nodes[i], tpos[i], controlword[i]);
+        }
+    }else{
+        std::vector<SdoTransfer> releases;
+        for(unsigned int i=0; i<n; i++){
+            releases.push_back(SdoTransfer::makeWrite(nodes[i], REG_CTRLWORD, &controlword[i], sizeof(controlword[i])));
+        }
+        if(!sdoTransfers(releases, false)) _logs->addLog("Fail to release the set points", LOG_WARN);
+    }
+    if(!ok){
+        for(unsigned int i=0; i<n; i++){
+            if(acked[i] != 0) continue;
+            QString log = QString("Set point of ")+_axes[getAxisOfNode(nodes[i])].name+" not acknowledged";
+            if(isPdoEnabled(nodes[i])) log += " (statusword 0x" + QString::number(getPdoStatus(nodes[i]).statusword, 16) + ")";
+            _logs->addLog(log, LOG_ERR);
+        }
+    }
+    return ok;
+}
 
+bool Motor_CANOpen_Driver::giveTargets(const std::vector<int32_t>& angles, bool immediate){
+    // function to send the set points of queueTargets/retarget, and keep their acknowledge for waitTargetsDone
+    std::vector<uint32_t> nodes;
+    std::vector<int32_t> tpos;
+    if(!axisTargets(angles, nodes, tpos)) return false;
+    if(_cspRunning){
+        for(unsigned int i=0; i<nodes.size(); i++){
+            if(!isCspAxis(nodes[i])) continue;
+            _logs->addLog(_axes[i].name + " is in cyclic synchronous position, use go2positions", LOG_ERR);
+            return false;
+        }
+    }
+    std::vector<int64_t> acked;
+    if(!sendSetPoints(nodes, tpos, immediate, acked)) return false;
+    std::lock_guard<std::mutex> lock(_moveMutex);
+    _targetNodes = nodes;
+    _targetAcked = acked;
     return true;
 }
 
+bool Motor_CANOpen_Driver::queueTargets(const std::vector<int32_t>& angles){
+    return giveTargets(angles, false);
+}
+
+bool Motor_CANOpen_Driver::retarget(const std::vector<int32_t>& angles){
+    return giveTargets(angles, true);
+}
+
+bool Motor_CANOpen_Driver::waitTargetsDone(int timeoutMs){
+    std::vector<uint32_t> nodes;
+    std::vector<int64_t> acked;
+    {
+        std::lock_guard<std::mutex> lock(_moveMutex);
+        nodes = _targetNodes;
+        acked = _targetAcked;
+    }
+    // bit 10 is only set once the buffered set points are done too
+    std::vector<AxisMoveStatus> status;
+    bool arrived = waitMoveDone(nodes, acked, timeoutMs, status);
+    return reportMove(status) && arrived;
+}
+
 
 bool Motor_CANOpen_Driver::setPosition(uint32_t nodeid, int32_t tpos, uint16_t controlword){
     //function to set the motor into the desired position
     // nodeid: the id of the corresponding controller
     // tpos: the target position
     // controlword: the current controlword (avoid to request the controlword again and again...)
+    std::vector<SdoTransfer> transfers;
+    addSetPosition(transfers, nodeid, tpos, controlword);
+    if(sdoTransfers(transfers, false)) return true;
 
-    // we set the target position
-    if(!setRegister(REG_PPOS_TPOS, nodeid, &tpos, sizeof(tpos),0,false)){
+    if(!transfers[0].done){
         _logs->addLog("Fail to set the target position", LOG_ERR);
-        return false;
+    }else{
+        _logs->addLog("Fail to set the control word!", LOG_ERR);
     }
+    return false;
+}
+
+void Motor_CANOpen_Driver::addSetPosition(std::vector<SdoTransfer>& transfers, uint32_t nodeid, int32_t tpos, uint16_t controlword, bool immediate){
+    // function to add the 3 transfers of a new target position to a list for sdoTransfers
+    // nodeid, tpos, controlword: see setPosition
+    // immediate: the set point replaces the move in progress (bit 5), otherwise it is started once the current target is reached
+
+    // we set the target position
+    transfers.push_back(SdoTransfer::makeWrite(nodeid, REG_PPOS_TPOS, &tpos, sizeof(tpos)));
 
     // bit value for the controlword (starting at 0):
     //  4 : new set point (0 not applied, 1 applied)
@@ -531,16 +2545,10 @@ bool Motor_CANOpen_Driver::setPosition(uint32_t nodeid, int32_t tpos, uint16_t c
     controlword = controlword & 0xFEFF; // set bit 8 to 0
 
     // we update the control word
-    if(!setRegister(REG_CTRLWORD, nodeid, &controlword, sizeof(controlword),0,false)){
-        _logs->addLog("Fail to set the control word!", LOG_ERR);
-        return false;
-    }
+    transfers.push_back(SdoTransfer::makeWrite(nodeid, REG_CTRLWORD, &controlword, sizeof(controlword)));
 
     controlword = controlword | 0x0010; // set bit 4 to 1
+    if(immediate) controlword = controlword | 0x0020; // set bit 5 to 1
     // reset the control word for the next command
-    if(!setRegister(REG_CTRLWORD, nodeid, &controlword, sizeof(controlword), 0, false)){
-        _logs->addLog("Fail to set the control word!", LOG_ERR);
-        return false;
-    }
-    return true;
+    transfers.push_back(SdoTransfer::makeWrite(nodeid, REG_CTRLWORD, &controlword, sizeof(controlword)));
 }
@@ -1,16 +1,24 @@
 #ifndef MOTOR_CANOPEN_DRIVER_H
 #define MOTOR_CANOPEN_DRIVER_H
 
-#include "canwrapper.h"
+#include "cantransport.h"
+#include "canreceiver.h"
+#include "cancapture.h"
+#include "canbcm.h"
+#include "trajectory.h"
+#include "odcache.h"
+#include "sdoclient.h"
+#include "ioworker.h"
+#include "nodemonitor.h"
 #include <QString>
 #include <QObject>
+#include <functional>
+#include <future>
+#include <string>
+#include <thread>
+#include <vector>
 #include "log_handler.h"
-
-#define ID_MIRROR_1 3
-#define ID_MIRROR_2 4
-
-#define OFFCET_MIRROR_1 265750
-#define OFFCET_MIRROR_2 441000
+#include "axisconfig.h"
 
 #define REG_STATUSWORD 0x6041
 #define REG_CTRLWORD 0x6040
@@ -27,33 +35,385 @@
 #define REG_PPOS_ACPO2 0x6064
 #define REG_PPOS_PVEL 0x6081
 
+#define REG_IP_SUBMODE 0x60C0
+#define REG_IP_DATA 0x60C1       // sub 1: next set point of the interpolated position mode
+#define REG_INTERP_PERIOD 0x60C2 // sub 1: value, sub 2: exponent (s)
+#define REG_IP_CONFIG 0x60C4     // sub 1: max buffer size, sub 3: buffer organization, sub 6: buffer clear
+
+#define REG_HEARTBEAT 0x1017 // producer heartbeat time (ms, 0: disabled)
+
+#define REG_RPDO_COMM 0x1400 // + pdo number (0 to 3)
+#define REG_RPDO_MAP 0x1600
+#define REG_TPDO_COMM 0x1800
+#define REG_TPDO_MAP 0x1A00
+
+#define NMT_START 0x01
+#define NMT_STOP 0x02
+#define NMT_PREOPERATIONAL 0x80
+#define NMT_RESET_NODE 0x81
+#define NMT_RESET_COMM 0x82
+
+#define PDO_MAP(index, subindex, bits) (((uint32_t)(index) << 16) | ((uint32_t)(subindex) << 8) | (bits)) // mapping entry of a PDO
+
+#define SDO_LATENCY_BUCKETS 14 // histogram bucket i counts the round trips in [16us*2^i, 16us*2^(i+1)[, bucket 0 starts at 0
+
+struct SdoLatencyStats
+{
+    unsigned long count;  // number of SDO round trips measured
+    int64_t minNs;
+    int64_t maxNs;
+    int64_t sumNs;
+    unsigned long histogram[SDO_LATENCY_BUCKETS];
+};
+
+// One expedited SDO transfer, for sdoTransfers()
+struct SdoTransfer
+{
+    uint32_t nodeid;
+    uint16_t regadd;
+    unsigned char subindex;
+    bool write;        // setRegister (true) or readRegister (false)
+    void* regval;      // read: where the value is stored
+    uint8_t value[4];  // write: the value to write
+    size_t size;       // size of the value (byte number)
+    bool done;         // set to true when the node acknowledged the transfer
+    int64_t sent;      // time at which the request was sent
+
+    static SdoTransfer makeRead(uint32_t nodeid, uint16_t regadd, void* regval, size_t size, unsigned char subindex = 0);
+    static SdoTransfer makeWrite(uint32_t nodeid, uint16_t regadd, const void* regval, size_t size, unsigned char subindex = 0);
+};
+
+// Last statusword and actual position sent by a node in its TPDO
+struct PdoStatus
+{
+    uint16_t statusword;
+    int32_t position;  // REG_PPOS_ACPO2
+    int64_t timestamp; // reception time (ns since epoch), 0 if nothing has been received yet
+};
+
+// Outcome of a move for one axis, see Motor_CANOpen_Driver::waitMoveDone
+enum MoveResult
+{
+    MOVE_PENDING,         // still moving
+    MOVE_REACHED,         // target reached (statusword bit 10) after the set point was acknowledged
+    MOVE_FOLLOWING_ERROR, // statusword bit 13
+    MOVE_FAULT,           // statusword bit 3
+    MOVE_LOST,            // no heartbeat from the node anymore
+    MOVE_TIMEOUT
+};
+
+struct AxisMoveStatus
+{
+    uint32_t nodeid;
+    MoveResult result;
+    uint16_t statusword; // last statusword received
+    int64_t arrivalNs;   // time from the acknowledge of the set point to the target reached, -1 if not reached
+};
+
+// Settling times of the moves: from the acknowledge of the set points to the last axis reaching its target
+struct MoveTelemetry
+{
+    unsigned long count;    // moves where every axis reached its target
+    unsigned long failures; // moves ended by a timeout, a fault or a lost node
+    int64_t lastNs;
+    int64_t minNs;
+    int64_t maxNs;
+    int64_t sumNs;
+};
+
+typedef std::function<void(bool ok)> DriverCallback; // completion of an asynchronous call (see Motor_CANOpen_Driver::runAsync)
+
+// One CAN interface of the machine and the nodes on it
+struct CanBus
+{
+    std::string interfaceName;        // can0, vcan0, loop0...
+    CanTransport *can;
+    bool ownCan;                      // can has been created by the driver and is deleted with it
+    CanReceiver *rx;                  // reception threads of the bus, posting into the driver mailboxes
+    CanMailbox nmtBox;                // boot-up and heartbeat frames of the bus
+    CanBcm *bcm;                      // cyclic frames sent by the kernel, opened at the first use
+    std::vector<unsigned char> nodes; // the nodes expected on the bus by connect()
+};
 
 class Motor_CANOpen_Driver
 {
 
 public:
-    Motor_CANOpen_Driver(Log_handler* logs);
+    Motor_CANOpen_Driver(Log_handler* logs, const char* interfaceName = "can0");
+    Motor_CANOpen_Driver(Log_handler* logs, CanTransport* transport, const char* interfaceName);
+    ~Motor_CANOpen_Driver();
+
+    int addBus(const char* interfaceName, const std::vector<unsigned char>& nodes, CanTransport* transport = NULL);
+    // function to add a CAN interface, to be called before connect()
+    // nodes: the node ids on this bus (moved from the bus they were on, if any)
+    // transport: NULL to create it from the interface name, otherwise it is not deleted by the driver
+    // return the index of the bus
+
+    bool loadAxisConfig(const char* path = AXIS_CONFIG_FILE);
+    // function to read the axis table from an ini file (see loadAxes), to be called before connect()
+    // without the file, the two mirrors of the macros are kept
+    void setAxes(const std::vector<AxisConfig>& axes); // function to replace the axis table, the nodes are moved to the bus of their axis
+    int getAxisCount() const { return _axes.size(); }
+    const AxisConfig& getAxis(int axis) const { return _axes[axis]; }
+    const std::vector<AxisConfig>& getAxes() const { return _axes; }
+    std::vector<unsigned char> getAxisNodes() const;
+    int getAxisOfNode(uint32_t nodeid) const; // index of the axis of a node, -1 if the node is not an axis
+
+    bool startSimulation(const VirtualDriveConfig& config, const std::string& bus = "");
+    // function to replace the drives of the axes by simulated ones (see VirtualDrive), to be called before connect()
+    // bus: interface where every axis is moved, empty to keep the bus of each axis (only vcan* and loop* are accepted)
+    void stopSimulation();
+    bool isSimulated() const { return !_simulation.empty(); }
+    VirtualDrive* getSimulatedDrive(uint32_t nodeid); // NULL if the node is not simulated
+
+    int getBusCount() const { return _buses.size(); }
+    int getBusOfNode(uint32_t nodeid) const; // index of the bus of nodeid (the first bus for an unknown node)
     bool readRegister (uint16_t regadd, uint32_t nodeid, void* regval, size_t size, unsigned char subindex=0, bool verbose=true);
     bool setRegister (uint16_t regadd, uint32_t nodeid, const void* regval, size_t size, unsigned char subindex=0, bool verbose=true);
 
+    bool readObject(uint32_t nodeid, uint16_t index, unsigned char subindex, std::vector<uint8_t>& data, bool block=false, bool verbose=true);
+    bool writeObject(uint32_t nodeid, uint16_t index, unsigned char subindex, const void* data, size_t size, bool block=false, bool verbose=true);
+    // function to transfer an object of any size (segmented SDO, or block SDO with a CRC when block is true)
+    // readRegister/setRegister use them for the registers larger than 4 bytes
+
+    bool sdoTransfers(std::vector<SdoTransfer>& transfers, bool verbose=true);
+    // function to run several SDO transfers, with one transaction in progress per node:
+    // the transfers of a node are done in the order of the list, the ones of different nodes at the same time
+    // the remaining transfers of a node are cancelled when one of them fails
+    // return true if every transfer is done (see SdoTransfer::done)
+
+    std::future<bool> runAsync(uint32_t nodeid, std::function<bool()> job, DriverCallback callback = DriverCallback());
+    // function to run a blocking job on the I/O thread of a node and return at once
+    // the jobs of a node run in the order they are posted, the ones of different nodes at the same time
+    // callback: called from the I/O thread with the result of the job, before the future gets ready
+    //   (a widget should get back to the GUI thread from it, e.g. with QMetaObject::invokeMethod(..., Qt::QueuedConnection))
+    std::future<bool> readRegisterAsync(uint16_t regadd, uint32_t nodeid, void* regval, size_t size, unsigned char subindex=0, DriverCallback callback=DriverCallback());
+    // regval: must stay valid until the future is ready
+    std::future<bool> setRegisterAsync(uint16_t regadd, uint32_t nodeid, const void* regval, size_t size, unsigned char subindex=0, DriverCallback callback=DriverCallback());
+    // regval: copied, can be released at once
+    std::future<bool> setPositionAsync(uint32_t nodeid, int32_t tpos, uint16_t controlword, DriverCallback callback=DriverCallback());
+    std::future<bool> configureNodeAsync(unsigned char nodeid, DriverCallback callback=DriverCallback());
+    void waitAsyncIdle(); // function to wait until every asynchronous job is done
+
     bool isarrived(uint32_t nodeid);
-    bool go2position_angle(int phi1, int phi2);
+    bool waitMoveDone(const std::vector<uint32_t>& nodes, const std::vector<int64_t>& acked, int timeoutMs, std::vector<AxisMoveStatus>& status);
+    // function to wait for the end of the move of several axes, without spinning on the bus:
+    // the PDO axes are woken up by their TPDO, the others are polled with one pipelined read per round and a growing interval
+    // acked: time each set point was acknowledged (see sendSetPoints), the statuswords up to it are ignored
+    // status: the result of each axis, in the order of nodes
+    // return true if every axis reached its target, false at the first fault/following error/lost node or after timeoutMs
+    bool sendSetPoints(const std::vector<uint32_t>& nodes, const std::vector<int32_t>& tpos, bool immediate, std::vector<int64_t>& acked);
+    // function to give a new target to several axes with the set point handshake of the profile position mode:
+    // bit 4 raised, acknowledge of the drive (statusword bit 12), bit 4 released at once so the drive can take the next one while moving
+    // immediate: bit 5 "change set immediately", the move in progress is abandoned for the new target,
+    // otherwise the set point is buffered by the drive and started when the current target is reached
+    // the drives buffer one set point: while it is taken, the call waits for the current target to be reached
+    // acked: time each set point was acknowledged, for waitMoveDone
+    bool queueTargets(const std::vector<int32_t>& angles); // function to load the next target of the axes, started when the current one is reached
+    bool retarget(const std::vector<int32_t>& angles);     // function to replace the target of the axes, in the middle of the move
+    bool waitTargetsDone(int timeoutMs);                   // function to wait for the axes to reach the last target given by queueTargets/retarget
+    std::vector<AxisMoveStatus> getLastMove();  // per-axis result of the last move of go2positions
+    MoveTelemetry getMoveTelemetry();
+    void resetMoveTelemetry();
+    QString moveResult2QString(MoveResult result);
+    bool go2positions(const std::vector<int32_t>& angles);
+    // function to move the first angles.size() axes at the same time and wait for them
+    // angles: target of each axis, relative to its offset
+    bool go2position_angle(int phi1, int phi2); // go2positions for the two first axes
+    bool getAngles(std::vector<int32_t>& angles, unsigned int count);
+    // function to read the actual position of the first count axes, relative to their offset (from the TPDO when they stream it)
+    bool getAxisDynamics(std::vector<AxisDynamics>& dynamics, unsigned int count);
+    // function to get the profile of the moves of the first count axes: the limits of the synchronized profiles once
+    // the axes are configured, otherwise the profile position parameters of the drives (from the object cache after the first read)
+    void setSynchronizedProfiles(bool enabled);
+    // go2positions gives the axes profiles that make them arrive together (see AxisTrajectory::synchronize), within the
+    // profile of each axis at the configuration (profile of the table or of the drive, velocity capped by 0x607F)
+    // the parameters are only written when they differ from the ones of the drive (object cache). Enabled by default.
+    // when disabled, the profiles of the configuration are written back to the drives
     bool setPosition(uint32_t nodeid, int32_t tpos, uint16_t controlword);
+    void addSetPosition(std::vector<SdoTransfer>& transfers, uint32_t nodeid, int32_t tpos, uint16_t controlword, bool immediate = false);
 
     QString canFrame2QString(const struct can_frame& canframe);
+    QString sdoAbort2QString(uint32_t abortCode);
     QString state2QString(unsigned int state);
     QString mode2QString(int8_t mode);
     unsigned int getStateFromStatusWord(uint16_t statusword);
 
     bool addStates2logs();
 
+    bool startCapture(const char* path, uint64_t maxFrames);
+    void stopCapture();
+    CanCapture* getCapture() { return _capture; }
+
+    bool startSync(uint32_t periodUs); // function to have the kernel send a SYNC frame every periodUs on every bus
+    void stopSync();
+
+    SdoLatencyStats getSdoLatency(uint32_t nodeid);
+    QString sdoLatency2QString(uint32_t nodeid);
+    void resetSdoLatency();
+
+    bool sendNmt(uint8_t command, uint8_t nodeid); // function to send an NMT command (nodeid 0: every node of every bus)
+
+    bool configureRpdo(uint8_t nodeid, int pdo, const std::vector<uint32_t>& mapping, uint8_t transmissionType);
+    bool configureTpdo(uint8_t nodeid, int pdo, const std::vector<uint32_t>& mapping, uint8_t transmissionType, uint16_t inhibitTime = 0, uint16_t eventTimer = 0);
+    // functions to map objects into a PDO (the node should be pre-operational)
+    // pdo: the PDO number, from 0 to 3 (COB-ID 0x200/0x300/0x400/0x500 + nodeid for the RPDO, 0x180/0x280/0x380/0x480 + nodeid for the TPDO)
+    // mapping: the mapped objects, see PDO_MAP
+    // transmissionType: 0 to 240 synchronous (every n SYNC), 254/255 event driven
+    // inhibitTime: minimum time between two TPDO (100us unit), eventTimer: TPDO sent at least every eventTimer ms (0: only on change)
+
+    bool enablePdoPositioning(const std::vector<unsigned char>& nodes);
+    // function to set up the fast path of the positioning on the nodes:
+    // RPDO1 = target position + controlword, TPDO1 = statusword + actual position (on change)
+    bool isPdoEnabled(uint32_t nodeid) const { return _pdoEnabled[nodeid & 0x7F]; }
+    bool pdoSetPosition(uint32_t nodeid, int32_t tpos, uint16_t controlword); // function to send a new target position through the RPDO
+    PdoStatus getPdoStatus(uint32_t nodeid);
+    bool waitPdoStatus(uint32_t nodeid, uint16_t mask, uint16_t value, int64_t after, int timeoutMs, int64_t* timestamp = NULL);
+    // function to wait for a TPDO of nodeid received after the time after (ns since epoch) with (statusword & mask) == value
+    // timestamp: if not NULL, the reception time of the matching TPDO
+    // return false on timeout
+
+    bool enableCsp(const std::vector<unsigned char>& nodes, uint32_t periodUs);
+    // function to switch enabled nodes to the cyclic synchronous position mode (mode 8) and start streaming their set points
+    // RPDO1 (target position + controlword) and TPDO1 (statusword + actual position) are exchanged at each SYNC,
+    // a real-time thread sends the set points then the SYNC every periodUs (also written in 0x60C2)
+    // the axes hold their actual position until cspMoveTo is called
+    void disableCsp(); // function to stop the stream, the drives keep their last set point and go back to profile position
+    bool isCspRunning() const { return _cspRunning; }
+    bool isCspAxis(uint32_t nodeid);
+    bool cspMoveTo(uint32_t nodeid, int32_t target, double duration); // function to move a CSP axis to target in duration seconds
+    bool cspWaitIdle(int timeoutMs); // function to wait for the end of the moves of every CSP axis
+    // the last set points have been sent and the actual positions (TPDO) are within the window of the targets
+    void setCspSpeed(double countsPerSecond) { _cspSpeed = countsPerSecond; } // peak speed of the moves of go2position_angle in CSP
+    unsigned long getCspMissed() const { return _cspMissed; } // number of cycles late or with a frame not sent
+
+    bool enableIpMode(const std::vector<unsigned char>& nodes, uint32_t periodUs);
+    // function to switch enabled nodes to the interpolated position mode (mode 7, linear interpolation)
+    // the set points go through RPDO2 (0x300+nodeid) into the FIFO of the drive, which takes one of them every periodUs (SYNC)
+    // a feeder thread keeps the FIFOs filled ahead of time, it only has to wake up a few times per buffer
+    void disableIpMode();
+    bool ipFollowPath(uint32_t nodeid, const std::vector<int32_t>& points); // function to queue set points (one per period) for an axis
+    bool ipFollowTargets(uint32_t nodeid, const std::vector<int32_t>& targets, double speed);
+    // function to queue a path going through targets, each segment with a minimum jerk profile keeping the peak speed under speed (counts/s)
+    bool ipWaitDone(int timeoutMs); // function to wait until the drives have taken every queued set point
+
+    OdCache& getOdCache() { return _odCache; } // shadow copy of the objects, see OdCache
+
+    bool configureHeartbeat(const std::vector<unsigned char>& nodes, uint16_t periodMs);
+    // function to make the nodes send their heartbeat every periodMs (0x1017) and watch it:
+    // a node is reported lost if its heartbeat is late by half a period (see NodeMonitor)
+    // periodMs: 0 to stop the heartbeats
+    NodeMonitor& getNodeMonitor() { return _nodeMonitor; } // live NMT/EMCY state of the nodes, and its change events
+    NodeStatus getNodeStatus(uint32_t nodeid) { return _nodeMonitor.getStatus(nodeid); }
+    QString nodeStatus2QString(uint32_t nodeid);
+
     bool connect();
     bool configureNode(unsigned char nodeid);
+    bool configureNodes(const std::vector<unsigned char>& nodes);
     void configureMirrors();
 
 
 private:
-    CanWrapper *_can;
+    void setup(Log_handler* logs, CanTransport* transport, const char* interfaceName);
+    void assignNode(int busIndex, unsigned char nodeid);
+    CanTransport* canOf(uint32_t nodeid) { return _buses[getBusOfNode(nodeid)]->can; }
+    void flush(uint32_t nodeid, bool verbose, const char* caller);
+    bool sdoSend(SdoTransfer& transfer, bool verbose);
+    bool sdoWait(SdoTransfer& transfer, bool verbose);
+    bool sdoFromCache(SdoTransfer& transfer);
+    void sdoAbort(uint32_t nodeid, uint16_t regadd, unsigned char subindex, uint32_t abortCode);
+    void logSdoFailure(const SdoClient& client, const char* caller, bool verbose);
+    IoWorker* workerOf(uint32_t nodeid);
+    void onNodeEvent(const NodeEvent& event);
+    bool reportMove(const std::vector<AxisMoveStatus>& status);
+    bool axisTargets(const std::vector<int32_t>& angles, std::vector<uint32_t>& nodes, std::vector<int32_t>& tpos);
+    bool waitStatuswords(const std::vector<uint32_t>& nodes, uint16_t mask, uint16_t value, int64_t after, int timeoutMs, std::vector<int64_t>& received);
+    bool giveTargets(const std::vector<int32_t>& angles, bool immediate);
+    bool writeSyncProfiles(const std::vector<uint32_t>& nodes, const std::vector<int32_t>& tpos);
+    bool setProfilePositionMode(const std::vector<uint32_t>& nodes);
+    bool restoreProfiles();
+    bool readProfiles(unsigned int count, std::vector<uint32_t>& values, std::vector<AxisDynamics>& dynamics);
+    void addPdoConfig(std::vector<SdoTransfer>& transfers, uint8_t nodeid, uint16_t commIndex, uint16_t mapIndex, uint32_t cobid,
+                      const std::vector<uint32_t>& mapping, uint8_t transmissionType, bool tpdo, uint16_t inhibitTime, uint16_t eventTimer);
+    bool sendRpdo(uint32_t nodeid, int32_t tpos, uint16_t controlword);
+    void registerTpdoHandler(uint8_t nodeid);
+    void cspLoop();
+    void ipLoop();
+
+    struct IpAxis{
+        uint32_t nodeid;
+        std::deque<int32_t> points; // set points not sent yet
+        int32_t last;               // last set point queued (start of the next path)
+        int64_t inDrive;            // number of set points sent and not yet taken by the drive (estimated from the SYNC count)
+    };
+
+    struct CspAxis{
+        uint32_t nodeid;
+        AxisTrajectory trajectory;
+        int64_t start;    // CLOCK_MONOTONIC ns at the start of the trajectory
+        int32_t setpoint; // last set point sent
+    };
+    void recordSdoLatency(uint32_t nodeid, int64_t sent, int64_t received);
+
+    std::vector<AxisConfig> _axes; // the axes of the machine, in the order of the angles of go2positions
+    std::vector<VirtualDrive*> _simulation; // simulated drives of the axes, empty with the real ones
+
+    std::vector<CanBus*> _buses; // the first one is given to the constructor
+    int _nodeBus[128];           // index of the bus of each node id, -1 if unknown
+
+    CanTransport *_captureCan;   // second access to the first bus, receiving every frame (including ours) while capturing
+    CanReceiver *_captureRx;
+    CanCapture *_capture;
+
+    CanMailbox _sdoBox[128]; // SDO responses, indexed by node id (the node ids are unique across the buses)
+    std::recursive_mutex _sdoLock[128]; // held during the SDO transactions of a node, the calling threads do not mix their frames
+
+    std::mutex _workerMutex;
+    IoWorker* _workers[128]; // I/O thread of each node running the asynchronous calls, created at the first call
+
+    OdCache _odCache;
+    NodeMonitor _nodeMonitor;
+
+    std::mutex _pdoMutex;
+    std::condition_variable _pdoCond;  // notified at each TPDO received
+    PdoStatus _pdoStatus[128];          // indexed by node id
+    bool _pdoEnabled[128];              // the fast path is set up on the node
+    int _tpdoHandler[128];              // id of the receiver handler of the TPDO1 of the node, 0 if none
+    std::atomic<uint16_t> _pdoControlword[128]; // last controlword sent through the RPDO, also read by the CSP thread
+
+    std::mutex _cspMutex;
+    std::condition_variable _cspIdle; // notified by the real-time thread when every trajectory is finished
+    std::vector<CspAxis> _cspAxes;
+    std::thread _cspThread;
+    std::atomic<bool> _cspRunning;
+    uint32_t _cspPeriodUs;
+    double _cspSpeed;
+    std::atomic<unsigned long> _cspMissed;
+
+    std::mutex _ipMutex;
+    std::condition_variable _ipDone;  // notified by the feeder when every set point has been taken
+    std::vector<IpAxis> _ipAxes;
+    std::thread _ipThread;
+    std::atomic<bool> _ipRunning;
+    uint32_t _ipPeriodUs;
+    uint32_t _ipBufferSize;          // smallest FIFO of the axes
+    bool _ipOwnSync;                 // the feeder sends the SYNC itself (no broadcast manager on the bus)
+    bool _syncRunning;               // startSync has a SYNC sent by the broadcast manager
+
+    std::mutex _moveMutex;
+    std::vector<AxisMoveStatus> _lastMove;
+    MoveTelemetry _moveTelemetry;
+    std::vector<uint32_t> _targetNodes; // axes of the last queueTargets/retarget
+    std::vector<int64_t> _targetAcked;  // and the acknowledge of their set points, for waitTargetsDone
+
+    bool _syncProfiles;
+    std::vector<AxisDynamics> _profileLimits; // profile of each axis at the configuration, empty before
+    uint32_t _profileParameters[128][3];      // 0x6081, 0x6083 and 0x6084 of each node at the configuration, written back by restoreProfiles
+    bool _profileKnown[128];                  // _profileParameters has been read for the node
+    bool _profilesChanged;                    // writeSyncProfiles replaced some of these parameters since
+
+    std::mutex _latencyMutex;
+    SdoLatencyStats _sdoLatency[128]; // SDO round trip times, indexed by node id
 
     Log_handler* _logs;
 
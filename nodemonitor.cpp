@@ -0,0 +1,223 @@
+#include "nodemonitor.h"
+
+#include <string.h>
+
+NodeMonitor::NodeMonitor(){
+    memset(_status, 0, sizeof(_status));
+    for(int i=0; i<128; i++){
+        _status[i].nmtState = NMT_STATE_UNKNOWN;
+        _timeoutMs[i] = 0;
+    }
+    _nextListener = 1;
+    _stopping = false;
+}
+
+NodeMonitor::~NodeMonitor(){
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _cond.notify_all();
+    if(_thread.joinable()) _thread.join();
+}
+
+void NodeMonitor::watch(uint8_t nodeid, uint32_t timeoutMs){
+    std::lock_guard<std::mutex> lock(_mutex);
+    uint8_t id = nodeid & 0x7F;
+    _timeoutMs[id] = timeoutMs;
+    _status[id].watched = timeoutMs > 0;
+    if(timeoutMs == 0){
+        _status[id].alive = false;
+    }else{
+        // the node is considered alive until its first deadline
+        _status[id].alive = true;
+        _deadline[id] = Clock::now() + std::chrono::milliseconds(timeoutMs);
+        if(!_thread.joinable()) _thread = std::thread(&NodeMonitor::loop, this);
+    }
+    _cond.notify_all();
+}
+
+void NodeMonitor::onHeartbeat(uint8_t nodeid, uint8_t state, int64_t timestamp){
+    std::vector<NodeEvent> events;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        uint8_t id = nodeid & 0x7F;
+        NodeStatus& status = _status[id];
+        uint8_t previous = status.nmtState;
+        bool wasLost = status.watched && !status.alive;
+
+        status.nmtState = state;
+        status.lastHeartbeat = timestamp;
+        if(status.watched){
+            status.alive = true;
+            _deadline[id] = Clock::now() + std::chrono::milliseconds(_timeoutMs[id]);
+        }
+
+        NodeEvent event;
+        event.nodeid = id;
+        event.status = status;
+        if(wasLost){
+            event.type = NODE_FOUND;
+            events.push_back(event);
+            _cond.notify_all(); // the monitor thread may sleep without any deadline
+        }
+        if(state == NMT_STATE_BOOTUP){
+            // a boot-up resets the error state of the node
+            status.emcyCode = 0;
+            status.errorRegister = 0;
+            event.status = status;
+            event.type = NODE_BOOTUP;
+            events.push_back(event);
+        }else if(state != previous){
+            event.type = NODE_STATE_CHANGED;
+            events.push_back(event);
+        }
+    }
+    publish(events);
+}
+
+void NodeMonitor::onEmcy(uint8_t nodeid, const uint8_t *data, uint8_t len){
+    uint8_t frame[8];
+    memset(frame, 0, sizeof(frame));
+    memcpy(frame, data, len > 8 ? 8 : len);
+
+    std::vector<NodeEvent> events;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        uint8_t id = nodeid & 0x7F;
+        NodeStatus& status = _status[id];
+        // error code (2 bytes), error register (1 byte), manufacturer specific error (5 bytes)
+        status.emcyCode = frame[0] | (frame[1] << 8);
+        status.errorRegister = frame[2];
+        memcpy(status.emcyData, &frame[3], 5);
+        status.emcyCount++;
+
+        NodeEvent event;
+        event.type = status.emcyCode == 0 ? NODE_ERROR_RESET : NODE_EMCY;
+        event.nodeid = id;
+        event.status = status;
+        events.push_back(event);
+    }
+    publish(events);
+}
+
+NodeStatus NodeMonitor::getStatus(uint8_t nodeid){
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _status[nodeid & 0x7F];
+}
+
+int NodeMonitor::addListener(NodeEventCallback callback){
+    std::lock_guard<std::mutex> lock(_listenerMutex);
+    int id = _nextListener++;
+    _listeners[id] = callback;
+    return id;
+}
+
+void NodeMonitor::removeListener(int id){
+    std::lock_guard<std::mutex> lock(_listenerMutex);
+    _listeners.erase(id);
+}
+
+void NodeMonitor::publish(const std::vector<NodeEvent> &events){
+    // called without _mutex held, so that a listener can read the status table
+    if(events.empty()) return;
+    std::lock_guard<std::mutex> lock(_listenerMutex);
+    for(unsigned int i=0; i<events.size(); i++){
+        for(std::map<int, NodeEventCallback>::iterator it = _listeners.begin(); it != _listeners.end(); ++it){
+            it->second(events[i]);
+        }
+    }
+}
+
+void NodeMonitor::loop(){
+    std::unique_lock<std::mutex> lock(_mutex);
+    while(!_stopping){
+        // sleep until the earliest deadline of the nodes still alive
+        bool any = false;
+        Clock::time_point next;
+        for(int i=0; i<128; i++){
+            if(!_status[i].watched || !_status[i].alive) continue;
+            if(!any || _deadline[i] < next) next = _deadline[i];
+            any = true;
+        }
+        if(!any){
+            _cond.wait(lock);
+            continue;
+        }
+        _cond.wait_until(lock, next);
+        if(_stopping) break;
+
+        std::vector<NodeEvent> events;
+        Clock::time_point now = Clock::now();
+        for(int i=0; i<128; i++){
+            if(!_status[i].watched || !_status[i].alive || _deadline[i] > now) continue;
+            _status[i].alive = false;
+            NodeEvent event;
+            event.type = NODE_LOST;
+            event.nodeid = i;
+            event.status = _status[i];
+            events.push_back(event);
+        }
+        if(!events.empty()){
+            lock.unlock();
+            publish(events);
+            lock.lock();
+        }
+    }
+}
+
+const char* NodeMonitor::nmtState2String(uint8_t state){
+    switch(state){
+    case NMT_STATE_BOOTUP: return "Boot-up";
+    case NMT_STATE_STOPPED: return "Stopped";
+    case NMT_STATE_OPERATIONAL: return "Operational";
+    case NMT_STATE_PREOPERATIONAL: return "Pre-operational";
+    case NMT_STATE_UNKNOWN: return "Unknown";
+    default: return "Not a valid NMT state";
+    }
+}
+
+const char* NodeMonitor::emcyCode2String(uint16_t code){
+    // the most common codes of the drives, then the classes given by the first digits
+    switch(code){
+    case 0x0000: return "Error reset or no error";
+    case 0x2310: return "Continuous over current";
+    case 0x2320: return "Short circuit";
+    case 0x3210: return "DC link over voltage";
+    case 0x3220: return "DC link under voltage";
+    case 0x4210: return "Excess temperature device";
+    case 0x5530: return "Data storage error";
+    case 0x6100: return "Internal software error";
+    case 0x6320: return "Parameter error";
+    case 0x7300: return "Sensor error";
+    case 0x7305: return "Incremental sensor 1 fault";
+    case 0x8110: return "CAN overrun, objects lost";
+    case 0x8120: return "CAN in error passive mode";
+    case 0x8130: return "Life guard or heartbeat error";
+    case 0x8140: return "Recovered from bus off";
+    case 0x8210: return "PDO not processed due to length error";
+    case 0x8220: return "PDO length exceeded";
+    case 0x8400: return "Velocity speed controller error";
+    case 0x8611: return "Following error";
+    case 0x8612: return "Reference limit";
+    default: break;
+    }
+    switch(code & 0xFF00){
+    case 0x1000: return "Generic error";
+    case 0x8100: return "Communication error";
+    case 0xFF00: return "Device specific error";
+    default: break;
+    }
+    switch(code & 0xF000){
+    case 0x2000: return "Current error";
+    case 0x3000: return "Voltage error";
+    case 0x4000: return "Temperature error";
+    case 0x5000: return "Device hardware error";
+    case 0x6000: return "Device software error";
+    case 0x7000: return "Additional modules error";
+    case 0x8000: return "Monitoring error";
+    case 0x9000: return "External error";
+    case 0xF000: return "Additional functions error";
+    default: return "Unknown error";
+    }
+}
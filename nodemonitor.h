@@ -0,0 +1,97 @@
+#ifndef NODEMONITOR_H
+#define NODEMONITOR_H
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+// NMT states sent by a node in its heartbeat (CiA 301)
+#define NMT_STATE_BOOTUP 0x00
+#define NMT_STATE_STOPPED 0x04
+#define NMT_STATE_OPERATIONAL 0x05
+#define NMT_STATE_PREOPERATIONAL 0x7F
+#define NMT_STATE_UNKNOWN 0xFF // nothing received from the node yet
+
+// What we know about a node from its heartbeat and emergency frames
+struct NodeStatus
+{
+    uint8_t nmtState;       // last state received (NMT_STATE_*)
+    bool watched;           // the heartbeat of the node is expected (see NodeMonitor::watch)
+    bool alive;             // watched and a heartbeat has been received before the timeout
+    int64_t lastHeartbeat;  // reception time of the last heartbeat (ns since epoch), 0 if none
+    uint16_t emcyCode;      // error code of the last EMCY, 0 if none or after an error reset
+    uint8_t errorRegister;  // error register (0x1001) of the last EMCY
+    uint8_t emcyData[5];    // manufacturer specific bytes of the last EMCY
+    unsigned long emcyCount;
+};
+
+enum NodeEventType
+{
+    NODE_BOOTUP,        // the node (re)started, its configuration is lost
+    NODE_STATE_CHANGED, // new NMT state in the heartbeat
+    NODE_LOST,          // no heartbeat received before the timeout
+    NODE_FOUND,         // heartbeat received again after a NODE_LOST
+    NODE_EMCY,          // emergency frame with an error
+    NODE_ERROR_RESET    // emergency frame with the error code 0: every error is gone
+};
+
+struct NodeEvent
+{
+    NodeEventType type;
+    uint8_t nodeid;
+    NodeStatus status; // status of the node after the event
+};
+
+typedef std::function<void(const NodeEvent&)> NodeEventCallback;
+
+// Live state table of the nodes, maintained from the frames they send by themselves:
+// - heartbeat (0x700+id): NMT state, and the loss of the node when it stops arriving
+// - EMCY (0x080+id): the errors of the node as soon as they happen
+// The frames are given by the reception thread (onHeartbeat, onEmcy). A thread of the monitor sleeps
+// until the next heartbeat deadline, so the loss of a node is detected without polling the bus.
+// The listeners are called from the reception thread or from the monitor thread, they should be short.
+class NodeMonitor
+{
+public:
+    NodeMonitor();
+    ~NodeMonitor();
+
+    void watch(uint8_t nodeid, uint32_t timeoutMs); // function to expect a heartbeat of nodeid at least every timeoutMs (0: stop watching)
+
+    void onHeartbeat(uint8_t nodeid, uint8_t state, int64_t timestamp); // state: first byte of the heartbeat, toggle bit removed
+    void onEmcy(uint8_t nodeid, const uint8_t *data, uint8_t len);
+
+    NodeStatus getStatus(uint8_t nodeid);
+
+    int addListener(NodeEventCallback callback); // return an id to give to removeListener
+    void removeListener(int id);
+
+    static const char* nmtState2String(uint8_t state);
+    static const char* emcyCode2String(uint16_t code); // class of an EMCY error code (CiA 301 / CiA 402)
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    void loop();
+    void publish(const std::vector<NodeEvent> &events);
+
+    std::mutex _mutex;
+    std::condition_variable _cond; // notified when a deadline changes or the thread should stop
+    NodeStatus _status[128];
+    uint32_t _timeoutMs[128];
+    Clock::time_point _deadline[128];
+
+    std::mutex _listenerMutex;
+    std::map<int, NodeEventCallback> _listeners;
+    int _nextListener;
+
+    std::thread _thread; // started at the first watch
+    bool _stopping;
+};
+
+#endif // NODEMONITOR_H
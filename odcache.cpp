@@ -0,0 +1,80 @@
+#include "odcache.h"
+
+#include <string.h>
+
+OdCache::OdCache(){
+    _hits = 0;
+    _misses = 0;
+}
+
+void OdCache::declare(uint16_t index, uint8_t subindex, Owner owner){
+    std::lock_guard<std::mutex> lock(_mutex);
+    _objects[objectKey(index, subindex)] = owner;
+}
+
+bool OdCache::get(uint8_t nodeid, uint16_t index, uint8_t subindex, void *value, size_t size){
+    std::lock_guard<std::mutex> lock(_mutex);
+    if(_objects.find(objectKey(index, subindex)) == _objects.end()) return false; // not cacheable
+    std::unordered_map<uint32_t, Entry>::iterator it = _entries.find(entryKey(nodeid, index, subindex));
+    if(it == _entries.end() || !it->second.valid || it->second.size < size){
+        _misses++;
+        return false;
+    }
+    memcpy(value, &it->second.value, size);
+    _hits++;
+    return true;
+}
+
+void OdCache::store(uint8_t nodeid, uint16_t index, uint8_t subindex, const void *value, size_t size, bool fromPdo){
+    if(size > sizeof(uint32_t)) return;
+    std::lock_guard<std::mutex> lock(_mutex);
+    std::unordered_map<uint32_t, Owner>::iterator object = _objects.find(objectKey(index, subindex));
+    if(object == _objects.end()) return;
+    // an SDO read of a drive-owned object is already old when it is answered, it is not kept
+    if(object->second == DRIVE_OWNED && !fromPdo) return;
+
+    Entry& entry = _entries[entryKey(nodeid, index, subindex)];
+    entry.value = 0;
+    memcpy(&entry.value, value, size);
+    entry.size = size;
+    entry.valid = true;
+}
+
+void OdCache::update(uint8_t nodeid, uint16_t index, uint8_t subindex, const void *value, size_t size){
+    store(nodeid, index, subindex, value, size, false);
+}
+
+void OdCache::updateFromPdo(uint8_t nodeid, uint16_t index, uint8_t subindex, const void *value, size_t size){
+    store(nodeid, index, subindex, value, size, true);
+}
+
+void OdCache::invalidate(uint8_t nodeid, uint16_t index, uint8_t subindex){
+    std::lock_guard<std::mutex> lock(_mutex);
+    _entries.erase(entryKey(nodeid, index, subindex));
+}
+
+void OdCache::invalidateIf(uint8_t nodeid, bool driveOwnedOnly){
+    std::lock_guard<std::mutex> lock(_mutex);
+    for(std::unordered_map<uint32_t, Entry>::iterator it = _entries.begin(); it != _entries.end(); ){
+        bool sameNode = nodeid == 0 || (it->first >> 24) == (uint32_t)(nodeid & 0x7F);
+        bool driveOwned = _objects[it->first & 0xFFFFFF] == DRIVE_OWNED;
+        if(sameNode && (driveOwned || !driveOwnedOnly)){
+            it = _entries.erase(it);
+        }else{
+            ++it;
+        }
+    }
+}
+
+void OdCache::invalidateDriveOwned(uint8_t nodeid){
+    invalidateIf(nodeid, true);
+}
+
+void OdCache::invalidateNode(uint8_t nodeid){
+    invalidateIf(nodeid, false);
+}
+
+void OdCache::resetCounters(){
+    _hits = 0;
+    _misses = 0;
+}
@@ -0,0 +1,61 @@
+#ifndef ODCACHE_H
+#define ODCACHE_H
+
+#include <atomic>
+#include <mutex>
+#include <unordered_map>
+#include <stdint.h>
+#include <stddef.h>
+
+// Shadow copy of object dictionary entries of the nodes, to answer reads without an SDO round trip.
+// Only the declared objects are cached:
+// - host-owned: only the host writes them (controlword, mode, profile parameters), the value written or read once stays valid
+// - drive-owned: the drive changes them (statusword, actual position), they are valid only while a PDO streams them
+class OdCache
+{
+public:
+    enum Owner { HOST_OWNED, DRIVE_OWNED };
+
+    OdCache();
+
+    void declare(uint16_t index, uint8_t subindex, Owner owner); // function to cache an object for every node
+
+    bool get(uint8_t nodeid, uint16_t index, uint8_t subindex, void *value, size_t size);
+    // function to read an entry, return false if it is not cached (counted as a miss if the object is declared)
+
+    template <typename T>
+    bool get(uint8_t nodeid, uint16_t index, T &value, uint8_t subindex = 0){ return get(nodeid, index, subindex, &value, sizeof(T)); }
+
+    void update(uint8_t nodeid, uint16_t index, uint8_t subindex, const void *value, size_t size);
+    // function to store the value of an SDO transfer (kept for the host-owned objects only)
+    void updateFromPdo(uint8_t nodeid, uint16_t index, uint8_t subindex, const void *value, size_t size);
+    // function to store a value received/sent in a PDO (kept for every declared object)
+
+    void invalidate(uint8_t nodeid, uint16_t index, uint8_t subindex);
+    void invalidateDriveOwned(uint8_t nodeid); // function to forget the drive-owned entries (the PDO stopped), nodeid 0: every node
+    void invalidateNode(uint8_t nodeid);       // function to forget every entry of a node (reset), nodeid 0: every node
+
+    unsigned long getHits() const { return _hits; }
+    unsigned long getMisses() const { return _misses; }
+    void resetCounters();
+
+private:
+    struct Entry{
+        uint32_t value;
+        uint8_t size;
+        bool valid;
+    };
+
+    static uint32_t objectKey(uint16_t index, uint8_t subindex) { return ((uint32_t)index << 8) | subindex; }
+    static uint32_t entryKey(uint8_t nodeid, uint16_t index, uint8_t subindex) { return ((uint32_t)(nodeid & 0x7F) << 24) | objectKey(index, subindex); }
+    void store(uint8_t nodeid, uint16_t index, uint8_t subindex, const void *value, size_t size, bool fromPdo);
+    void invalidateIf(uint8_t nodeid, bool driveOwnedOnly);
+
+    std::mutex _mutex;
+    std::unordered_map<uint32_t, Owner> _objects; // declared objects, by objectKey
+    std::unordered_map<uint32_t, Entry> _entries; // by entryKey
+    std::atomic<unsigned long> _hits;
+    std::atomic<unsigned long> _misses;
+};
+
+#endif // ODCACHE_H
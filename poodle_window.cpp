@@ -18,6 +18,8 @@
 #define YINFPX 54
 #define YSUPPX 603
 
+#define SCHEDULE_BUDGET_MS 20 // time given to the ordering of the weeds, before the first shot
+
 Poodle_window::Poodle_window(QWidget *parent) : QMainWindow(parent), _logs(new Log_handler()), ui(new Ui::Poodle_window), _driver(_logs), _camera(_logs) {
     ui->setupUi(this);
 
@@ -37,12 +39,27 @@ Poodle_window::Poodle_window(QWidget *parent) : QMainWindow(parent), _logs(new L
 
     _initonce = false;
 
-    ui->lb_offcet1_val->setText(QString::number(OFFCET_MIRROR_1));
-    ui->lb_offcet2_val->setText(QString::number(OFFCET_MIRROR_2));
-    ui->lb_offcet1_name->setText(QString("Offcet mirror " + QString::number(ID_MIRROR_1) + ": "));
-    ui->lb_offcet2_name->setText(QString("Offcet mirror " + QString::number(ID_MIRROR_2) + ": "));
-    ui->lb_mirror1->setText(QString("Mirror " + QString::number(ID_MIRROR_1) + ": "));
-    ui->lb_mirror2->setText(QString("Mirror " + QString::number(ID_MIRROR_2) + ": "));
+    // axes of the machine, the manual tab shows the two first ones
+    _driver.loadAxisConfig(AXIS_CONFIG_FILE);
+
+    // simulated drives instead of the real ones ([simulation] of the axes file or POODLE_SIMULATION=<bus>)
+    VirtualDriveConfig simulation;
+    std::string simulationBus;
+    if(loadSimulation(AXIS_CONFIG_FILE, simulation, simulationBus)){
+        _driver.startSimulation(simulation, simulationBus);
+    }
+    if(_driver.getAxisCount() < 2){
+        addLog("The manual control needs two axes", LOG_ERR);
+        return;
+    }
+    const AxisConfig& axis1 = _driver.getAxis(0);
+    const AxisConfig& axis2 = _driver.getAxis(1);
+    ui->lb_offcet1_val->setText(QString::number(axis1.offset));
+    ui->lb_offcet2_val->setText(QString::number(axis2.offset));
+    ui->lb_offcet1_name->setText(QString("Offcet " + axis1.name + ": "));
+    ui->lb_offcet2_name->setText(QString("Offcet " + axis2.name + ": "));
+    ui->lb_mirror1->setText(QString(axis1.name + ": "));
+    ui->lb_mirror2->setText(QString(axis2.name + ": "));
 
 }
 
@@ -251,16 +268,41 @@ void Poodle_window::on_btn_weeding_clicked(){
     log += QString::number(adv_pos.size()/2) + " adventice(s) detected: \n";
 
 
+    std::vector<std::vector<int32_t> > targets;
     for(unsigned int i=0; i<adv_pos.size(); i+=2){
-        log += "(" + QString::number(adv_pos[i]) + "," + QString::number(adv_pos[i+1]) +")\n";
         double phi1;
         double phi2;
         double f;
         transfert_fct(110 - adv_pos[i] , 248 - adv_pos[i+1], 820, phi1, phi2, f);
+        std::vector<int32_t> angles(2);
+        angles[0] = phi1;
+        angles[1] = phi2;
+        targets.push_back(angles);
+    }
 
-        _driver.go2position_angle(phi1, phi2);
+    // the weeds are shot in the order that shortens the moves of the mirrors, not in the order of the image
+    std::vector<unsigned int> order(targets.size());
+    for(unsigned int k=0; k<order.size(); k++) order[k] = k;
+    std::vector<int32_t> start;
+    std::vector<AxisDynamics> dynamics;
+    if(targets.size() > 1 && _driver.getAngles(start, 2) && _driver.getAxisDynamics(dynamics, 2)){
+        TargetScheduler scheduler(dynamics);
+        order = scheduler.schedule(start, targets, SCHEDULE_BUDGET_MS);
+        const ScheduleStats& stats = scheduler.getStats();
+        log += "moves: " + QString::number(stats.duration * 1000, 'f', 1) + "ms instead of "
+                + QString::number(stats.initialDuration * 1000, 'f', 1) + "ms (ordered in "
+                + QString::number(stats.elapsedMs, 'f', 1) + "ms)\n";
+    }
+
+    for(unsigned int k=0; k<order.size(); k++){
+        unsigned int i = order[k];
+        log += "(" + QString::number(adv_pos[2*i]) + "," + QString::number(adv_pos[2*i+1]) +")\n";
 
-        usleep(300000);
+        // go2position_angle returns once both mirrors reported their target reached: the laser fires right away
+        if(!_driver.go2position_angle(targets[i][0], targets[i][1])){
+            log += "  not reached, skipped\n";
+            continue;
+        }
         for(int j=0; j<3; j++){
             digitalWrite (LASER_GPIO, HIGH) ; // from wiringPi library
             usleep(50000);
@@ -353,21 +395,25 @@ void Poodle_window::on_btn_getpositions_clicked(){
     // timer to update the position value of the motors
     int32_t actpos;
 
+    if(_driver.getAxisCount() < 2) return;
+    const AxisConfig& axis1 = _driver.getAxis(0);
+    const AxisConfig& axis2 = _driver.getAxis(1);
+
     // Node 1
-    if(!_driver.readRegister(REG_PPOS_ACPO2, ID_MIRROR_1, &actpos, sizeof(actpos),0, false)){
+    if(!_driver.readRegister(REG_PPOS_ACPO2, axis1.nodeid, &actpos, sizeof(actpos),0, false)){
         addLog("Fail to read Max profile velocity", LOG_ERR);
         return;
     }
     ui->lb_pos1->setText(QString::number(actpos,10));
-    ui->txb_pos1->setText(QString::number(actpos-OFFCET_MIRROR_1,10));
+    ui->txb_pos1->setText(QString::number(actpos-axis1.offset,10));
 
     // Node 2
-    if(!_driver.readRegister(REG_PPOS_ACPO2, ID_MIRROR_2, &actpos, sizeof(actpos),0, false)){
+    if(!_driver.readRegister(REG_PPOS_ACPO2, axis2.nodeid, &actpos, sizeof(actpos),0, false)){
         addLog("Fail to read Max profile velocity", LOG_ERR);
         return;
     }
     ui->lb_pos2->setText(QString::number(actpos,10));
-    ui->txb_pos2->setText(QString::number(actpos-OFFCET_MIRROR_2,10));
+    ui->txb_pos2->setText(QString::number(actpos-axis2.offset,10));
 }
 
 void Poodle_window::on_btn_setpositions_clicked(){
@@ -10,6 +10,7 @@
 #include "poodlecamera.h"
 #include "log_handler.h"
 #include "clickablelabel.h"
+#include "targetscheduler.h"
 
 
 namespace Ui {
@@ -0,0 +1,370 @@
+#include "sdoclient.h"
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SDO_BLOCK_RETRIES 3 // blocks in a row without any segment acknowledged before we give up
+
+static uint32_t le32(const uint8_t *p){
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void putLe32(uint8_t *p, uint32_t value){
+    p[0] = value;
+    p[1] = value >> 8;
+    p[2] = value >> 16;
+    p[3] = value >> 24;
+}
+
+SdoClient::SdoClient(CanTransport *can, CanMailbox *box, uint8_t nodeid, int timeoutMs){
+    _can = can;
+    _box = box;
+    _nodeid = nodeid & 0x7F;
+    _timeoutMs = timeoutMs;
+    _index = 0;
+    _subindex = 0;
+    start(0, 0);
+}
+
+const char* SdoClient::abortDescription(uint32_t abortCode){
+    switch(abortCode){
+    case 0x05030000: return "Toggle bit not alternated";
+    case 0x05040000: return "SDO protocol timed out";
+    case 0x05040001: return "Command specifier not valid or unknown";
+    case 0x05040002: return "Invalid block size";
+    case 0x05040003: return "Invalid sequence number";
+    case 0x05040004: return "CRC error";
+    case 0x05040005: return "Out of memory";
+    case 0x06010000: return "Unsupported access to an object";
+    case 0x06010001: return "Attempt to read a write only object";
+    case 0x06010002: return "Attempt to write a read only object";
+    case 0x06020000: return "Object does not exist in the object dictionary";
+    case 0x06040041: return "Object cannot be mapped to the PDO";
+    case 0x06040042: return "The number and length of the objects to be mapped would exceed the PDO length";
+    case 0x06040043: return "General parameter incompatibility";
+    case 0x06040047: return "General internal incompatibility in the device";
+    case 0x06060000: return "Access failed due to a hardware error";
+    case 0x06070010: return "Data type does not match, length of service parameter does not match";
+    case 0x06070012: return "Data type does not match, length of service parameter too high";
+    case 0x06070013: return "Data type does not match, length of service parameter too low";
+    case 0x06090011: return "Sub-index does not exist";
+    case 0x06090030: return "Invalid value for parameter";
+    case 0x06090031: return "Value of parameter written too high";
+    case 0x06090032: return "Value of parameter written too low";
+    case 0x06090036: return "Maximum value is less than minimum value";
+    case 0x060A0023: return "Resource not available: SDO connection";
+    case 0x08000000: return "General error";
+    case 0x08000020: return "Data cannot be transferred or stored to the application";
+    case 0x08000021: return "Data cannot be transferred or stored to the application because of local control";
+    case 0x08000022: return "Data cannot be transferred or stored to the application because of the present device state";
+    case 0x08000023: return "Object dictionary dynamic generation fails or no object dictionary is present";
+    case 0x08000024: return "No data available";
+    default: return "Unknown abort code";
+    }
+}
+
+uint16_t SdoClient::crc16(const uint8_t *data, size_t size, uint16_t crc){
+    // polynomial x^16 + x^12 + x^5 + 1, initial value 0, as required by CiA 301 for the block transfers
+    for(size_t i=0; i<size; i++){
+        crc ^= (uint16_t)data[i] << 8;
+        for(int bit=0; bit<8; bit++){
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+void SdoClient::start(uint16_t index, uint8_t subindex){
+    // function to reset the status at the beginning of a transfer
+    _index = index;
+    _subindex = subindex;
+    _abortCode = 0;
+    _serverAbort = false;
+    _errorCode = 0;
+    _frames = 0;
+}
+
+bool SdoClient::send(uint8_t command, const uint8_t *payload, int len){
+    // function to send a request: the command byte followed by up to 7 bytes (the rest is padded with 0)
+    struct can_frame msg;
+    msg.can_id = 0x600 + _nodeid;
+    msg.can_dlc = 8;
+    memset(msg.data, 0, sizeof(msg.data));
+    msg.data[0] = command;
+    if(len > 7) len = 7;
+    if(len > 0) memcpy(&msg.data[1], payload, len);
+    _frames++;
+    if(!_can->SendMsg(msg, 0, 0, _errorCode)) return false;
+    return true;
+}
+
+bool SdoClient::sendInitiate(uint8_t command, const uint8_t *payload, int len){
+    // function to send an initiate request: the command byte, the multiplexer (index, subindex) and up to 4 bytes
+    uint8_t data[7];
+    memset(data, 0, sizeof(data));
+    data[0] = _index;
+    data[1] = _index >> 8;
+    data[2] = _subindex;
+    if(len > 4) len = 4;
+    if(len > 0) memcpy(&data[3], payload, len);
+    return send(command, data, sizeof(data));
+}
+
+bool SdoClient::receive(struct can_frame &frame){
+    // function to wait for the next response of the server, the abort frames end the transfer
+    CanRxFrame rsp;
+    if(!_box->wait(rsp, _timeoutMs)){
+        abort(SDO_ABORT_TIMEOUT);
+        return false;
+    }
+    frame = rsp.frame;
+    _frames++;
+    if(frame.data[0] == 0x80){
+        _abortCode = le32(&frame.data[4]);
+        _serverAbort = true;
+        return false;
+    }
+    return true;
+}
+
+bool SdoClient::expect(const struct can_frame &frame, uint8_t mask, uint8_t command){
+    // function to check the command specifier of a response, the transfer is aborted if it is not the expected one
+    if((frame.data[0] & mask) != command){
+        abort(SDO_ABORT_COMMAND);
+        return false;
+    }
+    return true;
+}
+
+bool SdoClient::checkMux(const struct can_frame &frame){
+    // function to check that an initiate response is about the object of the transfer
+    uint16_t index = frame.data[1] | (frame.data[2] << 8);
+    if(index != _index || frame.data[3] != _subindex){
+        abort(SDO_ABORT_GENERAL);
+        return false;
+    }
+    return true;
+}
+
+void SdoClient::abort(uint32_t abortCode){
+    // function to end the transfer on our side and tell the server to do the same
+    uint8_t data[7];
+    data[0] = _index;
+    data[1] = _index >> 8;
+    data[2] = _subindex;
+    putLe32(&data[3], abortCode);
+    int errorCode = _errorCode;
+    send(0x80, data, sizeof(data));
+    _errorCode = errorCode; // the reason of the failure is the abort, not the sending of the abort frame
+    _abortCode = abortCode;
+    _serverAbort = false;
+}
+
+bool SdoClient::upload(uint16_t index, uint8_t subindex, std::vector<uint8_t> &data){
+    struct can_frame rsp;
+    start(index, subindex);
+    data.clear();
+
+    // initiate: the server answers with the value (expedited) or with the size of the segments to come
+    if(!sendInitiate(0x40, NULL, 0)) return false;
+    if(!receive(rsp) || !expect(rsp, 0xE0, 0x40) || !checkMux(rsp)) return false;
+
+    if(rsp.data[0] & 0x02){
+        // expedited: n (bits 3-2) bytes of the 4 do not contain data if the size is indicated (bit 0)
+        int n = (rsp.data[0] & 0x01) ? 4 - ((rsp.data[0] >> 2) & 0x03) : 4;
+        data.assign(&rsp.data[4], &rsp.data[4] + n);
+        return true;
+    }
+
+    bool sized = rsp.data[0] & 0x01;
+    uint32_t total = sized ? le32(&rsp.data[4]) : 0;
+    if(sized) data.reserve(total);
+
+    // segments: one request per segment, the toggle bit alternates from 0
+    uint8_t toggle = 0x00;
+    while(true){
+        if(!send(0x60 | toggle, NULL, 0)) return false;
+        if(!receive(rsp) || !expect(rsp, 0xE0, 0x00)) return false;
+        if((rsp.data[0] & 0x10) != toggle){
+            abort(SDO_ABORT_TOGGLE);
+            return false;
+        }
+        int n = 7 - ((rsp.data[0] >> 1) & 0x07); // bytes of the segment containing data
+        data.insert(data.end(), &rsp.data[1], &rsp.data[1] + n);
+        if(rsp.data[0] & 0x01) break; // last segment
+        toggle ^= 0x10;
+    }
+
+    if(sized && data.size() != total){
+        _abortCode = SDO_ABORT_GENERAL; // the transfer is over on the server side, nothing to abort
+        return false;
+    }
+    return true;
+}
+
+bool SdoClient::download(uint16_t index, uint8_t subindex, const void *data, size_t size){
+    const uint8_t* bytes = (const uint8_t*)data;
+    struct can_frame rsp;
+    start(index, subindex);
+
+    if(size > 0 && size <= 4){
+        // expedited, size indicated: n (bits 3-2) bytes of the 4 do not contain data
+        if(!sendInitiate(0x23 | ((4 - size) << 2), bytes, size)) return false;
+        return receive(rsp) && expect(rsp, 0xFF, 0x60) && checkMux(rsp);
+    }
+
+    // segmented: the size is given in the initiate request
+    uint8_t length[4];
+    putLe32(length, size);
+    if(!sendInitiate(0x21, length, 4)) return false;
+    if(!receive(rsp) || !expect(rsp, 0xFF, 0x60) || !checkMux(rsp)) return false;
+
+    size_t pos = 0;
+    uint8_t toggle = 0x00;
+    do{
+        int n = size - pos > 7 ? 7 : size - pos;
+        bool last = pos + n >= size;
+        if(!send(toggle | ((7 - n) << 1) | (last ? 0x01 : 0x00), bytes + pos, n)) return false;
+        if(!receive(rsp) || !expect(rsp, 0xEF, 0x20)) return false;
+        if((rsp.data[0] & 0x10) != toggle){
+            abort(SDO_ABORT_TOGGLE);
+            return false;
+        }
+        pos += n;
+        toggle ^= 0x10;
+    }while(pos < size);
+    return true;
+}
+
+bool SdoClient::blockUpload(uint16_t index, uint8_t subindex, std::vector<uint8_t> &data){
+    struct can_frame rsp;
+    start(index, subindex);
+    data.clear();
+
+    // initiate: we support the CRC, blksize segments per block, no switch to the segmented protocol (pst 0)
+    uint8_t params[2] = { SDO_BLOCK_SIZE, 0 };
+    if(!sendInitiate(0xA4, params, 2)) return false;
+    if(!receive(rsp)){
+        if(_serverAbort && _abortCode == SDO_ABORT_COMMAND) return upload(index, subindex, data);
+        return false;
+    }
+    if(!expect(rsp, 0xE1, 0xC0) || !checkMux(rsp)) return false;
+    bool crc = rsp.data[0] & 0x04;
+    bool sized = rsp.data[0] & 0x02;
+    uint32_t total = sized ? le32(&rsp.data[4]) : 0;
+    if(sized) data.reserve(total);
+
+    if(!send(0xA3, NULL, 0)) return false; // start the upload
+
+    bool finished = false;
+    while(!finished){
+        // one block: the segments are numbered from 1, the ones out of sequence are dropped and sent again by the server
+        int expected = 1;
+        while(true){
+            if(!receive(rsp)) return false;
+            int seq = rsp.data[0] & 0x7F;
+            bool last = rsp.data[0] & 0x80;
+            if(seq == expected){
+                data.insert(data.end(), &rsp.data[1], &rsp.data[1] + 7);
+                expected++;
+                finished = last;
+            }
+            if(last || seq >= SDO_BLOCK_SIZE) break;
+        }
+        uint8_t ack[2] = { (uint8_t)(expected - 1), SDO_BLOCK_SIZE };
+        if(!send(0xA2, ack, 2)) return false;
+    }
+
+    // end: n (bits 4-2) bytes of the last segment do not contain data, then the CRC of the whole data
+    if(!receive(rsp) || !expect(rsp, 0xE3, 0xC1)) return false;
+    size_t unused = (rsp.data[0] >> 2) & 0x07;
+    if(unused > data.size()){
+        abort(SDO_ABORT_GENERAL);
+        return false;
+    }
+    data.resize(data.size() - unused);
+    if(crc && crc16(data.data(), data.size()) != (uint16_t)(rsp.data[1] | (rsp.data[2] << 8))){
+        abort(SDO_ABORT_CRC);
+        return false;
+    }
+    if(sized && data.size() != total){
+        abort(SDO_ABORT_GENERAL);
+        return false;
+    }
+    return send(0xA1, NULL, 0);
+}
+
+bool SdoClient::blockDownload(uint16_t index, uint8_t subindex, const void *data, size_t size){
+    const uint8_t* bytes = (const uint8_t*)data;
+    struct can_frame rsp;
+    if(size == 0) return download(index, subindex, data, size); // a block holds at least one byte
+    start(index, subindex);
+
+    // initiate: we compute the CRC, the size is indicated
+    uint8_t length[4];
+    putLe32(length, size);
+    if(!sendInitiate(0xC6, length, 4)) return false;
+    if(!receive(rsp)){
+        if(_serverAbort && _abortCode == SDO_ABORT_COMMAND) return download(index, subindex, data, size);
+        return false;
+    }
+    if(!expect(rsp, 0xE3, 0xA0) || !checkMux(rsp)) return false;
+    bool crc = rsp.data[0] & 0x04;
+    int blksize = rsp.data[4];
+
+    size_t pos = 0; // first byte not acknowledged by the server
+    int retries = 0;
+    while(pos < size){
+        if(blksize < 1 || blksize > 127){
+            abort(SDO_ABORT_BLOCK_SIZE);
+            return false;
+        }
+
+        // the whole block is sent in a row, the server confirms it once
+        std::vector<struct can_frame> frames;
+        size_t p = pos;
+        for(int seq=1; seq<=blksize && p<size; seq++){
+            struct can_frame msg;
+            int n = size - p > 7 ? 7 : size - p;
+            msg.can_id = 0x600 + _nodeid;
+            msg.can_dlc = 8;
+            memset(msg.data, 0, sizeof(msg.data));
+            msg.data[0] = seq | (p + n >= size ? 0x80 : 0x00);
+            memcpy(&msg.data[1], bytes + p, n);
+            frames.push_back(msg);
+            p += n;
+        }
+        int sent = 0;
+        while(sent < (int)frames.size()){
+            int n = _can->SendBatch(&frames[sent], frames.size() - sent, _errorCode);
+            if(n > 0) sent += n;
+            if(n < 0 && _errorCode != ENOBUFS && _errorCode != EAGAIN) return false;
+            if(sent < (int)frames.size()) usleep(100); // tx queue full, wait for the controller to send some frames
+        }
+        _errorCode = 0;
+        _frames += sent;
+
+        // block acknowledge: the last segment received in sequence and the size of the next block
+        if(!receive(rsp) || !expect(rsp, 0xE3, 0xA2)) return false;
+        int ackseq = rsp.data[1];
+        if(ackseq > (int)frames.size()){
+            abort(SDO_ABORT_SEQUENCE);
+            return false;
+        }
+        if(ackseq == 0 && ++retries >= SDO_BLOCK_RETRIES){
+            abort(SDO_ABORT_TIMEOUT);
+            return false;
+        }
+        if(ackseq > 0) retries = 0;
+        pos += (size_t)ackseq * 7 > size - pos ? size - pos : (size_t)ackseq * 7;
+        blksize = rsp.data[2];
+    }
+
+    // end: n bytes of the last segment did not contain data, then the CRC of the whole data
+    int unused = 7 - (int)(size - ((size - 1) / 7) * 7);
+    uint16_t check = crc ? crc16(bytes, size) : 0;
+    uint8_t end[2] = { (uint8_t)check, (uint8_t)(check >> 8) };
+    if(!send(0xC1 | (unused << 2), end, 2)) return false;
+    return receive(rsp) && expect(rsp, 0xE3, 0xA1);
+}
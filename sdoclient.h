@@ -0,0 +1,74 @@
+#ifndef SDOCLIENT_H
+#define SDOCLIENT_H
+
+#include <vector>
+#include <stdint.h>
+#include <stddef.h>
+
+#include "cantransport.h"
+#include "canreceiver.h"
+
+// SDO abort codes (CiA 301), sent by either side to end a transfer
+#define SDO_ABORT_TOGGLE        0x05030000 // toggle bit not alternated
+#define SDO_ABORT_TIMEOUT       0x05040000 // SDO protocol timed out
+#define SDO_ABORT_COMMAND       0x05040001 // client/server command specifier not valid or unknown
+#define SDO_ABORT_BLOCK_SIZE    0x05040002 // invalid block size
+#define SDO_ABORT_SEQUENCE      0x05040003 // invalid sequence number
+#define SDO_ABORT_CRC           0x05040004 // CRC error
+#define SDO_ABORT_MEMORY        0x05040005 // out of memory
+#define SDO_ABORT_GENERAL       0x08000000 // general error
+
+#define SDO_BLOCK_SIZE 127 // segments per block we accept in a block upload (the maximum of the protocol)
+
+// Client side of the SDO protocol (CiA 301) for the transfers of any size:
+// - expedited: up to 4 bytes in the initiate frame
+// - segmented: 7 bytes per frame, each segment is confirmed by the server
+// - block: up to 127 segments sent in a row and confirmed at once, the whole data is checked with a CRC
+// The requests are sent on can (COB-ID 0x600+node) and the responses (0x580+node) are read from the
+// mailbox of the node, filled by the receiver thread. Only one transfer at a time per node.
+class SdoClient
+{
+public:
+    SdoClient(CanTransport *can, CanMailbox *box, uint8_t nodeid, int timeoutMs);
+
+    bool upload(uint16_t index, uint8_t subindex, std::vector<uint8_t> &data);
+    // function to read an object of any size (expedited or segmented, as the server answers)
+    bool download(uint16_t index, uint8_t subindex, const void *data, size_t size);
+    // function to write an object, expedited up to 4 bytes, segmented above
+
+    bool blockUpload(uint16_t index, uint8_t subindex, std::vector<uint8_t> &data);
+    bool blockDownload(uint16_t index, uint8_t subindex, const void *data, size_t size);
+    // function to transfer an object with the block protocol (large objects: tables, files, firmware)
+    // fall back to the segmented transfer if the server does not support the block transfers
+
+    uint32_t getAbortCode() const { return _abortCode; } // abort code of the last failed transfer (0: no abort, see getErrorCode)
+    bool isAbortedByServer() const { return _serverAbort; }
+    int getErrorCode() const { return _errorCode; } // errno of the last failed send, 0 if the failure is an abort
+    int getFrameCount() const { return _frames; }    // number of frames exchanged during the last transfer
+
+    static const char* abortDescription(uint32_t abortCode); // function to get the CiA 301 meaning of an abort code
+    static uint16_t crc16(const uint8_t *data, size_t size, uint16_t crc = 0); // CRC-16-CCITT of the block transfers
+
+private:
+    bool send(uint8_t command, const uint8_t *payload, int len);
+    bool sendInitiate(uint8_t command, const uint8_t *payload, int len);
+    bool receive(struct can_frame &frame);
+    bool expect(const struct can_frame &frame, uint8_t mask, uint8_t command);
+    bool checkMux(const struct can_frame &frame);
+    void abort(uint32_t abortCode);
+    void start(uint16_t index, uint8_t subindex);
+
+    CanTransport *_can;
+    CanMailbox *_box;
+    uint8_t _nodeid;
+    int _timeoutMs;
+    uint16_t _index; // object of the transfer in progress
+    uint8_t _subindex;
+
+    uint32_t _abortCode;
+    bool _serverAbort;
+    int _errorCode;
+    int _frames;
+};
+
+#endif // SDOCLIENT_H
@@ -15,6 +15,7 @@ public:
 
     int16_t getMaxFocale(){ return _maxfocale; }
     int16_t getMinFocale(){ return _minfocale; }
+    int getFd(){ return _fd; } // to drive the tty from a DeviceLoop
 
 
 private:
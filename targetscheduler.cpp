@@ -0,0 +1,180 @@
+#include "targetscheduler.h"
+
+#include <algorithm>
+#include <string.h>
+
+#define SCHEDULE_MIN_GAIN 1e-9 // s, smaller gains are rounding errors
+#define OR_OPT_MAX_LENGTH 3    // longest run of targets moved by Or-opt
+
+TargetScheduler::TargetScheduler(const std::vector<AxisDynamics>& axes){
+    _axes = axes;
+    _size = 0;
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+double TargetScheduler::moveDuration(const std::vector<int32_t>& from, const std::vector<int32_t>& to) const {
+    double duration = 0;
+    unsigned int n = std::min(_axes.size(), std::min(from.size(), to.size()));
+    for(unsigned int i=0; i<n; i++){
+        duration = std::max(duration, AxisTrajectory::profileDuration((double)to[i] - (double)from[i], _axes[i]));
+    }
+    return duration;
+}
+
+std::vector<unsigned int> TargetScheduler::schedule(const std::vector<int32_t>& start, const std::vector<std::vector<int32_t> >& targets, double budgetMs){
+    Clock::time_point begin = Clock::now();
+    Clock::time_point deadline = begin + std::chrono::microseconds((int64_t)(budgetMs * 1000));
+    unsigned int n = targets.size();
+    memset(&_stats, 0, sizeof(_stats));
+    _stats.targets = n;
+
+    // every duration is computed once: the solver only reads the table
+    _size = n + 1;
+    _cost.assign(_size * _size, 0);
+    for(unsigned int i=0; i<_size; i++){
+        const std::vector<int32_t>& from = i < n ? targets[i] : start;
+        for(unsigned int j=i+1; j<_size; j++){
+            const std::vector<int32_t>& to = j < n ? targets[j] : start;
+            _cost[i * _size + j] = _cost[j * _size + i] = moveDuration(from, to);
+        }
+    }
+
+    // path[0] is the start, it never moves
+    std::vector<unsigned int> path(n + 1);
+    path[0] = n;
+    for(unsigned int i=0; i<n; i++){
+        path[i + 1] = i;
+    }
+    _stats.initialDuration = pathCost(path);
+
+    nearestNeighbour(path);
+    _stats.nearestDuration = pathCost(path);
+
+    _stats.complete = true;
+    while(true){
+        if(Clock::now() >= deadline){
+            _stats.complete = false;
+            break;
+        }
+        // the cheap 2-opt first, Or-opt only when it is stuck
+        if(twoOpt(path, deadline)) continue;
+        if(orOpt(path, deadline)) continue;
+        _stats.complete = Clock::now() < deadline;
+        break;
+    }
+    _stats.duration = pathCost(path);
+    _stats.elapsedMs = std::chrono::duration<double, std::milli>(Clock::now() - begin).count();
+
+    return std::vector<unsigned int>(path.begin() + 1, path.end());
+}
+
+double TargetScheduler::pathDuration(const std::vector<int32_t>& start, const std::vector<std::vector<int32_t> >& targets,
+                                     const std::vector<unsigned int>& order) const {
+    double duration = 0;
+    const std::vector<int32_t>* from = &start;
+    for(unsigned int i=0; i<order.size(); i++){
+        duration += moveDuration(*from, targets[order[i]]);
+        from = &targets[order[i]];
+    }
+    return duration;
+}
+
+double TargetScheduler::pathCost(const std::vector<unsigned int>& path) const {
+    double duration = 0;
+    for(unsigned int i=1; i<path.size(); i++){
+        duration += cost(path[i - 1], path[i]);
+    }
+    return duration;
+}
+
+void TargetScheduler::nearestNeighbour(std::vector<unsigned int>& path) const {
+    // from the start, always go to the closest target not visited yet
+    unsigned int n = path.size() - 1;
+    std::vector<bool> visited(n, false);
+    unsigned int current = n;
+    for(unsigned int k=1; k<=n; k++){
+        unsigned int best = n;
+        for(unsigned int i=0; i<n; i++){
+            if(visited[i]) continue;
+            if(best == n || cost(current, i) < cost(current, best)) best = i;
+        }
+        visited[best] = true;
+        path[k] = best;
+        current = best;
+    }
+}
+
+bool TargetScheduler::twoOpt(std::vector<unsigned int>& path, Clock::time_point deadline){
+    // visit path[i..j] backward when it is shorter: the moves path[i-1] -> path[i] and path[j] -> path[j+1]
+    // become path[i-1] -> path[j] and path[i] -> path[j+1] (the durations are symmetric)
+    unsigned int n = path.size() - 1;
+    bool improved = false;
+    for(unsigned int i=1; i<n; i++){
+        if(Clock::now() >= deadline) return improved;
+        for(unsigned int j=i+1; j<=n; j++){
+            double before = cost(path[i - 1], path[i]);
+            double after = cost(path[i - 1], path[j]);
+            if(j < n){
+                before += cost(path[j], path[j + 1]);
+                after += cost(path[i], path[j + 1]);
+            }
+            if(after < before - SCHEDULE_MIN_GAIN){
+                std::reverse(path.begin() + i, path.begin() + j + 1);
+                _stats.moves++;
+                improved = true;
+            }
+        }
+    }
+    return improved;
+}
+
+bool TargetScheduler::orOpt(std::vector<unsigned int>& path, Clock::time_point deadline){
+    // move the run path[i..i+length-1] between path[k] and path[k+1] (or after the last target), reversed or not
+    unsigned int n = path.size() - 1;
+    bool improved = false;
+    for(unsigned int length=1; length<=OR_OPT_MAX_LENGTH && length<n; length++){
+        for(unsigned int i=1; i+length-1<=n; i++){
+            if(Clock::now() >= deadline) return improved;
+            unsigned int last = i + length - 1;
+            unsigned int first = path[i];
+            unsigned int end = path[last];
+            unsigned int previous = path[i - 1];
+            // time saved by taking the run out of the path
+            double removed = cost(previous, first);
+            if(last < n) removed += cost(end, path[last + 1]) - cost(previous, path[last + 1]);
+
+            double best = -SCHEDULE_MIN_GAIN;
+            unsigned int bestK = 0;
+            bool bestReversed = false;
+            for(unsigned int k=0; k<=n; k++){
+                if(k >= i - 1 && k <= last) continue; // the run itself, or where it already is
+                double forward = cost(path[k], first);
+                double backward = cost(path[k], end);
+                if(k < n){
+                    forward += cost(end, path[k + 1]) - cost(path[k], path[k + 1]);
+                    backward += cost(first, path[k + 1]) - cost(path[k], path[k + 1]);
+                }
+                if(forward - removed < best){
+                    best = forward - removed;
+                    bestK = k;
+                    bestReversed = false;
+                }
+                if(length > 1 && backward - removed < best){
+                    best = backward - removed;
+                    bestK = k;
+                    bestReversed = true;
+                }
+            }
+            if(best >= -SCHEDULE_MIN_GAIN) continue;
+
+            std::vector<unsigned int> run(path.begin() + i, path.begin() + last + 1);
+            if(bestReversed) std::reverse(run.begin(), run.end());
+            path.erase(path.begin() + i, path.begin() + last + 1);
+            unsigned int insert = bestK < i ? bestK + 1 : bestK + 1 - length;
+            path.insert(path.begin() + insert, run.begin(), run.end());
+            _stats.moves++;
+            improved = true;
+        }
+    }
+    return improved;
+}
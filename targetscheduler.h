@@ -0,0 +1,64 @@
+#ifndef TARGETSCHEDULER_H
+#define TARGETSCHEDULER_H
+
+#include <chrono>
+#include <vector>
+#include <stdint.h>
+
+#include "trajectory.h"
+
+// Durations of the last schedule (s)
+struct ScheduleStats
+{
+    unsigned int targets;
+    double initialDuration; // in the order given
+    double nearestDuration; // after the nearest neighbour
+    double duration;        // after the local search
+    unsigned long moves;    // 2-opt and Or-opt moves applied
+    double elapsedMs;       // time spent by the solver
+    bool complete;          // local optimum reached, false if the time budget stopped the search
+};
+
+// Order of visit of the targets of the mirrors that shortens the total time of the moves.
+// Cost of a move: the axes move at the same time, each with the profile of its drive (see AxisTrajectory::profileDuration),
+// so the slowest axis gives the duration.
+// Solver: nearest neighbour from the current position, then local search until no move shortens the path
+// or the time budget is over:
+// - 2-opt: a part of the path is visited backward
+// - Or-opt: 1 to 3 consecutive targets are moved elsewhere in the path, in either direction
+// The path is open: it starts at the current position of the mirrors and ends at the last target.
+class TargetScheduler
+{
+public:
+    TargetScheduler(const std::vector<AxisDynamics>& axes);
+
+    double moveDuration(const std::vector<int32_t>& from, const std::vector<int32_t>& to) const;
+    // function to compute the duration of a move (s), from and to: positions of the axes (same units as the dynamics)
+
+    std::vector<unsigned int> schedule(const std::vector<int32_t>& start, const std::vector<std::vector<int32_t> >& targets, double budgetMs);
+    // function to order the targets
+    // start: current position of the axes
+    // budgetMs: time given to the solver, the nearest neighbour path is always computed
+    // return the indexes in targets, in the order of the visit
+
+    double pathDuration(const std::vector<int32_t>& start, const std::vector<std::vector<int32_t> >& targets,
+                        const std::vector<unsigned int>& order) const; // function to compute the time of the moves of a path (s)
+
+    const ScheduleStats& getStats() const { return _stats; }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    double cost(unsigned int from, unsigned int to) const { return _cost[from * _size + to]; }
+    double pathCost(const std::vector<unsigned int>& path) const;
+    void nearestNeighbour(std::vector<unsigned int>& path) const;
+    bool twoOpt(std::vector<unsigned int>& path, Clock::time_point deadline);
+    bool orOpt(std::vector<unsigned int>& path, Clock::time_point deadline);
+
+    std::vector<AxisDynamics> _axes;
+    std::vector<double> _cost; // durations between the points, the start is the last one
+    unsigned int _size;
+    ScheduleStats _stats;
+};
+
+#endif // TARGETSCHEDULER_H
@@ -0,0 +1,31 @@
+#-------------------------------------------------
+#
+# Frames/s of the single frame calls of the CAN transports against the batched ones
+#
+#-------------------------------------------------
+
+QT       += core
+QT       -= gui
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+TARGET = can_batch
+TEMPLATE = app
+
+SRC = ../..
+INCLUDEPATH += $$SRC
+
+SOURCES += main.cpp \
+    $$SRC/canreceiver.cpp \
+    $$SRC/cantransport.cpp \
+    $$SRC/canwrapper.cpp \
+    $$SRC/loopbackcan.cpp \
+    $$SRC/cancapture.cpp
+
+HEADERS += $$SRC/canreceiver.h \
+    $$SRC/canringbuffer.h \
+    $$SRC/cantransport.h \
+    $$SRC/canwrapper.h \
+    $$SRC/loopbackcan.h \
+    $$SRC/cancapture.h
@@ -0,0 +1,25 @@
+#-------------------------------------------------
+#
+# DeviceLoop against the per-call path of the devices (write, poll, read on each fd in turn)
+#
+#-------------------------------------------------
+
+CONFIG += c++11 console
+CONFIG -= qt app_bundle
+
+# io_uring backend of DeviceLoop (liburing >= 2.2): qmake CONFIG+=io_uring
+io_uring {
+    DEFINES += POODLE_IO_URING
+    LIBS += -luring
+}
+
+TARGET = device_loop
+TEMPLATE = app
+
+SRC = ../..
+INCLUDEPATH += $$SRC
+
+SOURCES += main.cpp \
+    $$SRC/deviceloop.cpp
+
+HEADERS += $$SRC/deviceloop.h
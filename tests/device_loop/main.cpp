@@ -0,0 +1,193 @@
+// DeviceLoop against the per-call path of the devices
+//
+// Three socket pairs stand for the CAN socket, the lens tty and the GPIO: a thread at the other end of each
+// answers every request at once, so the numbers are the cost of our side only.
+// A transaction is a request written to the device and the reply read back, with a timeout.
+// - per-call: what the GUI thread does today, one device after the other: write(), poll() until the reply, read()
+// - DeviceLoop: the three devices are in flight together, each completion submits the next operation
+//   of its device from the callback, runOnce is called in a loop by the measuring thread
+// Both are measured on the calling thread: transactions/s, CPU time and context switches per transaction.
+//
+// usage: device_loop [transactions]
+//   transactions: per device (default 20000)
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+
+#include "deviceloop.h"
+
+#define DEVICES 3
+#define MESSAGE_SIZE 8
+#define TIMEOUT_MS 100
+
+struct Device
+{
+    int fd;    // our end
+    int peer;  // end of the echo thread
+    char request[MESSAGE_SIZE];
+    char reply[MESSAGE_SIZE];
+    unsigned long done;
+};
+
+struct Usage
+{
+    double seconds;
+    double cpuSeconds;
+    long switches; // voluntary and involuntary context switches of the thread
+};
+
+static double clockSeconds(clockid_t clock){
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static long threadSwitches(){
+    struct rusage usage;
+    getrusage(RUSAGE_THREAD, &usage);
+    return usage.ru_nvcsw + usage.ru_nivcsw;
+}
+
+static Usage startUsage(){
+    Usage usage;
+    usage.seconds = clockSeconds(CLOCK_MONOTONIC);
+    usage.cpuSeconds = clockSeconds(CLOCK_THREAD_CPUTIME_ID);
+    usage.switches = threadSwitches();
+    return usage;
+}
+
+static Usage endUsage(const Usage& start){
+    Usage usage;
+    usage.seconds = clockSeconds(CLOCK_MONOTONIC) - start.seconds;
+    usage.cpuSeconds = clockSeconds(CLOCK_THREAD_CPUTIME_ID) - start.cpuSeconds;
+    usage.switches = threadSwitches() - start.switches;
+    return usage;
+}
+
+// function to answer every request of the device until its socket is closed
+static void echo(int fd){
+    char buf[MESSAGE_SIZE];
+    while(true){
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if(n <= 0) return;
+        if(write(fd, buf, n) != n) return;
+    }
+}
+
+// function to run the transactions one device after the other, with blocking syscalls
+static bool perCall(std::vector<Device>& devices, unsigned long count){
+    for(unsigned long i=0; i<count; i++){
+        for(unsigned int d=0; d<devices.size(); d++){
+            Device& device = devices[d];
+            if(write(device.fd, device.request, MESSAGE_SIZE) != MESSAGE_SIZE) return false;
+            struct pollfd pfd;
+            pfd.fd = device.fd;
+            pfd.events = POLLIN;
+            pfd.revents = 0;
+            if(poll(&pfd, 1, TIMEOUT_MS) <= 0) return false;
+            if(read(device.fd, device.reply, MESSAGE_SIZE) != MESSAGE_SIZE) return false;
+            device.done++;
+        }
+    }
+    return true;
+}
+
+static void submitTransaction(DeviceLoop& loop, Device& device, unsigned long count, int& failed);
+
+// function to read the reply of a transaction, then start the next one
+static void submitReply(DeviceLoop& loop, Device& device, unsigned long count, int& failed){
+    loop.submitRead(device.fd, device.reply, MESSAGE_SIZE, TIMEOUT_MS, [&loop, &device, count, &failed](int result){
+        if(result != MESSAGE_SIZE){
+            failed++;
+            return;
+        }
+        device.done++;
+        if(device.done < count) submitTransaction(loop, device, count, failed);
+    });
+}
+
+static void submitTransaction(DeviceLoop& loop, Device& device, unsigned long count, int& failed){
+    loop.submitWrite(device.fd, device.request, MESSAGE_SIZE, TIMEOUT_MS, [&loop, &device, count, &failed](int result){
+        if(result != MESSAGE_SIZE){
+            failed++;
+            return;
+        }
+        submitReply(loop, device, count, failed);
+    });
+}
+
+// function to run the transactions of every device at the same time through the loop
+static bool throughLoop(std::vector<Device>& devices, unsigned long count){
+    DeviceLoop loop;
+    int errorCode;
+    if(!loop.init(DEVICE_LOOP_DEPTH, errorCode)){
+        fprintf(stderr, "cannot create the loop (error %d)\n", errorCode);
+        return false;
+    }
+    int failed = 0;
+    for(unsigned int d=0; d<devices.size(); d++){
+        submitTransaction(loop, devices[d], count, failed);
+    }
+    while(!failed){
+        bool finished = true;
+        for(unsigned int d=0; d<devices.size(); d++){
+            finished = finished && devices[d].done >= count;
+        }
+        if(finished) break;
+        if(loop.runOnce(TIMEOUT_MS) < 0) return false;
+    }
+    return failed == 0;
+}
+
+static void report(const char* name, const Usage& usage, unsigned long transactions, bool ok){
+    printf("%-10s %8.0f transactions/s, %5.2f us CPU and %.3f context switches per transaction%s\n", name,
+           transactions / usage.seconds, usage.cpuSeconds * 1e6 / transactions, (double)usage.switches / transactions,
+           ok ? "" : " (FAILED)");
+}
+
+int main(int argc, char** argv){
+    unsigned long count = argc > 1 ? strtoul(argv[1], NULL, 10) : 20000;
+
+    std::vector<Device> devices(DEVICES);
+    std::vector<std::thread> peers;
+    for(unsigned int d=0; d<devices.size(); d++){
+        int fds[2];
+        if(socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, fds) < 0){
+            perror("socketpair");
+            return 2;
+        }
+        devices[d].fd = fds[0];
+        devices[d].peer = fds[1];
+        memset(devices[d].request, 'a' + d, MESSAGE_SIZE);
+        peers.push_back(std::thread(echo, fds[1]));
+    }
+
+    printf("%u devices, %lu transactions each, DeviceLoop backend: %s\n", DEVICES, count, DeviceLoop::backend());
+
+    for(unsigned int d=0; d<devices.size(); d++) devices[d].done = 0;
+    Usage start = startUsage();
+    bool ok = perCall(devices, count);
+    report("per-call", endUsage(start), count * DEVICES, ok);
+
+    for(unsigned int d=0; d<devices.size(); d++) devices[d].done = 0;
+    start = startUsage();
+    ok = throughLoop(devices, count);
+    report("DeviceLoop", endUsage(start), count * DEVICES, ok);
+
+    for(unsigned int d=0; d<devices.size(); d++){
+        shutdown(devices[d].fd, SHUT_RDWR);
+        peers[d].join();
+        close(devices[d].fd);
+        close(devices[d].peer);
+    }
+    return 0;
+}
@@ -0,0 +1,168 @@
+// SDO success rate and round trip time under background traffic
+//
+// A simulated drive answers the SDO requests of the client while the bus carries the frames that used to make
+// the SDO calls fail: heartbeats of many nodes, EMCY messages, and a second node answering the requests of
+// a second client. The client only registers for its own response COB-ID (kernel filter of the receiver),
+// so every transfer should succeed whatever the load.
+//
+// usage: sdo_traffic [interface] [transfers]
+//   interface: vcan0 (SocketCAN) or loop0 (in-process loopback, the default)
+//   transfers: number of expedited uploads of the measured client (default 20000)
+// exit code 0 when every transfer succeeded
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+#include "cantransport.h"
+#include "canreceiver.h"
+#include "sdoclient.h"
+#include "virtualdrive.h"
+
+#define MEASURED_NODE 3        // node of the measured client
+#define OTHER_NODE 4           // node of the second client, its responses are noise for the first one
+#define HEARTBEAT_FIRST 0x10   // the nodes HEARTBEAT_FIRST to HEARTBEAT_LAST send heartbeats
+#define HEARTBEAT_LAST 0x1F
+#define HEARTBEAT_PERIOD_US 1000
+#define EMCY_NODE 0x20
+#define EMCY_PERIOD_US 5000
+#define SDO_TIMEOUT_MS 100
+#define REG_STATUSWORD 0x6041
+
+static std::atomic<bool> running(true);
+
+typedef std::chrono::steady_clock Clock;
+
+// function to flood the bus with heartbeats and EMCY messages until the end of the test
+static void noise(const char* interfaceName, unsigned long* sent){
+    CanTransport* can = CanTransport::create(interfaceName);
+    int errorCode;
+    if(!can->Init(interfaceName, errorCode)){
+        fprintf(stderr, "noise: cannot open %s (error %d)\n", interfaceName, errorCode);
+        delete can;
+        return;
+    }
+
+    std::vector<struct can_frame> heartbeats;
+    for(int node=HEARTBEAT_FIRST; node<=HEARTBEAT_LAST; node++){
+        struct can_frame frame;
+        memset(&frame, 0, sizeof(frame));
+        frame.can_id = 0x700 + node;
+        frame.can_dlc = 1;
+        frame.data[0] = 0x05; // operational
+        heartbeats.push_back(frame);
+    }
+    struct can_frame emcy;
+    memset(&emcy, 0, sizeof(emcy));
+    emcy.can_id = 0x80 + EMCY_NODE;
+    emcy.can_dlc = 8;
+    emcy.data[0] = 0x10; // generic current error
+    emcy.data[1] = 0x23;
+
+    Clock::time_point next = Clock::now();
+    Clock::time_point nextEmcy = next;
+    while(running){
+        int n = can->SendBatch(&heartbeats[0], heartbeats.size(), errorCode);
+        if(n > 0) *sent += n;
+        if(Clock::now() >= nextEmcy){
+            if(can->SendMsg(emcy, false, false, errorCode)) (*sent)++;
+            nextEmcy += std::chrono::microseconds(EMCY_PERIOD_US);
+        }
+        next += std::chrono::microseconds(HEARTBEAT_PERIOD_US);
+        std::this_thread::sleep_until(next);
+    }
+    delete can;
+}
+
+// function to keep the second node busy with SDO requests until the end of the test
+static void otherClient(CanTransport* can, CanReceiver* rx, unsigned long* transfers){
+    CanMailbox box;
+    int handler = rx->addHandler(0x580 + OTHER_NODE, 0x7FF, [&box](const CanRxFrame& frame){ box.post(frame); });
+    SdoClient client(can, &box, OTHER_NODE, SDO_TIMEOUT_MS);
+    std::vector<uint8_t> data;
+    while(running){
+        if(client.upload(REG_STATUSWORD, 0, data)) (*transfers)++;
+    }
+    rx->removeHandler(handler);
+}
+
+int main(int argc, char** argv){
+    const char* interfaceName = argc > 1 ? argv[1] : "loop0";
+    unsigned long count = argc > 2 ? strtoul(argv[2], NULL, 10) : 20000;
+    int errorCode;
+
+    // the drives, each with its own socket as real nodes
+    VirtualDriveConfig config = defaultVirtualDriveConfig();
+    config.latencyUs = 0; // the round trip is the one of the bus and of the client
+    config.jitterUs = 0;
+    VirtualDrive measured(MEASURED_NODE, config);
+    VirtualDrive other(OTHER_NODE, config);
+    if(!measured.start(interfaceName, errorCode) || !other.start(interfaceName, errorCode)){
+        fprintf(stderr, "cannot start the drives on %s (error %d)\n", interfaceName, errorCode);
+        return 2;
+    }
+
+    CanTransport* can = CanTransport::create(interfaceName);
+    if(!can->Init(interfaceName, errorCode)){
+        fprintf(stderr, "cannot open %s (error %d)\n", interfaceName, errorCode);
+        return 2;
+    }
+    CanReceiver rx(can);
+    CanMailbox box;
+    rx.addHandler(0x580 + MEASURED_NODE, 0x7FF, [&box](const CanRxFrame& frame){ box.post(frame); });
+    rx.start();
+
+    unsigned long noiseFrames = 0, otherTransfers = 0;
+    std::thread noiseThread(noise, interfaceName, &noiseFrames);
+    std::thread otherThread(otherClient, can, &rx, &otherTransfers);
+    usleep(20000); // the background traffic is there before the first transfer
+
+    SdoClient client(can, &box, MEASURED_NODE, SDO_TIMEOUT_MS);
+    std::vector<uint8_t> data;
+    std::vector<double> rtt;
+    rtt.reserve(count);
+    unsigned long failed = 0;
+    Clock::time_point begin = Clock::now();
+    for(unsigned long i=0; i<count; i++){
+        Clock::time_point sent = Clock::now();
+        if(!client.upload(REG_STATUSWORD, 0, data) || data.size() != 2){
+            if(failed < 10){
+                fprintf(stderr, "transfer %lu failed: abort %08X (%s), error %d\n", i, client.getAbortCode(),
+                        SdoClient::abortDescription(client.getAbortCode()), client.getErrorCode());
+            }
+            failed++;
+            continue;
+        }
+        rtt.push_back(std::chrono::duration<double, std::micro>(Clock::now() - sent).count());
+    }
+    double elapsed = std::chrono::duration<double>(Clock::now() - begin).count();
+
+    running = false;
+    noiseThread.join();
+    otherThread.join();
+    rx.stop();
+    measured.stop();
+    other.stop();
+    delete can;
+
+    printf("interface %s, %lu transfers in %.2f s (%.0f SDO/s)\n", interfaceName, count, elapsed, count / elapsed);
+    printf("background: %lu heartbeat/EMCY frames (%.0f frames/s), %lu SDO of node %d\n",
+           noiseFrames, noiseFrames / elapsed, otherTransfers, OTHER_NODE);
+    printf("success: %lu/%lu (%.3f %%)\n", count - failed, count, count ? 100.0 * (count - failed) / count : 0.0);
+    if(!rtt.empty()){
+        std::sort(rtt.begin(), rtt.end());
+        double sum = 0;
+        for(unsigned int i=0; i<rtt.size(); i++){
+            sum += rtt[i];
+        }
+        printf("round trip (us): min %.1f, mean %.1f, median %.1f, p99 %.1f, max %.1f\n", rtt.front(), sum / rtt.size(),
+               rtt[rtt.size() / 2], rtt[(rtt.size() * 99) / 100], rtt.back());
+    }
+    return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,35 @@
+#-------------------------------------------------
+#
+# SDO success rate and round trip time with heartbeat, EMCY and SDO traffic of other nodes on the bus
+#
+#-------------------------------------------------
+
+QT       += core
+QT       -= gui
+
+CONFIG += c++11 console
+CONFIG -= app_bundle
+
+TARGET = sdo_traffic
+TEMPLATE = app
+
+SRC = ../..
+INCLUDEPATH += $$SRC
+
+SOURCES += main.cpp \
+    $$SRC/sdoclient.cpp \
+    $$SRC/canreceiver.cpp \
+    $$SRC/cantransport.cpp \
+    $$SRC/canwrapper.cpp \
+    $$SRC/loopbackcan.cpp \
+    $$SRC/cancapture.cpp \
+    $$SRC/virtualdrive.cpp
+
+HEADERS += $$SRC/sdoclient.h \
+    $$SRC/canreceiver.h \
+    $$SRC/canringbuffer.h \
+    $$SRC/cantransport.h \
+    $$SRC/canwrapper.h \
+    $$SRC/loopbackcan.h \
+    $$SRC/cancapture.h \
+    $$SRC/virtualdrive.h
@@ -0,0 +1,91 @@
+// Total move time of the mirrors over synthetic weed fields, in the order of the camera and in the order of TargetScheduler
+//
+// Each field is generated from a fixed seed, so the runs can be compared from one build to the other:
+// - uniform: the weeds are spread over the whole field of the mirrors
+// - patchy: the weeds grow in a few clumps
+// The targets are given in raster order (image rows, then columns), as the weeding loop finds them, and are scheduled
+// with the time budget of the GUI. The durations are the ones of ScheduleStats.
+//
+// usage: target_scheduler [seed]
+
+#include <algorithm>
+#include <random>
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "targetscheduler.h"
+
+#define SCHEDULE_BUDGET_MS 20 // same as the weeding loop of the GUI
+#define FIELD_HALF_SIZE 100000 // counts, the targets are within +/- this on both axes
+#define RASTER_ROW 2000        // counts, height of an image row
+#define PATCHES 5              // clumps of a patchy field
+#define PATCH_HALF_SIZE 10000  // counts
+
+typedef std::vector<std::vector<int32_t> > Targets;
+
+// function to generate count targets, uniform or in patches, sorted in raster order
+static Targets makeField(unsigned int count, bool patchy, std::mt19937& random){
+    std::uniform_int_distribution<int32_t> field(-FIELD_HALF_SIZE, FIELD_HALF_SIZE);
+    std::uniform_int_distribution<int32_t> patch(-PATCH_HALF_SIZE, PATCH_HALF_SIZE);
+    std::uniform_int_distribution<unsigned int> whichPatch(0, PATCHES - 1);
+
+    std::vector<std::vector<int32_t> > centers(PATCHES, std::vector<int32_t>(2));
+    for(unsigned int i=0; i<centers.size(); i++){
+        centers[i][0] = field(random) * (FIELD_HALF_SIZE - PATCH_HALF_SIZE) / FIELD_HALF_SIZE;
+        centers[i][1] = field(random) * (FIELD_HALF_SIZE - PATCH_HALF_SIZE) / FIELD_HALF_SIZE;
+    }
+
+    Targets targets(count, std::vector<int32_t>(2));
+    for(unsigned int i=0; i<count; i++){
+        if(patchy){
+            const std::vector<int32_t>& center = centers[whichPatch(random)];
+            targets[i][0] = center[0] + patch(random);
+            targets[i][1] = center[1] + patch(random);
+        }else{
+            targets[i][0] = field(random);
+            targets[i][1] = field(random);
+        }
+    }
+
+    std::sort(targets.begin(), targets.end(), [](const std::vector<int32_t>& a, const std::vector<int32_t>& b){
+        int32_t rowA = a[1] / RASTER_ROW;
+        int32_t rowB = b[1] / RASTER_ROW;
+        return rowA != rowB ? rowA < rowB : a[0] < b[0];
+    });
+    return targets;
+}
+
+int main(int argc, char** argv){
+    unsigned int seed = argc > 1 ? strtoul(argv[1], NULL, 10) : 1;
+    const unsigned int sizes[4] = {10, 50, 200, 500};
+
+    // profile position parameters of the simulated drive (see defaultVirtualDriveConfig), the second axis a bit slower
+    std::vector<AxisDynamics> axes(2);
+    axes[0].velocity = 200000;
+    axes[0].acceleration = 2000000;
+    axes[0].deceleration = 2000000;
+    axes[1].velocity = 150000;
+    axes[1].acceleration = 1500000;
+    axes[1].deceleration = 3000000;
+
+    printf("seed %u, budget %d ms\n", seed, SCHEDULE_BUDGET_MS);
+    printf("%7s %8s %10s %10s %10s %7s %9s %8s %6s\n", "targets", "field", "raster ms", "nearest ms", "final ms", "gain %",
+           "solver ms", "complete", "moves");
+    for(unsigned int s=0; s<4; s++){
+        for(int patchy=0; patchy<2; patchy++){
+            std::mt19937 random(seed * 1000 + sizes[s] * 2 + patchy);
+            Targets targets = makeField(sizes[s], patchy != 0, random);
+            std::vector<int32_t> start(2, 0);
+
+            TargetScheduler scheduler(axes);
+            scheduler.schedule(start, targets, SCHEDULE_BUDGET_MS);
+            const ScheduleStats& stats = scheduler.getStats();
+            printf("%7u %8s %10.1f %10.1f %10.1f %7.1f %9.2f %8s %6lu\n", stats.targets, patchy ? "patchy" : "uniform",
+                   stats.initialDuration * 1000, stats.nearestDuration * 1000, stats.duration * 1000,
+                   100 * (1 - stats.duration / stats.initialDuration), stats.elapsedMs, stats.complete ? "yes" : "no",
+                   stats.moves);
+        }
+    }
+    return 0;
+}
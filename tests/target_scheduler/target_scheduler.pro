@@ -0,0 +1,21 @@
+#-------------------------------------------------
+#
+# Total move time of the mirrors over synthetic weed fields, in raster order and ordered by TargetScheduler
+#
+#-------------------------------------------------
+
+CONFIG += c++11 console
+CONFIG -= qt app_bundle
+
+TARGET = target_scheduler
+TEMPLATE = app
+
+SRC = ../..
+INCLUDEPATH += $$SRC
+
+SOURCES += main.cpp \
+    $$SRC/targetscheduler.cpp \
+    $$SRC/trajectory.cpp
+
+HEADERS += $$SRC/targetscheduler.h \
+    $$SRC/trajectory.h
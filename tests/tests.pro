@@ -0,0 +1,17 @@
+#-------------------------------------------------
+#
+# Test and benchmark programs (CAN stack on a vcan interface or on the in-process loopback, DeviceLoop, TargetScheduler):
+#   qmake tests/tests.pro && make
+#   sdo_traffic/sdo_traffic vcan0
+#   can_batch/can_batch vcan0
+#   device_loop/device_loop (qmake CONFIG+=io_uring tests/tests.pro for the io_uring backend)
+#   target_scheduler/target_scheduler
+#
+#-------------------------------------------------
+
+TEMPLATE = subdirs
+
+SUBDIRS += sdo_traffic \
+    can_batch \
+    device_loop \
+    target_scheduler
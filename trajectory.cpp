@@ -0,0 +1,71 @@
+#include "trajectory.h"
+
+#include <math.h>
+
+AxisTrajectory::AxisTrajectory(){
+    hold(0);
+}
+
+void AxisTrajectory::start(int32_t from, int32_t to, double duration){
+    _from = from;
+    _to = to;
+    _duration = duration > 0 ? duration : 0;
+}
+
+void AxisTrajectory::hold(int32_t position){
+    start(position, position, 0);
+}
+
+int32_t AxisTrajectory::at(double t) const {
+    if(t <= 0) return _from;
+    if(t >= _duration) return _to;
+    // s(u) = 10u^3 - 15u^4 + 6u^5, u in [0, 1]
+    double u = t / _duration;
+    double s = u*u*u * (10.0 + u * (-15.0 + 6.0 * u));
+    return _from + (int32_t)lround(s * ((double)_to - (double)_from));
+}
+
+double AxisTrajectory::minimumDuration(int32_t from, int32_t to, double maxSpeed){
+    // the peak speed of the profile, at the middle of the move, is 15/8 of the mean speed
+    if(maxSpeed <= 0) return 0;
+    return 1.875 * fabs((double)to - (double)from) / maxSpeed;
+}
+
+double AxisTrajectory::profileDuration(double distance, const AxisDynamics& dynamics){
+    distance = fabs(distance);
+    if(distance == 0 || dynamics.velocity <= 0) return 0;
+    double v = dynamics.velocity;
+    // a ramp of 0 is taken as an instant change of speed, like the drives do
+    double ta = dynamics.acceleration > 0 ? 1.0 / dynamics.acceleration : 0; // time to gain 1 count/s
+    double td = dynamics.deceleration > 0 ? 1.0 / dynamics.deceleration : 0;
+    double ramps = v * v * (ta + td) / 2; // distance to reach the velocity and to stop from it
+    if(distance >= ramps) return distance / v + v * (ta + td) / 2;
+    // triangular profile: the peak speed is not reached
+    double peak = sqrt(2 * distance / (ta + td));
+    return peak * (ta + td);
+}
+
+double AxisTrajectory::synchronize(const std::vector<double>& distances, const std::vector<AxisDynamics>& limits, std::vector<AxisDynamics>& profiles){
+    unsigned int n = distances.size();
+    std::vector<double> fastest(n);
+    double duration = 0;
+    for(unsigned int i=0; i<n; i++){
+        fastest[i] = profileDuration(distances[i], limits[i]);
+        if(fastest[i] > duration) duration = fastest[i];
+    }
+    // a profile run k times slower in speed and k^2 in acceleration has the same shape and lasts 1/k longer
+    profiles.resize(n);
+    for(unsigned int i=0; i<n; i++){
+        if(fastest[i] <= 0){
+            profiles[i].velocity = 0;
+            profiles[i].acceleration = 0;
+            profiles[i].deceleration = 0;
+            continue;
+        }
+        double k = fastest[i] / duration;
+        profiles[i].velocity = limits[i].velocity * k;
+        profiles[i].acceleration = limits[i].acceleration * k * k;
+        profiles[i].deceleration = limits[i].deceleration * k * k;
+    }
+    return duration;
+}
@@ -0,0 +1,48 @@
+#ifndef TRAJECTORY_H
+#define TRAJECTORY_H
+
+#include <vector>
+#include <stdint.h>
+
+// Profile of an axis in profile position: 0x6081 capped by 0x607F, 0x6083 and 0x6084
+struct AxisDynamics
+{
+    double velocity;     // counts/s
+    double acceleration; // counts/s^2
+    double deceleration; // counts/s^2
+};
+
+// Set points of one axis going from a position to another in a given time.
+// Minimum jerk profile (5th order polynomial): the speed and the acceleration are zero at both ends,
+// so the set points can be streamed to a drive in cyclic synchronous position without any jolt.
+class AxisTrajectory
+{
+public:
+    AxisTrajectory();
+
+    void start(int32_t from, int32_t to, double duration); // function to start a move of duration seconds
+    void hold(int32_t position);                          // function to stay at position
+
+    int32_t at(double t) const;             // set point at t seconds from the start of the move
+    bool isFinished(double t) const { return t >= _duration; }
+    int32_t getTarget() const { return _to; }
+    double getDuration() const { return _duration; }
+
+    static double minimumDuration(int32_t from, int32_t to, double maxSpeed);
+    // function to compute the shortest duration of a move keeping the peak speed under maxSpeed (counts/s)
+    static double profileDuration(double distance, const AxisDynamics& dynamics);
+    // function to compute the duration of a move of the profile generator of a drive (trapezoidal, triangular for the short moves)
+    // distance: counts, the sign does not matter
+    static double synchronize(const std::vector<double>& distances, const std::vector<AxisDynamics>& limits, std::vector<AxisDynamics>& profiles);
+    // function to compute the profiles of axes moving at the same time so that they arrive together, as soon as possible:
+    // the slowest axis moves at its limits, the others are slowed down to its duration (velocity scaled by k, ramps by k^2)
+    // profiles: velocity 0 for an axis that does not move
+    // return the duration of the move (s)
+
+private:
+    int32_t _from;
+    int32_t _to;
+    double _duration;
+};
+
+#endif // TRAJECTORY_H
@@ -0,0 +1,893 @@
+#include "virtualdrive.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+// states of the CiA 402 state machine, as the bits 0-6 of the statusword (see Motor_CANOpen_Driver::getStateFromStatusWord)
+#define DS402_NOTREADY 0x00
+#define DS402_DISABLED 0x50
+#define DS402_READY 0x31
+#define DS402_SWITCHEDON 0x33
+#define DS402_ENABLED 0x37
+#define DS402_QUICKSTOP 0x17
+#define DS402_FAULT 0x18
+
+// modes of operation supported by the drive
+#define DS402_MODE_PPOS 1
+#define DS402_MODE_PVEL 3
+#define DS402_MODE_IPOS 7
+#define DS402_MODE_CSP 8
+
+#define NMT_STATE_INIT 0x00 // also the content of the boot-up message
+#define NMT_STATE_STOP 0x04
+#define NMT_STATE_OP 0x05
+#define NMT_STATE_PREOP 0x7F
+
+// SDO abort codes of the server side (CiA 301), the client ones are in sdoclient.h
+#define ABORT_TOGGLE 0x05030000
+#define ABORT_COMMAND 0x05040001
+#define ABORT_READ_ONLY 0x06010002
+#define ABORT_NO_OBJECT 0x06020000
+#define ABORT_NOT_MAPPABLE 0x06040041
+#define ABORT_PDO_LENGTH 0x06040042
+#define ABORT_LENGTH_HIGH 0x06070012
+#define ABORT_LENGTH_LOW 0x06070013
+#define ABORT_NO_SUBINDEX 0x06090011
+#define ABORT_VALUE 0x06090030
+#define ABORT_VALUE_HIGH 0x06090031
+#define ABORT_DEVICE_STATE 0x08000022
+
+#define KEY(index, subindex) (((uint32_t)(index) << 8) | (subindex))
+
+VirtualDriveConfig defaultVirtualDriveConfig(){
+    VirtualDriveConfig config;
+    config.latencyUs = 300;
+    config.jitterUs = 100;
+    config.cycleUs = 1000;
+    config.bootMs = 5;
+    config.velocity = 200000;
+    config.acceleration = 2000000;
+    config.deceleration = 2000000;
+    config.maxVelocity = 1000000;
+    return config;
+}
+
+VirtualDrive::VirtualDrive(uint8_t nodeid, const VirtualDriveConfig& config) : _random(nodeid){
+    _nodeid = nodeid & 0x7F;
+    _config = config;
+    if(_config.cycleUs < 100) _config.cycleUs = 100;
+    _can = NULL;
+    _rx = NULL;
+    _running = false;
+    _nmtState = NMT_STATE_INIT;
+    _booting = false;
+    _resetApplication = true;
+    _segmented.active = false;
+    _sdoCount = 0;
+    _syncCount = 0;
+    _state = DS402_NOTREADY;
+    _controlword = 0;
+    _position = 0;
+    _velocity = 0;
+    _target = 0;
+    _nextTarget = 0;
+    _hasNext = false;
+    _setPointAck = false;
+    _targetReached = true;
+    _ipBufferEnabled = false;
+}
+
+VirtualDrive::~VirtualDrive(){
+    stop();
+}
+
+bool VirtualDrive::start(const char* interfaceName, int& errorCode){
+    if(_can != NULL) return true;
+    _can = CanTransport::create(interfaceName);
+    if(!_can->Init(interfaceName, errorCode)){
+        delete _can;
+        _can = NULL;
+        return false;
+    }
+    // NMT and SYNC for everyone, then the frames addressed to this node (SDO requests, RPDO)
+    _rx = new CanReceiver(_can);
+    _rx->addHandler(0x000, 0x7FF, [this](const CanRxFrame& rx){ onFrame(rx); });
+    _rx->addHandler(0x080, 0x7FF, [this](const CanRxFrame& rx){ onFrame(rx); });
+    _rx->addHandler(_nodeid, 0x7F, [this](const CanRxFrame& rx){ onFrame(rx); });
+
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        // power on: initialisation, then the boot-up message
+        _resetApplication = true;
+        _booting = true;
+        _bootAt = Clock::now();
+        _running = true;
+    }
+    if(!_rx->start()){
+        errorCode = 0;
+        stop();
+        return false;
+    }
+    _thread = std::thread(&VirtualDrive::loop, this);
+    return true;
+}
+
+void VirtualDrive::stop(){
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _running = false;
+    }
+    _cond.notify_all();
+    if(_thread.joinable()) _thread.join();
+    if(_rx != NULL){
+        _rx->stop();
+        delete _rx;
+        _rx = NULL;
+    }
+    if(_can != NULL){
+        _can->Close();
+        delete _can;
+        _can = NULL;
+    }
+}
+
+int32_t VirtualDrive::getPosition(){
+    std::lock_guard<std::mutex> lock(_mutex);
+    return lround(_position);
+}
+
+uint16_t VirtualDrive::getStatusword(){
+    std::lock_guard<std::mutex> lock(_mutex);
+    return get(0x6041);
+}
+
+uint8_t VirtualDrive::getNmtState(){
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _nmtState;
+}
+
+unsigned long VirtualDrive::getSdoCount(){
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _sdoCount;
+}
+
+void VirtualDrive::injectFault(uint16_t emcyCode){
+    std::lock_guard<std::mutex> lock(_mutex);
+    if(_state == DS402_FAULT) return;
+    stopMotion();
+    _state = DS402_FAULT;
+    set(0x1001, 0, 0x01); // generic error
+    sendEmcy(emcyCode, 0x01);
+    updateStatusword();
+    sendTpdos(false);
+}
+
+void VirtualDrive::loop(){
+    // time based work of the drive: delayed SDO answers, boot-up, profile generator, heartbeat, TPDO timers
+    std::chrono::microseconds cycle(_config.cycleUs);
+    std::unique_lock<std::mutex> lock(_mutex);
+    Clock::time_point nextTick = Clock::now() + cycle;
+    while(_running){
+        Clock::time_point next = nextTick;
+        if(!_sdoQueue.empty() && _sdoQueue.front().due < next) next = _sdoQueue.front().due;
+        if(_booting && _bootAt < next) next = _bootAt;
+        _cond.wait_until(lock, next);
+        if(!_running) break;
+
+        Clock::time_point now = Clock::now();
+        if(_booting && now >= _bootAt) boot();
+        while(!_sdoQueue.empty() && _sdoQueue.front().due <= now){
+            processSdo(_sdoQueue.front().request);
+            _sdoQueue.pop_front();
+        }
+
+        if(now >= nextTick){
+            step(_config.cycleUs / 1e6);
+            uint16_t heartbeat = get(0x1017);
+            if(!_booting && heartbeat > 0 && now >= _nextHeartbeat){
+                sendFrame(0x700 + _nodeid, &_nmtState, 1);
+                _nextHeartbeat += std::chrono::milliseconds(heartbeat);
+                if(_nextHeartbeat < now) _nextHeartbeat = now + std::chrono::milliseconds(heartbeat);
+            }
+            nextTick += cycle;
+            if(nextTick < now) nextTick = now + cycle; // late (loaded machine): the lost cycles are skipped
+        }
+        sendTpdos(false);
+    }
+}
+
+void VirtualDrive::onFrame(const CanRxFrame& rx){
+    if(rx.fd) return;
+    const struct can_frame& frame = rx.frame;
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    if(frame.can_id == 0x000){
+        if(frame.can_dlc >= 2 && (frame.data[1] == 0 || frame.data[1] == _nodeid)) onNmt(frame.data[0]);
+        return;
+    }
+    if(_booting) return;
+
+    if(frame.can_id == 0x080){
+        if(_nmtState == NMT_STATE_OP) onSync();
+        return;
+    }
+
+    if(frame.can_id == (canid_t)(0x600 + _nodeid)){
+        if(_config.latencyUs <= 0 && _config.jitterUs <= 0){
+            processSdo(frame);
+            sendTpdos(false);
+            return;
+        }
+        // the answers keep the order of the requests
+        PendingSdo pending;
+        pending.request = frame;
+        int delay = std::max(0, _config.latencyUs);
+        if(_config.jitterUs > 0) delay += std::uniform_int_distribution<int>(0, _config.jitterUs)(_random);
+        pending.due = Clock::now() + std::chrono::microseconds(delay);
+        if(!_sdoQueue.empty() && pending.due < _sdoQueue.back().due) pending.due = _sdoQueue.back().due;
+        _sdoQueue.push_back(pending);
+        _cond.notify_all();
+        return;
+    }
+
+    if(_nmtState != NMT_STATE_OP) return;
+    for(int i=0; i<4; i++){
+        uint32_t cobid = get(0x1400 + i, 1);
+        if((cobid & 0x80000000) || (cobid & 0x7FF) != frame.can_id) continue;
+        if(get(0x1400 + i, 2) <= 240){
+            _rpdoData[i].assign(frame.data, frame.data + frame.can_dlc); // synchronous: applied at the next SYNC
+        }else{
+            applyRpdo(i, frame.data, frame.can_dlc);
+            sendTpdos(false);
+        }
+        return;
+    }
+}
+
+void VirtualDrive::boot(){
+    // end of a reset: default values, pre-operational, boot-up message
+    _booting = false;
+    resetObjects(!_resetApplication);
+    if(_resetApplication){
+        _state = DS402_DISABLED; // not ready to switch on is left at once, there is no power stage to check
+        _controlword = 0;
+        stopMotion();
+        _ipBuffer.clear();
+        _ipBufferEnabled = false;
+    }
+    _segmented.active = false;
+    _sdoQueue.clear();
+    for(int i=0; i<4; i++){
+        _rpdoData[i].clear();
+        _tpdoLast[i].clear();
+        _tpdoSent[i] = Clock::time_point();
+    }
+    _syncCount = 0;
+    updatePosition();
+    updateStatusword();
+
+    uint8_t bootup = NMT_STATE_INIT;
+    sendFrame(0x700 + _nodeid, &bootup, 1);
+    _nmtState = NMT_STATE_PREOP;
+    _nextHeartbeat = Clock::now() + std::chrono::milliseconds(get(0x1017));
+}
+
+void VirtualDrive::addObject(uint16_t index, uint8_t subindex, size_t size, uint32_t value, bool writable, bool mappable){
+    Object& object = _od[KEY(index, subindex)];
+    object.data.resize(size);
+    for(size_t i=0; i<size; i++){
+        object.data[i] = i < 4 ? (value >> (8*i)) & 0xFF : 0;
+    }
+    object.writable = writable;
+    object.mappable = mappable;
+}
+
+void VirtualDrive::addString(uint16_t index, const char* value){
+    Object& object = _od[KEY(index, 0)];
+    object.data.assign(value, value + strlen(value));
+    object.writable = false;
+    object.mappable = false;
+}
+
+void VirtualDrive::resetObjects(bool communicationOnly){
+    // default values of the object dictionary, after a reset node (everything) or a reset communication (0x1000-0x1FFF)
+    addObject(0x1000, 0, 4, 0x00020192, false);   // device type: CiA 402 servo drive
+    addObject(0x1001, 0, 1, 0, false, true);      // error register
+    addString(0x1008, "Poodle virtual drive");    // longer than 4 bytes: segmented upload
+    addString(0x1009, "1.0");
+    addString(0x100A, "1.0");
+    addObject(0x1017, 0, 2, 0);                   // producer heartbeat time (ms)
+    addObject(0x1018, 0, 1, 4, false);            // identity
+    addObject(0x1018, 1, 4, 0, false);
+    addObject(0x1018, 2, 4, 0x402, false);
+    addObject(0x1018, 3, 4, 1, false);
+    addObject(0x1018, 4, 4, _nodeid, false);
+
+    // RPDO1: controlword, TPDO1: statusword, the other PDO are disabled and not mapped
+    for(int i=0; i<4; i++){
+        uint32_t disabled = i == 0 ? 0 : 0x80000000;
+        addObject(0x1400 + i, 0, 1, 2, false);
+        addObject(0x1400 + i, 1, 4, disabled | (0x200 + 0x100*i + _nodeid));
+        addObject(0x1400 + i, 2, 1, 255);
+        addObject(0x1600 + i, 0, 1, i == 0 ? 1 : 0);
+        addObject(0x1800 + i, 0, 1, 5, false);
+        addObject(0x1800 + i, 1, 4, disabled | (0x180 + 0x100*i + _nodeid));
+        addObject(0x1800 + i, 2, 1, 255);
+        addObject(0x1800 + i, 3, 2, 0);           // inhibit time (100us)
+        addObject(0x1800 + i, 5, 2, 0);           // event timer (ms)
+        addObject(0x1A00 + i, 0, 1, i == 0 ? 1 : 0);
+        for(int j=1; j<=8; j++){
+            addObject(0x1600 + i, j, 4, i == 0 && j == 1 ? 0x60400010 : 0);
+            addObject(0x1A00 + i, j, 4, i == 0 && j == 1 ? 0x60410010 : 0);
+        }
+    }
+    if(communicationOnly) return;
+
+    addObject(0x6040, 0, 2, 0, true, true);                           // controlword
+    addObject(0x6041, 0, 2, 0, false, true);                          // statusword
+    addObject(0x6060, 0, 1, DS402_MODE_PPOS, true, true);             // modes of operation
+    addObject(0x6061, 0, 1, DS402_MODE_PPOS, false, true);            // modes of operation display
+    addObject(0x6063, 0, 4, 0, false, true);                          // position actual value (internal)
+    addObject(0x6064, 0, 4, 0, false, true);                          // position actual value
+    addObject(0x606C, 0, 4, 0, false, true);                          // velocity actual value
+    addObject(0x607A, 0, 4, 0, true, true);                           // target position
+    addObject(0x607F, 0, 4, _config.maxVelocity, true, true);         // max profile velocity
+    addObject(0x6081, 0, 4, _config.velocity, true, true);            // profile velocity
+    addObject(0x6083, 0, 4, _config.acceleration, true, true);        // profile acceleration
+    addObject(0x6084, 0, 4, _config.deceleration, true, true);        // profile deceleration
+    addObject(0x6085, 0, 4, _config.deceleration, true, true);        // quick stop deceleration
+    addObject(0x60FF, 0, 4, 0, true, true);                           // target velocity
+    addObject(0x60C0, 0, 2, 0);                                       // interpolation sub mode: linear
+    addObject(0x60C1, 0, 1, 1, false);                                // interpolation data record
+    addObject(0x60C1, 1, 4, 0, true, true);
+    addObject(0x60C2, 0, 1, 2, false);                                // interpolation time period
+    addObject(0x60C2, 1, 1, 1);
+    addObject(0x60C2, 2, 1, (uint8_t)-3);
+    addObject(0x60C4, 0, 1, 6, false);                                // interpolation data configuration
+    addObject(0x60C4, 1, 4, 16, false);                               // max buffer size
+    addObject(0x60C4, 2, 4, 16);                                      // actual buffer size
+    addObject(0x60C4, 3, 1, 0);                                       // buffer organization: FIFO
+    addObject(0x60C4, 4, 2, 0);                                       // buffer position
+    addObject(0x60C4, 5, 1, 4, false);                                // size of data record
+    addObject(0x60C4, 6, 1, 0);                                       // buffer clear
+    addObject(0x6502, 0, 4, 0x000000C5, false);                       // supported modes: PP, PV, IP, CSP
+}
+
+uint32_t VirtualDrive::get(uint16_t index, uint8_t subindex){
+    std::map<uint32_t, Object>::iterator it = _od.find(KEY(index, subindex));
+    if(it == _od.end()) return 0;
+    uint32_t value = 0;
+    for(size_t i=0; i<it->second.data.size() && i<4; i++){
+        value |= (uint32_t)it->second.data[i] << (8*i);
+    }
+    return value;
+}
+
+void VirtualDrive::set(uint16_t index, uint8_t subindex, uint32_t value){
+    std::map<uint32_t, Object>::iterator it = _od.find(KEY(index, subindex));
+    if(it == _od.end()) return;
+    for(size_t i=0; i<it->second.data.size() && i<4; i++){
+        it->second.data[i] = (value >> (8*i)) & 0xFF;
+    }
+}
+
+uint32_t VirtualDrive::checkAccess(uint32_t key, bool write){
+    std::map<uint32_t, Object>::iterator it = _od.find(key);
+    if(it == _od.end()){
+        // the index may exist without this subindex
+        std::map<uint32_t, Object>::iterator first = _od.lower_bound(key & 0xFFFF00);
+        return first != _od.end() && (first->first >> 8) == (key >> 8) ? ABORT_NO_SUBINDEX : ABORT_NO_OBJECT;
+    }
+    if(write && !it->second.writable) return ABORT_READ_ONLY;
+    return 0;
+}
+
+uint32_t VirtualDrive::checkWrite(uint32_t key, const std::vector<uint8_t>& data){
+    // function to check an SDO write before it is done, return the abort code (0: accepted)
+    uint32_t abortCode = checkAccess(key, true);
+    if(abortCode != 0) return abortCode;
+    size_t size = _od[key].data.size();
+    if(data.size() > size) return ABORT_LENGTH_HIGH;
+    if(data.size() < size) return ABORT_LENGTH_LOW;
+
+    uint16_t index = key >> 8;
+    uint8_t subindex = key & 0xFF;
+    uint32_t value = 0;
+    for(size_t i=0; i<data.size() && i<4; i++){
+        value |= (uint32_t)data[i] << (8*i);
+    }
+
+    // the COB-ID of a PDO can only be changed while the PDO is disabled (bit 31)
+    if(((index & 0xFFFC) == 0x1400 || (index & 0xFFFC) == 0x1800) && subindex == 1){
+        uint32_t cobid = get(index, 1);
+        if(!(cobid & 0x80000000) && !(value & 0x80000000) && value != cobid) return ABORT_VALUE;
+    }
+
+    // the mapping of a PDO can only be changed while the PDO is disabled and its number of entries is 0 (CiA 301)
+    if((index & 0xFFFC) == 0x1600 || (index & 0xFFFC) == 0x1A00){
+        if(!(get(index - 0x200, 1) & 0x80000000)) return ABORT_DEVICE_STATE;
+        if(subindex != 0 && get(index, 0) != 0) return ABORT_DEVICE_STATE;
+        if(subindex == 0){
+            if(value > 8) return ABORT_VALUE_HIGH;
+            unsigned int bits = 0;
+            for(unsigned int i=1; i<=value; i++){
+                uint32_t entry = get(index, i);
+                std::map<uint32_t, Object>::iterator it = _od.find(KEY(entry >> 16, (entry >> 8) & 0xFF));
+                if(it == _od.end() || !it->second.mappable || it->second.data.size() * 8 != (entry & 0xFF)) return ABORT_NOT_MAPPABLE;
+                bits += entry & 0xFF;
+            }
+            if(bits > 64) return ABORT_PDO_LENGTH;
+        }
+    }
+
+    if(index == 0x6060){
+        int8_t mode = value;
+        if(mode != DS402_MODE_PPOS && mode != DS402_MODE_PVEL && mode != DS402_MODE_IPOS && mode != DS402_MODE_CSP) return ABORT_VALUE;
+    }
+    return 0;
+}
+
+void VirtualDrive::write(uint32_t key, const std::vector<uint8_t>& data){
+    // function to write an object (SDO already checked or mapped RPDO) and apply its effect on the drive
+    std::map<uint32_t, Object>::iterator it = _od.find(key);
+    if(it == _od.end()) return;
+    std::copy(data.begin(), data.begin() + std::min(data.size(), it->second.data.size()), it->second.data.begin());
+
+    uint16_t index = key >> 8;
+    uint8_t subindex = key & 0xFF;
+    if(index == 0x6040){
+        onControlword(get(0x6040));
+    }else if(index == 0x6060){
+        int8_t mode = get(0x6060);
+        if(mode != (int8_t)get(0x6061)){
+            // a new mode starts from where the axis is
+            stopMotion();
+            set(0x607A, 0, lround(_position));
+            _ipBuffer.clear();
+            set(0x6061, 0, (uint8_t)mode);
+        }
+        updateStatusword();
+    }else if(index == 0x1017){
+        _nextHeartbeat = Clock::now() + std::chrono::milliseconds(get(0x1017));
+    }else if(index == 0x60C4 && subindex == 6){
+        _ipBufferEnabled = get(0x60C4, 6) != 0;
+        if(!_ipBufferEnabled) _ipBuffer.clear();
+    }else if(index == 0x60C1 && subindex == 1){
+        // the set points are queued until the SYNC takes them, the ones arriving on a full buffer are lost
+        if(_ipBufferEnabled && _ipBuffer.size() < get(0x60C4, 2)) _ipBuffer.push_back(get(0x60C1, 1));
+    }else if((index & 0xFFFC) == 0x1400 && subindex == 1){
+        _rpdoData[index & 0x3].clear();
+    }else if((index & 0xFFFC) == 0x1800 && subindex == 1){
+        _tpdoLast[index & 0x3].clear(); // sent at the first occasion once enabled
+    }
+}
+
+void VirtualDrive::sendFrame(canid_t cobid, const uint8_t* data, int len){
+    struct can_frame frame;
+    memset(&frame, 0, sizeof(frame));
+    frame.can_id = cobid;
+    frame.can_dlc = len;
+    memcpy(frame.data, data, len);
+    int errorCode;
+    _can->SendMsg(frame, false, false, errorCode);
+}
+
+void VirtualDrive::sendSdo(uint8_t command, uint32_t key, const uint8_t* data, int len){
+    uint8_t response[8];
+    memset(response, 0, sizeof(response));
+    response[0] = command;
+    response[1] = (key >> 8) & 0xFF;
+    response[2] = (key >> 16) & 0xFF;
+    response[3] = key & 0xFF;
+    if(len > 0) memcpy(&response[4], data, std::min(len, 4));
+    sendFrame(0x580 + _nodeid, response, 8);
+}
+
+void VirtualDrive::sendAbort(uint32_t key, uint32_t abortCode){
+    uint8_t code[4];
+    for(int i=0; i<4; i++){
+        code[i] = (abortCode >> (8*i)) & 0xFF;
+    }
+    _segmented.active = false;
+    sendSdo(0x80, key, code, 4);
+}
+
+void VirtualDrive::processSdo(const struct can_frame& request){
+    // SDO server: expedited and segmented transfers, the block ones are refused
+    if(_booting || _nmtState == NMT_STATE_STOP) return; // no SDO in the stopped state
+    _sdoCount++;
+    uint8_t command = request.data[0];
+    uint32_t key = KEY(request.data[1] | (request.data[2] << 8), request.data[3]);
+
+    switch(command >> 5){
+    case 1: { // initiate download
+        uint32_t abortCode = checkAccess(key, true);
+        if(abortCode != 0){
+            sendAbort(key, abortCode);
+            break;
+        }
+        if(command & 0x02){
+            // expedited, the size is given by the command (bit 0) or is the one of the object
+            size_t size = (command & 0x01) ? 4 - ((command >> 2) & 0x3) : std::min((size_t)4, _od[key].data.size());
+            std::vector<uint8_t> data(&request.data[4], &request.data[4] + size);
+            abortCode = checkWrite(key, data);
+            if(abortCode != 0){
+                sendAbort(key, abortCode);
+                break;
+            }
+            write(key, data);
+            sendSdo(0x60, key, NULL, 0);
+        }else{
+            _segmented.active = true;
+            _segmented.upload = false;
+            _segmented.key = key;
+            _segmented.toggle = 0;
+            _segmented.data.clear();
+            sendSdo(0x60, key, NULL, 0);
+        }
+        break;
+    }
+    case 0: { // download segment
+        if(!_segmented.active || _segmented.upload){
+            sendAbort(key, ABORT_COMMAND);
+            break;
+        }
+        if((command & 0x10) != _segmented.toggle){
+            sendAbort(_segmented.key, ABORT_TOGGLE);
+            break;
+        }
+        int n = 7 - ((command >> 1) & 0x7);
+        _segmented.data.insert(_segmented.data.end(), &request.data[1], &request.data[1] + n);
+        uint8_t response[8];
+        memset(response, 0, sizeof(response));
+        response[0] = 0x20 | _segmented.toggle;
+        _segmented.toggle ^= 0x10;
+        if(command & 0x01){
+            // last segment: the whole object is checked before the confirmation
+            _segmented.active = false;
+            uint32_t abortCode = checkWrite(_segmented.key, _segmented.data);
+            if(abortCode != 0){
+                sendAbort(_segmented.key, abortCode);
+                break;
+            }
+            write(_segmented.key, _segmented.data);
+        }
+        sendFrame(0x580 + _nodeid, response, 8);
+        break;
+    }
+    case 2: { // initiate upload
+        uint32_t abortCode = checkAccess(key, false);
+        if(abortCode != 0){
+            sendAbort(key, abortCode);
+            break;
+        }
+        const std::vector<uint8_t>& data = _od[key].data;
+        if(data.size() <= 4){
+            sendSdo(0x43 | ((4 - data.size()) << 2), key, &data[0], data.size());
+        }else{
+            uint8_t size[4];
+            for(int i=0; i<4; i++){
+                size[i] = (data.size() >> (8*i)) & 0xFF;
+            }
+            _segmented.active = true;
+            _segmented.upload = true;
+            _segmented.key = key;
+            _segmented.toggle = 0;
+            _segmented.data = data;
+            _segmented.offset = 0;
+            sendSdo(0x41, key, size, 4);
+        }
+        break;
+    }
+    case 3: { // upload segment
+        if(!_segmented.active || !_segmented.upload){
+            sendAbort(key, ABORT_COMMAND);
+            break;
+        }
+        if((command & 0x10) != _segmented.toggle){
+            sendAbort(_segmented.key, ABORT_TOGGLE);
+            break;
+        }
+        size_t n = std::min((size_t)7, _segmented.data.size() - _segmented.offset);
+        bool last = _segmented.offset + n == _segmented.data.size();
+        uint8_t response[8];
+        memset(response, 0, sizeof(response));
+        response[0] = _segmented.toggle | ((7 - n) << 1) | (last ? 0x01 : 0x00);
+        memcpy(&response[1], &_segmented.data[_segmented.offset], n);
+        _segmented.offset += n;
+        _segmented.toggle ^= 0x10;
+        if(last) _segmented.active = false;
+        sendFrame(0x580 + _nodeid, response, 8);
+        break;
+    }
+    case 4: // abort from the client
+        _segmented.active = false;
+        break;
+    default: // block transfers and unknown commands
+        sendAbort(key, ABORT_COMMAND);
+        break;
+    }
+}
+
+void VirtualDrive::onNmt(uint8_t command){
+    switch(command){
+    case 0x01:
+        _nmtState = NMT_STATE_OP;
+        break;
+    case 0x02:
+        _nmtState = NMT_STATE_STOP;
+        break;
+    case 0x80:
+        _nmtState = NMT_STATE_PREOP;
+        break;
+    case 0x81: // reset node
+    case 0x82: // reset communication
+        _resetApplication = command == 0x81;
+        _nmtState = NMT_STATE_INIT;
+        _booting = true;
+        _bootAt = Clock::now() + std::chrono::milliseconds(_config.bootMs);
+        _cond.notify_all();
+        break;
+    default:
+        break;
+    }
+}
+
+void VirtualDrive::onSync(){
+    // the synchronous RPDO are applied, the cyclic modes take their set point, then the synchronous TPDO are sent
+    _syncCount++;
+    for(int i=0; i<4; i++){
+        if(_rpdoData[i].empty()) continue;
+        applyRpdo(i, &_rpdoData[i][0], _rpdoData[i].size());
+        _rpdoData[i].clear();
+    }
+    if(_state == DS402_ENABLED){
+        int8_t mode = get(0x6061);
+        if(mode == DS402_MODE_CSP){
+            _position = (int32_t)get(0x607A);
+            _velocity = 0;
+        }else if(mode == DS402_MODE_IPOS && (_controlword & 0x10) && !_ipBuffer.empty()){
+            _position = _ipBuffer.front();
+            _ipBuffer.pop_front();
+        }
+    }
+    updatePosition();
+    updateStatusword();
+    sendTpdos(true);
+}
+
+void VirtualDrive::applyRpdo(int pdo, const uint8_t* data, int len){
+    // function to write the objects mapped in an RPDO, in the order of the mapping
+    unsigned int count = get(0x1600 + pdo, 0);
+    int needed = 0;
+    for(unsigned int i=1; i<=count; i++){
+        needed += (get(0x1600 + pdo, i) & 0xFF) / 8;
+    }
+    if(len < needed){
+        sendEmcy(0x8210, get(0x1001) | 0x10); // PDO not processed due to length error
+        return;
+    }
+    int offset = 0;
+    for(unsigned int i=1; i<=count; i++){
+        uint32_t entry = get(0x1600 + pdo, i);
+        int size = (entry & 0xFF) / 8;
+        write(KEY(entry >> 16, (entry >> 8) & 0xFF), std::vector<uint8_t>(data + offset, data + offset + size));
+        offset += size;
+    }
+}
+
+bool VirtualDrive::packTpdo(int pdo, std::vector<uint8_t>& data){
+    data.clear();
+    unsigned int count = get(0x1A00 + pdo, 0);
+    for(unsigned int i=1; i<=count; i++){
+        uint32_t entry = get(0x1A00 + pdo, i);
+        std::map<uint32_t, Object>::iterator it = _od.find(KEY(entry >> 16, (entry >> 8) & 0xFF));
+        if(it == _od.end()) return false;
+        data.insert(data.end(), it->second.data.begin(), it->second.data.end());
+    }
+    return count > 0 && data.size() <= 8;
+}
+
+void VirtualDrive::sendTpdos(bool sync){
+    // function to send the TPDO due: on change (inhibit time) or event timer for the types 254/255, at the SYNC for the others
+    if(_nmtState != NMT_STATE_OP) return;
+    Clock::time_point now = Clock::now();
+    std::vector<uint8_t> data;
+    for(int i=0; i<4; i++){
+        uint32_t cobid = get(0x1800 + i, 1);
+        if(cobid & 0x80000000) continue;
+        if(!packTpdo(i, data)) continue;
+        uint8_t type = get(0x1800 + i, 2);
+        bool send = false;
+        if(type >= 254){
+            if(sync) continue;
+            std::chrono::microseconds inhibit(100 * get(0x1800 + i, 3));
+            std::chrono::milliseconds eventTimer(get(0x1800 + i, 5));
+            if(data != _tpdoLast[i] && now - _tpdoSent[i] >= inhibit) send = true;
+            if(eventTimer.count() > 0 && now - _tpdoSent[i] >= eventTimer) send = true;
+        }else if(sync){
+            if(type == 0) send = data != _tpdoLast[i];      // acyclic synchronous
+            else if(type <= 240) send = _syncCount % type == 0;
+        }
+        if(!send) continue;
+        sendFrame(cobid & 0x7FF, &data[0], data.size());
+        _tpdoLast[i] = data;
+        _tpdoSent[i] = now;
+    }
+}
+
+void VirtualDrive::sendEmcy(uint16_t code, uint8_t errorRegister){
+    uint8_t emcy[8];
+    memset(emcy, 0, sizeof(emcy));
+    emcy[0] = code & 0xFF;
+    emcy[1] = code >> 8;
+    emcy[2] = errorRegister;
+    sendFrame(0x080 + _nodeid, emcy, 8);
+}
+
+void VirtualDrive::onControlword(uint16_t controlword){
+    // CiA 402 state machine, then the bits of the mode of operation
+    uint16_t previous = _controlword;
+    unsigned int state = _state;
+    _controlword = controlword;
+
+    if(_state == DS402_FAULT){
+        if((controlword & 0x80) && !(previous & 0x80)){ // fault reset on the rising edge of bit 7
+            _state = DS402_DISABLED;
+            set(0x1001, 0, 0);
+            sendEmcy(0x0000, 0);
+        }
+    }else if((controlword & 0x82) == 0x00){ // disable voltage
+        _state = DS402_DISABLED;
+    }else if((controlword & 0x86) == 0x02){ // quick stop
+        if(_state == DS402_ENABLED) _state = DS402_QUICKSTOP;
+        else if(_state != DS402_QUICKSTOP) _state = DS402_DISABLED;
+    }else if((controlword & 0x87) == 0x06){ // shutdown
+        if(_state == DS402_DISABLED || _state == DS402_SWITCHEDON || _state == DS402_ENABLED) _state = DS402_READY;
+    }else if((controlword & 0x8F) == 0x07){ // switch on / disable operation
+        if(_state == DS402_READY || _state == DS402_ENABLED) _state = DS402_SWITCHEDON;
+    }else if((controlword & 0x8F) == 0x0F){ // enable operation
+        if(_state == DS402_SWITCHEDON || _state == DS402_QUICKSTOP) _state = DS402_ENABLED;
+    }
+
+    if(state == DS402_ENABLED && _state != DS402_ENABLED && _state != DS402_QUICKSTOP) stopMotion();
+
+    if(_state == DS402_ENABLED && (int8_t)get(0x6061) == DS402_MODE_PPOS){
+        if((controlword & 0x10) && !(previous & 0x10)) newSetPoint(controlword);
+        if(!(controlword & 0x10) && !_hasNext) _setPointAck = false; // end of the handshake
+    }
+    updateStatusword();
+}
+
+void VirtualDrive::newSetPoint(uint16_t controlword){
+    // rising edge of bit 4 in profile position: the set point is taken at once (bit 5 or axis at rest)
+    // or buffered until the current target is reached. Ignored while the previous one is not released (bit 12).
+    if(_setPointAck) return;
+    double target = (int32_t)get(0x607A);
+    if(controlword & 0x40) target += _target; // relative to the previous target
+    if((controlword & 0x20) || _targetReached){
+        _target = target;
+        _hasNext = false;
+    }else{
+        _nextTarget = target;
+        _hasNext = true;
+    }
+    _setPointAck = true;
+    _targetReached = false;
+}
+
+void VirtualDrive::stopMotion(){
+    _velocity = 0;
+    _target = _position;
+    _hasNext = false;
+    _setPointAck = false;
+    _targetReached = true;
+}
+
+void VirtualDrive::moveToward(double target, double dt){
+    // one cycle of a trapezoidal profile toward target: accelerate up to the profile velocity,
+    // brake when the remaining distance is the braking distance. The set point can change on the way.
+    double velocity = get(0x6081);
+    double maxVelocity = get(0x607F);
+    if(maxVelocity > 0 && velocity > maxVelocity) velocity = maxVelocity;
+    double acceleration = get(0x6083);
+    double deceleration = get(0x6084);
+    if(acceleration <= 0) acceleration = 1e12; // no ramp
+    if(deceleration <= 0) deceleration = 1e12;
+
+    double distance = target - _position;
+    double direction = distance >= 0 ? 1 : -1;
+    double speed = _velocity * direction; // toward the target
+    if(speed < 0){
+        speed = std::min(0.0, speed + deceleration * dt); // going away: brake first
+    }else if(fabs(distance) <= speed * speed / (2 * deceleration)){
+        speed = std::max(0.0, speed - deceleration * dt);
+    }else if(speed > velocity){
+        speed = std::max(velocity, speed - deceleration * dt);
+    }else{
+        speed = std::min(velocity, speed + acceleration * dt);
+    }
+
+    if(speed >= 0 && (speed * dt >= fabs(distance) || (fabs(distance) < 0.5 && speed <= deceleration * dt))){
+        _position = target;
+        _velocity = 0;
+        return;
+    }
+    _position += speed * direction * dt;
+    _velocity = speed * direction;
+}
+
+void VirtualDrive::brake(double deceleration, double dt){
+    if(deceleration <= 0) deceleration = 1e12;
+    if(_velocity > 0) _velocity = std::max(0.0, _velocity - deceleration * dt);
+    else _velocity = std::min(0.0, _velocity + deceleration * dt);
+    _position += _velocity * dt;
+}
+
+void VirtualDrive::step(double dt){
+    // one cycle of the motion control loop
+    if(_state == DS402_QUICKSTOP){
+        brake(get(0x6085), dt);
+        _target = _position;
+    }else if(_state == DS402_ENABLED){
+        int8_t mode = get(0x6061);
+        if(mode == DS402_MODE_PPOS){
+            if(_controlword & 0x100){
+                brake(get(0x6084), dt); // halt, the move goes on when bit 8 is released
+            }else if(!_targetReached){
+                moveToward(_target, dt);
+                if(_position == _target && _velocity == 0){
+                    if(_hasNext){
+                        _target = _nextTarget; // the buffered set point starts, the buffer is free again
+                        _hasNext = false;
+                        if(!(_controlword & 0x10)) _setPointAck = false;
+                    }else{
+                        _targetReached = true;
+                    }
+                }
+            }
+        }else if(mode == DS402_MODE_PVEL){
+            double target = (int32_t)get(0x60FF);
+            double ramp = (fabs(target) > fabs(_velocity) ? get(0x6083) : get(0x6084)) * dt;
+            if(ramp <= 0) ramp = 1e12;
+            if(_velocity < target) _velocity = std::min(target, _velocity + ramp);
+            else _velocity = std::max(target, _velocity - ramp);
+            _position += _velocity * dt;
+            _targetReached = _velocity == target;
+        }
+    }
+    updatePosition();
+    updateStatusword();
+}
+
+void VirtualDrive::updatePosition(){
+    set(0x6063, 0, (int32_t)lround(_position));
+    set(0x6064, 0, (int32_t)lround(_position));
+    set(0x606C, 0, (int32_t)lround(_velocity));
+}
+
+void VirtualDrive::updateStatusword(){
+    uint16_t statusword = _state | 0x0200; // bit 9: remote
+    if(_state == DS402_ENABLED || _state == DS402_QUICKSTOP){
+        int8_t mode = get(0x6061);
+        if(mode == DS402_MODE_PPOS){
+            if(_setPointAck) statusword |= 0x1000;
+            if(_controlword & 0x100){
+                if(_velocity == 0) statusword |= 0x0400; // halted
+            }else if(_targetReached){
+                statusword |= 0x0400;
+            }
+        }else if(mode == DS402_MODE_PVEL){
+            if(_targetReached) statusword |= 0x0400;
+            if(_velocity == 0) statusword |= 0x1000; // speed 0
+        }else if(mode == DS402_MODE_IPOS){
+            if(_controlword & 0x10) statusword |= 0x1000; // interpolation active
+            if(_ipBuffer.empty()) statusword |= 0x0400;
+        }else if(mode == DS402_MODE_CSP){
+            statusword |= 0x1000; // the target position is followed
+        }
+    }
+    set(0x6041, 0, statusword);
+}
@@ -0,0 +1,156 @@
+#ifndef VIRTUALDRIVE_H
+#define VIRTUALDRIVE_H
+
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+#include "cantransport.h"
+#include "canreceiver.h"
+
+// Behaviour of the simulated drives
+struct VirtualDriveConfig
+{
+    int latencyUs;         // time taken by the drive to answer an SDO request
+    int jitterUs;          // random extra time added to each answer, from 0 to jitterUs
+    int cycleUs;           // period of the motion control loop (profile generator, TPDO timers, heartbeat)
+    int bootMs;            // time from an NMT reset to the boot-up message
+    uint32_t velocity;     // default profile velocity 0x6081 (counts/s)
+    uint32_t acceleration; // default profile acceleration 0x6083 (counts/s^2)
+    uint32_t deceleration; // default profile deceleration 0x6084 (counts/s^2)
+    uint32_t maxVelocity;  // default max profile velocity 0x607F (counts/s)
+};
+
+VirtualDriveConfig defaultVirtualDriveConfig();
+
+// Simulated CiA 402 servo drive, attached to a vcan interface or to a loopback bus like a real node:
+// - NMT slave: boot-up message, reset node/communication, pre-operational/operational/stopped, heartbeat producer (0x1017)
+// - SDO server: expedited and segmented transfers, CiA 301 abort codes (the block transfers are refused,
+//   so the clients fall back to the segmented ones)
+// - 4 RPDO and 4 TPDO with a configurable mapping, event-driven (254/255) or synchronous transmission
+// - CiA 402 state machine (the statuswords are the ones decoded by Motor_CANOpen_Driver::getStateFromStatusWord)
+// - profile position (trapezoidal profile, set point handshake of bits 4/5/12, target reached bit 10), profile velocity,
+//   interpolated position (set point FIFO 0x60C1 taken at each SYNC) and cyclic synchronous position
+// No physical model: the actual position is the demand of the profile generator, there is no following error.
+// The frames are handled by a CanReceiver thread and the time based work by a thread of the drive.
+class VirtualDrive
+{
+public:
+    VirtualDrive(uint8_t nodeid, const VirtualDriveConfig& config);
+    ~VirtualDrive();
+
+    bool start(const char* interfaceName, int& errorCode); // function to power the drive on: it opens its own socket and sends its boot-up
+    void stop();
+
+    uint8_t getNodeId() const { return _nodeid; }
+    int32_t getPosition();
+    uint16_t getStatusword();
+    uint8_t getNmtState();
+    unsigned long getSdoCount(); // SDO requests answered since the start
+
+    void injectFault(uint16_t emcyCode); // function to put the drive in fault, as after an error detected by the drive (EMCY sent)
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Object{
+        std::vector<uint8_t> data; // little endian value, its size is the size of the object
+        bool writable;
+        bool mappable;
+    };
+
+    struct PendingSdo{
+        Clock::time_point due;
+        struct can_frame request;
+    };
+
+    struct Segmented{
+        bool active;
+        bool upload;
+        uint32_t key;
+        uint8_t toggle;
+        std::vector<uint8_t> data;
+        size_t offset;
+    };
+
+    void loop();
+    void onFrame(const CanRxFrame& rx);
+
+    void boot();
+    void resetObjects(bool communicationOnly);
+    void addObject(uint16_t index, uint8_t subindex, size_t size, uint32_t value, bool writable = true, bool mappable = false);
+    void addString(uint16_t index, const char* value);
+    uint32_t get(uint16_t index, uint8_t subindex = 0);
+    void set(uint16_t index, uint8_t subindex, uint32_t value);
+
+    void processSdo(const struct can_frame& request);
+    void sendSdo(uint8_t command, uint32_t key, const uint8_t* data, int len);
+    void sendAbort(uint32_t key, uint32_t abortCode);
+    uint32_t checkAccess(uint32_t key, bool write);
+    uint32_t checkWrite(uint32_t key, const std::vector<uint8_t>& data);
+    void write(uint32_t key, const std::vector<uint8_t>& data);
+
+    void onNmt(uint8_t command);
+    void onSync();
+    void applyRpdo(int pdo, const uint8_t* data, int len);
+    void sendTpdos(bool sync);
+    bool packTpdo(int pdo, std::vector<uint8_t>& data);
+    void sendEmcy(uint16_t code, uint8_t errorRegister);
+    void sendFrame(canid_t cobid, const uint8_t* data, int len);
+
+    void onControlword(uint16_t controlword);
+    void newSetPoint(uint16_t controlword);
+    void stopMotion();
+    void step(double dt);
+    void moveToward(double target, double dt);
+    void brake(double deceleration, double dt);
+    void updateStatusword();
+    void updatePosition();
+
+    uint8_t _nodeid;
+    VirtualDriveConfig _config;
+    CanTransport* _can;
+    CanReceiver* _rx;
+
+    std::mutex _mutex; // everything below, taken by the reception thread, the drive thread and the accessors
+    std::condition_variable _cond;
+    std::thread _thread;
+    bool _running;
+
+    std::map<uint32_t, Object> _od; // key: index << 8 | subindex
+    uint8_t _nmtState;
+    Clock::time_point _bootAt;     // pending boot-up after a reset
+    bool _booting;
+    bool _resetApplication;        // reset node (true) or reset communication (false)
+    Clock::time_point _nextHeartbeat;
+
+    std::deque<PendingSdo> _sdoQueue; // requests waiting for the latency of the drive, answered in order
+    Segmented _segmented;
+    unsigned long _sdoCount;
+    std::minstd_rand _random;
+
+    std::vector<uint8_t> _rpdoData[4];  // synchronous RPDO received, applied at the next SYNC
+    std::vector<uint8_t> _tpdoLast[4];  // last data sent by each TPDO
+    Clock::time_point _tpdoSent[4];
+    unsigned int _syncCount;
+
+    unsigned int _state;     // CiA 402 state, as the bits 0-6 of the statusword
+    uint16_t _controlword;   // last controlword written
+    double _position;        // counts
+    double _velocity;        // counts/s
+    double _target;          // target of the profile generator (profile position)
+    double _nextTarget;      // buffered set point, started when the current one is reached
+    bool _hasNext;
+    bool _setPointAck;       // statusword bit 12 in profile position
+    bool _targetReached;     // statusword bit 10
+    std::deque<int32_t> _ipBuffer;
+    bool _ipBufferEnabled;
+};
+
+#endif // VIRTUALDRIVE_H